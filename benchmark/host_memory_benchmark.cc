@@ -0,0 +1,103 @@
+/****************************************************************
+ * Copyright (c) 2022, liyinbin
+ * All rights reserved.
+ * Author by liyinbin (jeff.li) lijippy@163.com
+ *****************************************************************/
+
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+#include <benchmark/benchmark.h>
+#include "hercules/core/host_memory.h"
+
+namespace hercules::core {
+
+    namespace {
+
+        constexpr uint64_t kBufferSize = 512 << 20;
+
+        // A source and a destination buffer backed by the pages of 'mode',
+        // touched once so that page faults are not measured.
+        struct buffer_pair {
+            explicit buffer_pair(huge_page_mode mode) {
+                ok_ = map_host_memory(kBufferSize, mode, &src_).is_ok() &&
+                      map_host_memory(kBufferSize, mode, &dst_).is_ok();
+                if (ok_) {
+                    memset(src_.addr_, 1, kBufferSize);
+                    memset(dst_.addr_, 0, kBufferSize);
+                }
+            }
+
+            ~buffer_pair() {
+                unmap_host_memory(src_);
+                unmap_host_memory(dst_);
+            }
+
+            std::string label() const {
+                if (src_.page_size_ > base_page_size()) {
+                    return "reserved huge pages";
+                }
+                return src_.transparent_huge_pages_ ? "transparent huge pages" : "regular pages";
+            }
+
+            bool ok_;
+            host_mapping src_;
+            host_mapping dst_;
+        };
+
+        // Large sequential copies, as when staging whole tensors.
+        void
+        BM_HostCopy(benchmark::State &state) {
+            buffer_pair buffers(static_cast<huge_page_mode>(state.range(0)));
+            if (!buffers.ok_) {
+                state.SkipWithError("unable to map the buffers");
+                return;
+            }
+            for (auto _ : state) {
+                memcpy(buffers.dst_.addr_, buffers.src_.addr_, kBufferSize);
+                benchmark::ClobberMemory();
+            }
+            state.SetBytesProcessed(state.iterations() * kBufferSize);
+            state.SetLabel(buffers.label());
+        }
+
+        // Copies of 'state.range(1)' bytes at random offsets, as when
+        // gathering rows of a batch. Every copy is likely a TLB miss with
+        // regular pages.
+        void
+        BM_HostGather(benchmark::State &state) {
+            buffer_pair buffers(static_cast<huge_page_mode>(state.range(0)));
+            if (!buffers.ok_) {
+                state.SkipWithError("unable to map the buffers");
+                return;
+            }
+            const auto row = static_cast<uint64_t>(state.range(1));
+            const uint64_t rows = kBufferSize / row;
+            std::vector<uint64_t> order(rows);
+            std::mt19937_64 rng(42);
+            for (auto &index : order) {
+                index = rng() % rows;
+            }
+            auto *src = static_cast<const char *>(buffers.src_.addr_);
+            auto *dst = static_cast<char *>(buffers.dst_.addr_);
+            for (auto _ : state) {
+                for (uint64_t i = 0; i < rows; ++i) {
+                    memcpy(dst + i * row, src + order[i] * row, row);
+                }
+                benchmark::ClobberMemory();
+            }
+            state.SetBytesProcessed(state.iterations() * kBufferSize);
+            state.SetLabel(buffers.label());
+        }
+
+    }  // namespace
+
+    // The first argument is the huge_page_mode.
+    BENCHMARK(BM_HostCopy)->DenseRange(0, 2)->Unit(benchmark::kMillisecond)->UseRealTime();
+    BENCHMARK(BM_HostGather)
+            ->ArgsProduct({{0, 1, 2}, {64, 512}})
+            ->Unit(benchmark::kMillisecond)
+            ->UseRealTime();
+
+}  // namespace hercules::core
@@ -0,0 +1,160 @@
+/****************************************************************
+ * Copyright (c) 2022, liyinbin
+ * All rights reserved.
+ * Author by liyinbin (jeff.li) lijippy@163.com
+ *****************************************************************/
+
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <vector>
+#include <benchmark/benchmark.h>
+#include "hercules/common/cnmem.h"
+#include "hercules/core/host_pool_allocator.h"
+
+namespace hercules::core {
+
+    namespace {
+
+        constexpr uint64_t kPoolSize = 512 << 20;
+
+        // The previous cnmem arena: free blocks in a list in address order,
+        // scanned in full for the best fit, and used blocks in a list
+        // searched on release.
+        class linear_scan_arena {
+        public:
+            linear_scan_arena(void *buffer, uint64_t size)
+                    : free_(new block{static_cast<char *>(buffer), size, nullptr}) {
+            }
+
+            ~linear_scan_arena() {
+                for (block *list : {free_, used_}) {
+                    while (list != nullptr) {
+                        block *next = list->next_;
+                        delete list;
+                        list = next;
+                    }
+                }
+            }
+
+            void *allocate(uint64_t size) {
+                block *best = nullptr;
+                block *best_prev = nullptr;
+                for (block *b = free_, *prev = nullptr; b != nullptr; prev = b, b = b->next_) {
+                    if ((b->size_ >= size) && ((best == nullptr) || (b->size_ < best->size_))) {
+                        best = b;
+                        best_prev = prev;
+                    }
+                }
+                if (best == nullptr) {
+                    return nullptr;
+                }
+                block *next = best->next_;
+                if (best->size_ != size) {
+                    next = new block{best->data_ + size, best->size_ - size, best->next_};
+                    best->size_ = size;
+                }
+                (best_prev != nullptr ? best_prev->next_ : free_) = next;
+                best->next_ = used_;
+                used_ = best;
+                return best->data_;
+            }
+
+            void deallocate(void *ptr) {
+                block *curr = used_;
+                block *prev = nullptr;
+                for (; (curr != nullptr) && (curr->data_ != ptr); prev = curr, curr = curr->next_) {
+                }
+                if (curr == nullptr) {
+                    return;
+                }
+                (prev != nullptr ? prev->next_ : used_) = curr->next_;
+
+                prev = nullptr;
+                block *next = free_;
+                for (; (next != nullptr) && (next->data_ < curr->data_); prev = next, next = next->next_) {
+                }
+                if ((prev != nullptr) && (prev->data_ + prev->size_ == curr->data_)) {
+                    prev->size_ += curr->size_;
+                    delete curr;
+                    curr = prev;
+                } else if (prev != nullptr) {
+                    prev->next_ = curr;
+                } else {
+                    free_ = curr;
+                }
+                if ((next != nullptr) && (curr->data_ + curr->size_ == next->data_)) {
+                    curr->size_ += next->size_;
+                    curr->next_ = next->next_;
+                    delete next;
+                } else {
+                    curr->next_ = next;
+                }
+            }
+
+        private:
+            struct block {
+                char *data_;
+                uint64_t size_;
+                block *next_;
+            };
+
+            block *free_;
+            block *used_ = nullptr;
+        };
+
+        // Replace a random live block by one of a random size, 'count' times,
+        // once 'live' blocks of random sizes are allocated. The free blocks
+        // multiply as the pool fragments.
+        template<typename Allocator>
+        void
+        run_churn(benchmark::State &state, Allocator &allocator) {
+            const auto live = static_cast<size_t>(state.range(0));
+            std::mt19937_64 rng(42);
+            const auto random_size = [&rng]() {
+                // 512 bytes to 64KB, in multiples of the cnmem granularity
+                return (rng() % 128 + 1) * CNMEM_GRANULARITY;
+            };
+            std::vector<void *> blocks(live);
+            for (auto &ptr : blocks) {
+                ptr = allocator.allocate(random_size());
+            }
+            for (auto _ : state) {
+                auto &ptr = blocks[rng() % live];
+                allocator.deallocate(ptr);
+                ptr = allocator.allocate(random_size());
+                benchmark::DoNotOptimize(ptr);
+            }
+            for (auto ptr : blocks) {
+                if (ptr != nullptr) {
+                    allocator.deallocate(ptr);
+                }
+            }
+            state.SetItemsProcessed(state.iterations());
+        }
+
+        void
+        BM_LinearScanArena(benchmark::State &state) {
+            std::vector<char> buffer(kPoolSize);
+            linear_scan_arena arena(buffer.data(), buffer.size());
+            run_churn(state, arena);
+        }
+
+        // The second argument is the host_pool_backend.
+        void
+        BM_HostPoolChurn(benchmark::State &state) {
+            std::vector<char> buffer(kPoolSize);
+            auto allocator = create_host_pool_allocator(
+                    static_cast<host_pool_backend>(state.range(1)), buffer.data(), buffer.size());
+            run_churn(state, *allocator);
+        }
+
+    }  // namespace
+
+    // The argument is the number of live blocks.
+    BENCHMARK(BM_LinearScanArena)->RangeMultiplier(4)->Range(64, 4096);
+    BENCHMARK(BM_HostPoolChurn)
+            ->ArgsProduct({benchmark::CreateRange(64, 4096, 4), {0, 1, 2}})
+            ->ArgNames({"live", "backend"});
+
+}  // namespace hercules::core
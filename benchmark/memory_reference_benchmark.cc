@@ -0,0 +1,127 @@
+/****************************************************************
+ * Copyright (c) 2022, liyinbin
+ * All rights reserved.
+ * Author by liyinbin (jeff.li) lijippy@163.com
+ *****************************************************************/
+
+#include <cstdint>
+#include <vector>
+#include <benchmark/benchmark.h>
+#include "hercules/core/memory_base.h"
+
+namespace hercules::core {
+
+    namespace {
+
+        constexpr size_t kBufferSize = 4096;
+
+        // The previous memory_reference: blocks in a std::vector, with
+        // buffer_attributes that reserved room for a CUDA IPC handle.
+        class vector_memory_reference {
+        public:
+            void add_buffer(
+                    const char *buffer, size_t byte_size, hercules::proto::MemoryType memory_type,
+                    int64_t memory_type_id) {
+                buffer_.emplace_back(buffer, byte_size, memory_type, memory_type_id);
+            }
+
+            void add_buffer_front(
+                    const char *buffer, size_t byte_size, hercules::proto::MemoryType memory_type,
+                    int64_t memory_type_id) {
+                buffer_.emplace(buffer_.begin(), buffer, byte_size, memory_type, memory_type_id);
+            }
+
+            const char *buffer_at(
+                    size_t idx, size_t *byte_size, hercules::proto::MemoryType *memory_type,
+                    int64_t *memory_type_id) const {
+                if (idx >= buffer_.size()) {
+                    *byte_size = 0;
+                    return nullptr;
+                }
+                *byte_size = buffer_[idx].byte_size_;
+                *memory_type = buffer_[idx].memory_type_;
+                *memory_type_id = buffer_[idx].memory_type_id_;
+                return buffer_[idx].buffer_;
+            }
+
+            size_t buffer_count() const { return buffer_.size(); }
+
+        private:
+            struct block {
+                block(
+                        const char *buffer, size_t byte_size,
+                        hercules::proto::MemoryType memory_type, int64_t memory_type_id)
+                        : buffer_(buffer), byte_size_(byte_size), memory_type_(memory_type),
+                          memory_type_id_(memory_type_id) {
+                    cuda_ipc_handle_.reserve(64);
+                }
+
+                const char *buffer_;
+                size_t byte_size_;
+                hercules::proto::MemoryType memory_type_;
+                int64_t memory_type_id_;
+                std::vector<char> cuda_ipc_handle_;
+            };
+
+            std::vector<block> buffer_;
+        };
+
+        // Build a reference of 'state.range(0)' buffers per iteration, added
+        // at the front if 'state.range(1)', then read them back the way the
+        // backends gather their inputs.
+        template<typename Reference>
+        void
+        RunReference(benchmark::State &state) {
+            const auto buffers = static_cast<size_t>(state.range(0));
+            const bool front = (state.range(1) != 0);
+            std::vector<char> data(buffers * kBufferSize);
+            for (auto _ : state) {
+                Reference reference;
+                for (size_t i = 0; i < buffers; ++i) {
+                    if (front) {
+                        reference.add_buffer_front(
+                                data.data() + i * kBufferSize, kBufferSize,
+                                hercules::proto::MEMORY_CPU, 0);
+                    } else {
+                        reference.add_buffer(
+                                data.data() + i * kBufferSize, kBufferSize,
+                                hercules::proto::MEMORY_CPU, 0);
+                    }
+                }
+                size_t total = 0;
+                for (size_t i = 0; i < reference.buffer_count(); ++i) {
+                    size_t byte_size;
+                    hercules::proto::MemoryType memory_type;
+                    int64_t memory_type_id;
+                    const char *buffer =
+                            reference.buffer_at(i, &byte_size, &memory_type, &memory_type_id);
+                    benchmark::DoNotOptimize(buffer);
+                    total += byte_size;
+                }
+                benchmark::DoNotOptimize(total);
+            }
+            state.SetItemsProcessed(state.iterations());
+        }
+
+        void
+        BM_VectorMemoryReference(benchmark::State &state) {
+            RunReference<vector_memory_reference>(state);
+        }
+
+        void
+        BM_MemoryReference(benchmark::State &state) {
+            RunReference<memory_reference>(state);
+        }
+
+    }  // namespace
+
+    // The first argument is the number of buffers, the second whether they
+    // are added at the front.
+    BENCHMARK(BM_VectorMemoryReference)
+            ->ArgsProduct({{1, 2, 4, 16}, {0, 1}})
+            ->ArgNames({"buffers", "front"});
+    BENCHMARK(BM_MemoryReference)
+            ->ArgsProduct({{1, 2, 4, 16}, {0, 1}})
+            ->ArgNames({"buffers", "front"});
+
+}  // namespace hercules::core
@@ -0,0 +1,112 @@
+/****************************************************************
+ * Copyright (c) 2022, liyinbin
+ * All rights reserved.
+ * Author by liyinbin (jeff.li) lijippy@163.com
+ *****************************************************************/
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <utility>
+#include <vector>
+#include <benchmark/benchmark.h>
+#include "hercules/common/sharded_pointer_map.h"
+#include "hercules/core/pinned_memory_manager.h"
+
+namespace hercules::core {
+
+    namespace {
+
+        constexpr size_t kLiveAllocations = 64;
+
+        using owner_info = std::pair<bool, void *>;
+
+        // Addresses standing in for 'count' allocations 'spacing' bytes
+        // apart, distinct per thread. They are never dereferenced.
+        std::vector<void *>
+        fake_allocations(size_t thread_index, size_t count, size_t spacing) {
+            const uintptr_t base = (uintptr_t(0x7f) << 40) + (uintptr_t(thread_index) << 36);
+            std::vector<void *> ptrs;
+            for (size_t i = 0; i < count; ++i) {
+                ptrs.push_back(reinterpret_cast<void *>(base + i * spacing));
+            }
+            return ptrs;
+        }
+
+        // The previous tracking scheme: a single map under a global lock.
+        std::mutex global_mtx;
+        std::map<void *, owner_info> global_map;
+
+        void
+        BM_GlobalMapTracking(benchmark::State &state) {
+            const auto ptrs = fake_allocations(
+                    state.thread_index(), state.range(1), state.range(0));
+            for (auto _ : state) {
+                for (void *ptr : ptrs) {
+                    std::lock_guard<std::mutex> lk(global_mtx);
+                    global_map.emplace(ptr, owner_info(true, nullptr));
+                }
+                for (void *ptr : ptrs) {
+                    std::lock_guard<std::mutex> lk(global_mtx);
+                    global_map.erase(ptr);
+                }
+            }
+            state.SetItemsProcessed(state.iterations() * ptrs.size());
+        }
+
+        hercules::common::sharded_pointer_map<owner_info> sharded_map;
+
+        void
+        BM_ShardedTracking(benchmark::State &state) {
+            const auto ptrs = fake_allocations(
+                    state.thread_index(), state.range(1), state.range(0));
+            for (auto _ : state) {
+                for (void *ptr : ptrs) {
+                    sharded_map.insert(ptr, owner_info(true, nullptr));
+                }
+                owner_info info;
+                for (void *ptr : ptrs) {
+                    sharded_map.erase(ptr, &info);
+                }
+            }
+            state.SetItemsProcessed(state.iterations() * ptrs.size());
+        }
+
+        // Full alloc/free round trips through the manager. Without a pinned
+        // pool these take the non-pinned fallback.
+        void
+        BM_PinnedAllocFree(benchmark::State &state) {
+            if (state.thread_index() == 0) {
+                pinned_memory_manager::create(pinned_memory_manager::options(64 << 20));
+            }
+            std::vector<void *> ptrs(kLiveAllocations);
+            for (auto _ : state) {
+                hercules::proto::MemoryType type;
+                for (auto &ptr : ptrs) {
+                    pinned_memory_manager::alloc(&ptr, state.range(0), &type, true);
+                }
+                for (auto ptr : ptrs) {
+                    pinned_memory_manager::Free(ptr);
+                }
+            }
+            state.SetItemsProcessed(state.iterations() * kLiveAllocations);
+        }
+
+    }  // namespace
+
+    // The first argument is the spacing of the tracked pointers, from packed
+    // small blocks to huge page aligned chunks, the second how many each
+    // thread tracks.
+    BENCHMARK(BM_GlobalMapTracking)
+            ->ArgsProduct({{64, 4 << 10, 2 << 20}, {kLiveAllocations, 4096}})
+            ->ArgNames({"spacing", "live"})
+            ->ThreadRange(1, 16)
+            ->UseRealTime();
+    BENCHMARK(BM_ShardedTracking)
+            ->ArgsProduct({{64, 4 << 10, 2 << 20}, {kLiveAllocations, 4096}})
+            ->ArgNames({"spacing", "live"})
+            ->ThreadRange(1, 16)
+            ->UseRealTime();
+    BENCHMARK(BM_PinnedAllocFree)->Arg(256)->Arg(64 << 10)->ThreadRange(1, 16)->UseRealTime();
+
+}  // namespace hercules::core
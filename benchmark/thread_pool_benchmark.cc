@@ -0,0 +1,112 @@
+/****************************************************************
+ * Copyright (c) 2022, liyinbin
+ * All rights reserved.
+ * Author by liyinbin (jeff.li) lijippy@163.com
+ *****************************************************************/
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <benchmark/benchmark.h>
+#include "hercules/common/thread_pool.h"
+
+namespace hercules::common {
+
+    namespace {
+
+        constexpr size_t kTasksPerIteration = 10000;
+        constexpr size_t kFanout = 16;
+
+        std::unique_ptr<thread_pool> pool;
+
+        void
+        wait_for(const std::atomic<size_t> &done, size_t expected) {
+            while (done.load(std::memory_order_acquire) != expected) {
+                std::this_thread::yield();
+            }
+        }
+
+        // Every producer thread floods the pool with tiny tasks, so the cost is
+        // dominated by the queue synchronization.
+        template<bool kWorkStealing>
+        void
+        BM_Contention(benchmark::State &state) {
+            if (state.thread_index() == 0) {
+                pool.reset(new thread_pool(
+                        thread_pool::options(state.range(0), kWorkStealing)));
+            }
+            for (auto _ : state) {
+                std::atomic<size_t> done{0};
+                for (size_t i = 0; i < kTasksPerIteration; ++i) {
+                    pool->enqueue([&done]() { done.fetch_add(1, std::memory_order_release); });
+                }
+                wait_for(done, kTasksPerIteration);
+            }
+            state.SetItemsProcessed(state.iterations() * kTasksPerIteration);
+            if (state.thread_index() == 0) {
+                pool.reset();
+            }
+        }
+
+        // Tasks submit further tasks from inside the pool, which the work
+        // stealing scheduler keeps on the submitting worker's own queue.
+        template<bool kWorkStealing>
+        void
+        BM_NestedFanout(benchmark::State &state) {
+            pool.reset(new thread_pool(
+                    thread_pool::options(state.range(0), kWorkStealing)));
+            const size_t parents = kTasksPerIteration / kFanout;
+            for (auto _ : state) {
+                std::atomic<size_t> done{0};
+                for (size_t i = 0; i < parents; ++i) {
+                    pool->enqueue([&done]() {
+                        for (size_t j = 0; j < kFanout; ++j) {
+                            pool->enqueue([&done]() {
+                                done.fetch_add(1, std::memory_order_release);
+                            });
+                        }
+                    });
+                }
+                wait_for(done, parents * kFanout);
+            }
+            state.SetItemsProcessed(state.iterations() * parents * kFanout);
+            pool.reset();
+        }
+
+        // The same load as BM_Contention, but every batch is published with a
+        // single enqueue_bulk() call.
+        template<bool kWorkStealing>
+        void
+        BM_EnqueueBulk(benchmark::State &state) {
+            pool.reset(new thread_pool(
+                    thread_pool::options(state.range(0), kWorkStealing)));
+            std::vector<thread_pool::func_task> tasks(kTasksPerIteration);
+            for (auto _ : state) {
+                std::atomic<size_t> done{0};
+                for (auto &task : tasks) {
+                    task = [&done]() { done.fetch_add(1, std::memory_order_release); };
+                }
+                pool->enqueue_bulk(tasks.data(), tasks.size());
+                wait_for(done, kTasksPerIteration);
+            }
+            state.SetItemsProcessed(state.iterations() * kTasksPerIteration);
+            pool.reset();
+        }
+
+    }  // namespace
+
+    BENCHMARK_TEMPLATE(BM_Contention, false)
+            ->RangeMultiplier(2)->Range(4, 64)->ThreadRange(1, 8)->UseRealTime();
+    BENCHMARK_TEMPLATE(BM_Contention, true)
+            ->RangeMultiplier(2)->Range(4, 64)->ThreadRange(1, 8)->UseRealTime();
+    BENCHMARK_TEMPLATE(BM_NestedFanout, false)
+            ->RangeMultiplier(2)->Range(4, 64)->UseRealTime();
+    BENCHMARK_TEMPLATE(BM_NestedFanout, true)
+            ->RangeMultiplier(2)->Range(4, 64)->UseRealTime();
+    BENCHMARK_TEMPLATE(BM_EnqueueBulk, false)
+            ->RangeMultiplier(2)->Range(4, 64)->UseRealTime();
+    BENCHMARK_TEMPLATE(BM_EnqueueBulk, true)
+            ->RangeMultiplier(2)->Range(4, 64)->UseRealTime();
+
+}  // namespace hercules::common
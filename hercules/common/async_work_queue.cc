@@ -7,6 +7,9 @@
 
 #include "hercules/common/error_code.h"
 #include "hercules/common/async_work_queue.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
 
 namespace hercules::common {
 
@@ -22,7 +25,12 @@ namespace hercules::common {
 
     flare::result_status
     async_work_queue::initialize(size_t worker_count) {
-        if (worker_count < 1) {
+        return initialize(thread_pool::options(worker_count));
+    }
+
+    flare::result_status
+    async_work_queue::initialize(const thread_pool::options &options) {
+        if (options.thread_count_ < 1) {
             return flare::result_status(
                     ERROR_INVALID_ARG,
                     "Async work queue must be initialized with positive 'worker_count'");
@@ -39,7 +47,7 @@ namespace hercules::common {
                     " 'worker_count'");
         }
 
-        get_singleton()->thread_pool_.reset(new thread_pool(worker_count));
+        get_singleton()->thread_pool_.reset(new thread_pool(options));
         return flare::result_status::success();
     }
 
@@ -52,7 +60,18 @@ namespace hercules::common {
     }
 
     flare::result_status
-    async_work_queue::add_task(std::function<void(void)> &&task) {
+    async_work_queue::get_stats(thread_pool::stats *stats) {
+        if (!get_singleton()->thread_pool_) {
+            return flare::result_status(
+                    ERROR_UNAVAILABLE,
+                    "Async work queue must be initialized before getting stats");
+        }
+        *stats = get_singleton()->thread_pool_->get_stats();
+        return flare::result_status::success();
+    }
+
+    flare::result_status
+    async_work_queue::add_task(thread_pool::func_task &&task) {
         if (!get_singleton()->thread_pool_) {
             return flare::result_status(
                     ERROR_UNAVAILABLE,
@@ -63,6 +82,101 @@ namespace hercules::common {
         return flare::result_status::success();
     }
 
+    flare::result_status
+    async_work_queue::add_task(thread_pool::func_task &&task, int node_hint) {
+        if (!get_singleton()->thread_pool_) {
+            return flare::result_status(
+                    ERROR_UNAVAILABLE,
+                    "Async work queue must be initialized before adding task");
+        }
+        get_singleton()->thread_pool_->enqueue(std::move(task), node_hint);
+
+        return flare::result_status::success();
+    }
+
+    flare::result_status
+    async_work_queue::add_task(
+            thread_pool::func_task &&task, int node_hint, uint32_t priority) {
+        if (!get_singleton()->thread_pool_) {
+            return flare::result_status(
+                    ERROR_UNAVAILABLE,
+                    "Async work queue must be initialized before adding task");
+        }
+        get_singleton()->thread_pool_->enqueue(std::move(task), node_hint, priority);
+
+        return flare::result_status::success();
+    }
+
+    flare::result_status
+    async_work_queue::add_tasks(thread_pool::func_task *tasks, size_t count) {
+        if (!get_singleton()->thread_pool_) {
+            return flare::result_status(
+                    ERROR_UNAVAILABLE,
+                    "Async work queue must be initialized before adding task");
+        }
+        get_singleton()->thread_pool_->enqueue_bulk(tasks, count);
+
+        return flare::result_status::success();
+    }
+
+    flare::result_status
+    async_work_queue::parallel_for(
+            size_t begin, size_t end, size_t grain,
+            const std::function<void(size_t, size_t)> &fn) {
+        if (begin >= end) {
+            return flare::result_status::success();
+        }
+        grain = std::max<size_t>(grain, 1);
+        const size_t chunk_count = (end - begin + grain - 1) / grain;
+        thread_pool *pool = get_singleton()->thread_pool_.get();
+        if ((chunk_count == 1) || (pool == nullptr)) {
+            for (size_t i = begin; i < end; i += grain) {
+                fn(i, std::min(i + grain, end));
+            }
+            return flare::result_status::success();
+        }
+
+        // Helpers may start after all chunks are claimed and the call has
+        // returned, so the shared state must outlive this frame.
+        struct loop_state {
+            std::atomic<size_t> next_{0};
+            std::atomic<size_t> done_{0};
+            std::mutex mtx_;
+            std::condition_variable cv_;
+        };
+        auto state = std::make_shared<loop_state>();
+        const auto *body = &fn;
+        auto run_chunks = [state, body, begin, end, grain, chunk_count]() {
+            size_t finished = 0;
+            size_t chunk;
+            while ((chunk = state->next_.fetch_add(1)) < chunk_count) {
+                const size_t chunk_begin = begin + chunk * grain;
+                (*body)(chunk_begin, std::min(chunk_begin + grain, end));
+                ++finished;
+            }
+            if ((finished != 0) &&
+                (state->done_.fetch_add(finished) + finished == chunk_count)) {
+                std::lock_guard<std::mutex> lk(state->mtx_);
+                state->cv_.notify_all();
+            }
+        };
+
+        const size_t helper_count = std::min(chunk_count - 1, pool->size());
+        std::vector<thread_pool::func_task> helpers;
+        helpers.reserve(helper_count);
+        for (size_t i = 0; i < helper_count; ++i) {
+            helpers.emplace_back(run_chunks);
+        }
+        pool->enqueue_bulk(helpers.data(), helpers.size());
+
+        run_chunks();
+        std::unique_lock<std::mutex> lk(state->mtx_);
+        state->cv_.wait(lk, [&state, chunk_count]() {
+            return state->done_.load() == chunk_count;
+        });
+        return flare::result_status::success();
+    }
+
     void
     async_work_queue::reset() {
         // Reconstruct the singleton to reset it
@@ -8,7 +8,9 @@
 #ifndef HERCULES_COMMON_ASYNC_WORK_QUEUE_H_
 #define HERCULES_COMMON_ASYNC_WORK_QUEUE_H_
 
+#include "hercules/common/task_future.h"
 #include "hercules/common/thread_pool.h"
+#include <functional>
 #include <flare/base/result_status.h>
 
 namespace hercules::common {
@@ -23,12 +25,51 @@ namespace hercules::common {
         // Start 'worker_count' number of worker threads.
         static flare::result_status initialize(size_t worker_count);
 
+        // Start the worker threads described by 'options', i.e. to select the
+        // work-stealing scheduler, or an elastic number of workers.
+        static flare::result_status initialize(const thread_pool::options &options);
+
         // Get the number of worker threads.
         static size_t worker_count();
 
         // Add a 'task' to the queue. The function will take ownership of 'task'.
         // Therefore std::move should be used when calling AddTask.
-        static flare::result_status add_task(std::function<void(void)> &&task);
+        static flare::result_status add_task(thread_pool::func_task &&task);
+
+        // Similar to the above, but prefer the workers on NUMA node 'node_hint'
+        // if the queue is initialized with worker groups.
+        static flare::result_status add_task(thread_pool::func_task &&task, int node_hint);
+
+        // Similar to the above, with the priority level of 'task', 0 being the
+        // highest. Pass thread_pool::kAnyNode as 'node_hint' to run the task on
+        // any worker. Priorities only take effect if the queue is initialized
+        // with 'priority_levels_' set in the options.
+        static flare::result_status add_task(
+                thread_pool::func_task &&task, int node_hint, uint32_t priority);
+
+        // Add the 'count' tasks starting at 'tasks' to the queue at once. The
+        // tasks are moved from.
+        static flare::result_status add_tasks(thread_pool::func_task *tasks, size_t count);
+
+        // Add a 'task' returning flare::result_status to the queue, and return a
+        // future that is ready with that status once the task has run. If the
+        // task can't be added, the future is ready with the error.
+        template<typename F>
+        static task_future submit(F &&task);
+
+        // Split [begin, end) into chunks of 'grain' elements and call
+        // 'fn(chunk_begin, chunk_end)' for each chunk, in parallel on the
+        // worker threads. The calling thread works on chunks as well, so it is
+        // safe to call from a worker thread. Return after all chunks are done.
+        // If the queue is not initialized the chunks run on the calling thread.
+        static flare::result_status parallel_for(
+                size_t begin, size_t end, size_t grain,
+                const std::function<void(size_t, size_t)> &fn);
+
+        // Get the counters of the worker threads, i.e. to tell whether tasks
+        // wait for a worker. The latency histograms are only filled if the
+        // queue is initialized with 'instrumentation_' set in the options.
+        static flare::result_status get_stats(thread_pool::stats *stats);
 
     protected:
         static void reset();
@@ -43,6 +84,21 @@ namespace hercules::common {
         std::unique_ptr<thread_pool> thread_pool_;
     };
 
+    template<typename F>
+    task_future
+    async_work_queue::submit(F &&task) {
+        task_promise promise;
+        task_future future = promise.get_future();
+        auto status = add_task(
+                [promise = std::move(promise), task = std::forward<F>(task)]() mutable {
+                    promise.set_value(task());
+                });
+        if (!status.is_ok()) {
+            return task_future::make_ready(status);
+        }
+        return future;
+    }
+
 }  // namespace hercules::common
 
 #endif  // HERCULES_COMMON_ASYNC_WORK_QUEUE_H_
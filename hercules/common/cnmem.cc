@@ -25,28 +25,19 @@
 // (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
 // OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 ///////////////////////////////////////////////////////////////////////////////////////////////////
-#ifdef HERCULES_ENABLE_GPU
 #include "cnmem.h"
 #include <cstddef>
+#include <cstdlib>
+#include <new>
 #include <vector>
+#ifdef HERCULES_ENABLE_GPU
 #include <cuda_runtime_api.h>
-
-#if !defined(WIN32) && defined(_MSC_VER)
-#define WIN32
-#endif
-
-#ifdef WIN32
-#include <Windows.h>
-#else
-#include <pthread.h>
-#endif
+#endif  // HERCULES_ENABLE_GPU
 
 #if defined(__SIZEOF_POINTER__) && __SIZEOF_POINTER__ == 4 // ARMv7 is the only 32-bit target that we support.
 #define CNMEM_BUILD_WITH_32_BIT_POINTERS
 #endif
 
-#define CNMEM_GRANULARITY 512
-
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
 extern "C" const char* cnmemGetErrorString(cnmemStatus_t status) {
@@ -129,6 +120,7 @@ static inline void printBacktrace() {
     } \
 } while(0)
 
+#ifdef HERCULES_ENABLE_GPU
 #define CNMEM_CHECK_CUDA(call) do { \
     cudaError_t cudaError = (call); \
     if( cudaError == cudaErrorMemoryAllocation ) { \
@@ -158,6 +150,7 @@ static inline void printBacktrace() {
         return CNMEM_STATUS_CUDA_ERROR; \
     } \
 } while(0)
+#endif  // HERCULES_ENABLE_GPU
 
 #ifdef WIN32
 #define CNMEM_CHECK_WIN32(call, error_code) do { \
@@ -188,26 +181,6 @@ static inline std::size_t ceilInt(std::size_t m, std::size_t n) {
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
-class Mutex {
-#ifdef WIN32
-    mutable CRITICAL_SECTION mCriticalSection;
-#else
-    pthread_mutex_t  mMutex;
-#endif
-
-public:
-    /// Initialize the mutex.
-    cnmemStatus_t initialize();
-    /// Finalize the mutex.
-    cnmemStatus_t finalize();
-    /// Lock the mutex.
-    cnmemStatus_t lock() const;
-    /// Unlock the mutex.
-    cnmemStatus_t unlock() const;
-};
-
-///////////////////////////////////////////////////////////////////////////////////////////////////
-
 cnmemStatus_t Mutex::initialize() {
 #ifdef WIN32
     CNMEM_CHECK_WIN32(InitializeCriticalSection((CRITICAL_SECTION*) &mCriticalSection), CNMEM_STATUS_UNKNOWN_ERROR);
@@ -259,178 +232,114 @@ cnmemStatus_t Mutex::unlock() const {
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
-class Block {
-    /// The pointer to the memory region on the device. 
-    char *mData;
-    /// The size of the memory buffer.
-    std::size_t mSize;
-    /// The prev/next blocks in the linked list of blocks.
-    Block *mNext;
-    /// Is it a head node (i.e. a node obtained from parent->allocate or cudaMalloc).
-    bool mIsHead;
+cnmemStatus_t HostBacking::allocate(void *&ptr, std::size_t size) {
+    ptr = NULL;
+#ifdef WIN32
+    ptr = _aligned_malloc(size, CNMEM_GRANULARITY);
+#else
+    if( posix_memalign(&ptr, CNMEM_GRANULARITY, size) != 0 ) {
+        ptr = NULL;
+    }
+#endif
+    return ptr ? CNMEM_STATUS_SUCCESS : CNMEM_STATUS_OUT_OF_MEMORY;
+}
 
-public:
-    /// Create a block.
-    Block(char *data, std::size_t size, Block *next, bool isHead)
-        : mData(data)
-        , mSize(size)
-        , mNext(next)
-        , mIsHead(isHead) {
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+cnmemStatus_t HostBacking::release(void *ptr) {
+#ifdef WIN32
+    _aligned_free(ptr);
+#else
+    free(ptr);
+#endif
+    return CNMEM_STATUS_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+MemoryState::MemoryState()
+    : usedMemory(0)
+    , freeMemory(0)
+    , largestFreeBlock(0)
+    , blocks() {
+    for( int i = 0 ; i < NUM_HISTOGRAM_BUCKETS ; ++i ) {
+        freeHistogram[i] = 0;
     }
-    
-    /// The data.
-    inline const char* getData() const { return mData; }
-    /// The data (mutable).
-    inline char* getData() { return mData; }
-    
-    /// The size of the block.
-    inline std::size_t getSize() const { return mSize; }
+}
 
-    /// The next block in the linked list.
-    inline const Block* getNext() const { return mNext; }
-    /// The next block in the linked list (mutable).
-    inline Block* getNext() { return mNext; }
-    
-    /// Is it a head block.
-    inline bool isHead() const { return mIsHead; }
-
-    /// Change the next block.
-    inline void setNext(Block *next) { mNext = next; }
-    /// Change the size of the block.
-    inline void setSize(std::size_t size) { mSize = size; }
-    /// Set the head flag.
-    inline void setHeadFlag(bool isHead) { mIsHead = isHead; }
-};
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+double MemoryState::getFragmentation() const {
+    if( freeMemory == 0 ) {
+        return 0.0;
+    }
+    return 1.0 - (double) largestFreeBlock / (double) freeMemory;
+}
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
-class Manager {
+BlockPool::BlockPool()
+    : mSlabs()
+    , mFreeList(NULL)
+    , mNumBlocks(0) {
+}
 
-    /// The parent manager.
-    Manager *mParent;
-    /// The children managers.
-    std::vector<Manager*> mChildren;
-    /// The GPU device where the memory is allocated.
-    int mDevice;
-    /// The stream this manager is associated with. It could be NULL.
-    cudaStream_t mStream;
-    /// Is the stream blocking?
-    bool mIsStreamBlocking;
-    /// The list of used blocks.
-    Block *mUsedBlocks;
-    /// The list of free blocks.
-    Block *mFreeBlocks;
-    /// The managed memory size.
-    std::size_t mSize;
-    /// The flags.
-    unsigned mFlags;
-    /// To support multi-threading. Each manager has its own mutex.
-    Mutex mMutex;
+///////////////////////////////////////////////////////////////////////////////////////////////////
 
-public:
-    /// Create an unitialized manager.
-    Manager();
-    /// Dtor.
-    ~Manager();
-
-    /// Allocate a block of memory.
-    cnmemStatus_t allocate(void *&ptr, std::size_t size, bool isBlocking = true);
-    /// Release a block of memory.
-    cnmemStatus_t release(void *ptr);
-    /// Release memory. It returns true if we have no memory leak.
-    cnmemStatus_t releaseAllUnsafe();
-    /// Reserve memory for a manager.
-    cnmemStatus_t reserve(std::size_t size);
-    /// Steal memory from another manager.
-    cnmemStatus_t stealUnsafe(void *&ptr, std::size_t size);
-
-    /// Print the full memory state.
-    cnmemStatus_t printMemoryState(FILE *file) const;
-
-    /// The amount of used memory.
-    inline cnmemStatus_t getUsedMemoryUnsafe(std::size_t &usedMemory) const { 
-        return getMemoryUnsafe(usedMemory, mUsedBlocks); 
+BlockPool::~BlockPool() {
+    for( std::size_t i = 0 ; i < mSlabs.size() ; ++i ) {
+        ::operator delete(mSlabs[i]);
     }
-    /// The amount of used memory.
-    inline cnmemStatus_t getFreeMemoryUnsafe(std::size_t &freeMemory) const { 
-        return getMemoryUnsafe(freeMemory, mFreeBlocks); 
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+Block* BlockPool::create(char *data, std::size_t size, bool isHead) {
+    if( mFreeList == NULL ) {
+        grow();
     }
-    
-    /// Get a specific child based on the stream id. 
-    cnmemStatus_t getChildFromStream(Manager *&manager, cudaStream_t stream) const;
-    /// Get a specific child based on the stream id. 
-    cnmemStatus_t getChild(Manager *&manager, std::size_t i) const;
-    /// Add a new child.
-    cnmemStatus_t addChild(Manager *manager);
-    /// The number of children.
-    cnmemStatus_t getNumChildren(std::size_t &numChildren) const;
-
-    /// The associated device.
-    inline int getDevice() const { return mDevice; }
-    /// The flags.
-    inline unsigned getFlags() const { return mFlags; }
-    /// Get the mutex.
-    inline const Mutex* getMutex() const { return &mMutex; }
-    /// The size allocated to that manager.
-    inline std::size_t getSize() const { return mSize; }
-    /// The CUDA stream.
-    inline cudaStream_t getStream() const { return mStream; }
-    
-    /// Define the parent.
-    inline void setParent(Manager *parent) { mParent = parent; }
-    /// Define the device.
-    inline void setDevice(int device) { mDevice = device; }
-    /// Define the stream.
-    inline cnmemStatus_t setStream(cudaStream_t stream) { 
-        mStream = stream; 
-#ifdef CUDA_API_PER_THREAD_DEFAULT_STREAM
-        mIsStreamBlocking = false;
-#elif CUDART_VERSION < 5050
-        mIsStreamBlocking = true;
-#else
-        unsigned flags = 0;
-        CNMEM_CHECK_CUDA(cudaStreamGetFlags(mStream, &flags));
-        mIsStreamBlocking = !mStream || !(flags & cudaStreamNonBlocking);
-#endif
-        return CNMEM_STATUS_SUCCESS;
+    void *storage = mFreeList;
+    mFreeList = *static_cast<void**>(storage);
+    ++mNumBlocks;
+    return new(storage) Block(data, size, isHead);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void BlockPool::destroy(Block *block) {
+    CNMEM_ASSERT(!block->mAddressHook.is_linked() && !block->mSizeHook.is_linked());
+    block->~Block();
+    *reinterpret_cast<void**>(block) = mFreeList;
+    mFreeList = block;
+    --mNumBlocks;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void BlockPool::grow() {
+    // Make room first so that the slab can't leak.
+    mSlabs.reserve(mSlabs.size() + 1);
+    char *slab = static_cast<char*>(::operator new(BLOCKS_PER_SLAB * sizeof(Block)));
+    mSlabs.push_back(slab);
+    for( std::size_t i = BLOCKS_PER_SLAB ; i-- > 0 ; ) {
+        void *storage = slab + i * sizeof(Block);
+        *static_cast<void**>(storage) = mFreeList;
+        mFreeList = storage;
     }
-    /// Define the flags.
-    inline void setFlags(unsigned flags) { mFlags = flags; }
-    
-private:
-    /// The member functions below which are marked "Unsafe" are not thread-safe when called on a
-    /// same Manager object. Make sure they are called by a single thread in that case.
-
-    /// Allocate a new block and add it to the free list.
-    cnmemStatus_t allocateBlockUnsafe(Block *&curr, Block *&prev, std::size_t size);
-    /// Release a block from the active list.
-    cnmemStatus_t releaseBlockUnsafe(Block *curr, Block *prev);
-    /// Find the best free node based on the size.
-    cnmemStatus_t findBestBlockUnsafe(Block *&curr, Block *&prev, std::size_t size);
-    /// Extract a node from the list of free blocks.
-    cnmemStatus_t extractBlockUnsafe(Block *curr, Block *prev, std::size_t size, bool stolen);
-    
-    /// Give a free block from that manager.
-    cnmemStatus_t giveBlockUnsafe(void *&data, std::size_t &dataSize, std::size_t size);
-    /// Steal a block from another manager.
-    cnmemStatus_t stealBlockUnsafe(void *&data, std::size_t &dataSize, std::size_t size);
-    
-    /// The memory consumption of a list.
-    cnmemStatus_t getMemoryUnsafe(std::size_t &memSize, const Block *head) const;
-    /// Print an internal linked list.
-    cnmemStatus_t printListUnsafe(FILE *file, const char *name, const Block *head) const;
-};
+}
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
 Manager::Manager()
     : mParent(NULL)
     , mChildren()
-    , mDevice(-1)
+    , mBacking(NULL)
     , mStream(NULL)
     , mIsStreamBlocking(false)
-    , mUsedBlocks(NULL)
-    , mFreeBlocks(NULL)
+    , mBlockPool()
+    , mUsedBlocks()
+    , mFreeBlocks()
+    , mFreeBlocksBySize()
     , mSize(0)
     , mFlags(CNMEM_FLAGS_DEFAULT)
     , mMutex() {
@@ -441,7 +350,7 @@ Manager::Manager()
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
 Manager::~Manager() {
-    if( mDevice == -1 || cudaSetDevice(mDevice) != cudaSuccess ) { // Invalid device, skip it.
+    if( mBacking == NULL || mBacking->activate() != CNMEM_STATUS_SUCCESS ) { // No memory, skip it.
         return;
     }
     releaseAllUnsafe();
@@ -463,17 +372,17 @@ cnmemStatus_t Manager::allocate(void *&ptr, std::size_t size, bool isBlocking) {
     CNMEM_CHECK(mMutex.lock());
 
     // If the client is not blocking, we have to explicitly synchronize before giving one buffer.
-    if( !isBlocking ) {
-        CNMEM_CHECK_CUDA_OR_UNLOCK(cudaStreamSynchronize(mStream), mMutex);
+    if( !isBlocking && mBacking ) {
+        CNMEM_CHECK_OR_UNLOCK(mBacking->synchronize(mStream), mMutex);
     }
 
     // Find the best fit.
-    Block *best = NULL, *prev = NULL;
-    CNMEM_CHECK_OR_UNLOCK(findBestBlockUnsafe(best, prev, size), mMutex);
+    Block *best = NULL;
+    CNMEM_CHECK_OR_UNLOCK(findBestBlockUnsafe(best, size), mMutex);
 
     // If there's no block left in the list of free blocks (with a sufficient size). Request a new block. 
     if( best == NULL && !(mFlags & CNMEM_FLAGS_CANNOT_GROW) ) {
-        CNMEM_CHECK_OR_UNLOCK(allocateBlockUnsafe(best, prev, size), mMutex);
+        CNMEM_CHECK_OR_UNLOCK(allocateBlockUnsafe(best, size), mMutex);
     }
     
     // Make sure we do have a block or quit.
@@ -484,109 +393,85 @@ cnmemStatus_t Manager::allocate(void *&ptr, std::size_t size, bool isBlocking) {
     }
 
     // Split the free block if needed.
-    CNMEM_CHECK_OR_UNLOCK(extractBlockUnsafe(best, prev, size, false), mMutex);
+    CNMEM_CHECK_OR_UNLOCK(extractBlockUnsafe(best, size, false), mMutex);
 
-    // Push the node to the list of used nodes.
-    best->setNext(mUsedBlocks);
-    mUsedBlocks = best;
+    // Add the node to the used nodes.
+    mUsedBlocks.insert(*best);
 
     // Return the new pointer into memory.
-    ptr = mUsedBlocks->getData();
+    ptr = best->getData();
     CNMEM_CHECK(mMutex.unlock());
     return CNMEM_STATUS_SUCCESS;
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
-cnmemStatus_t Manager::allocateBlockUnsafe(Block *&curr, Block *&prev, std::size_t size) {
-    // Reset the outputs.
-    curr = prev = NULL;
+cnmemStatus_t Manager::allocateBlockUnsafe(Block *&curr, std::size_t size) {
+    // Reset the output.
+    curr = NULL;
 
-    // Try to allocate data from the parent or the device.
+    // Try to allocate data from the parent or the backing memory.
     void *data = NULL;
     if( mParent ) {
         CNMEM_CHECK(mParent->allocate(data, size, mIsStreamBlocking));
     }
     else {
-        if (mFlags & CNMEM_FLAGS_MANAGED) {
-            CNMEM_DEBUG_INFO("cudaMallocManaged(%lu)\n", size);
-            CNMEM_CHECK_CUDA(cudaMallocManaged(&data, size));
-            CNMEM_CHECK_CUDA(cudaMemPrefetchAsync(data, size, mDevice));
-        }
-        else {
-            CNMEM_DEBUG_INFO("cudaMalloc(%lu)\n", size);
-            CNMEM_CHECK_CUDA(cudaMalloc(&data, size));
-        }
-        CNMEM_DEBUG_INFO(">> returned address=0x%016lx\n", (size_t) data);
+        CNMEM_CHECK_TRUE(mBacking, CNMEM_STATUS_NOT_INITIALIZED);
+        CNMEM_CHECK(mBacking->allocate(data, size));
     }
     
     // If it failed, there's an unexpected issue.
     CNMEM_ASSERT(data);
 
-    // We have data, we now need to add it to the list of free nodes. We keep the list sorted.
-    Block *next = mFreeBlocks;
-    for( ; next && next->getData() < data ; next = next->getNext() ) {
-        prev = next;
-    }
-    curr = new Block((char*) data, size, next, true);
-    if( !curr ) {
-        return CNMEM_STATUS_OUT_OF_MEMORY;
-    }
-    if( prev ) {
-        prev->setNext(curr);
-    }
-    else {
-        mFreeBlocks = curr;
-    }
-
+    // We have data, we now need to add it to the free nodes.
+    curr = mBlockPool.create((char*) data, size, true);
+    insertFreeBlockUnsafe(curr);
     return CNMEM_STATUS_SUCCESS;
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
-cnmemStatus_t Manager::extractBlockUnsafe(Block *curr, Block *prev, std::size_t size, bool stolen) {
+cnmemStatus_t Manager::extractBlockUnsafe(Block *curr, std::size_t size, bool stolen) {
+    // The size is part of the key of the free node, remove it before any change.
+    eraseFreeBlockUnsafe(curr);
+
     // We have two cases: 1/ It is the right size so we keep it or 2/ it is too large and we split the node.
-    Block *next;
-    if( curr->getSize() == size ) {
-        next = curr->getNext();
-    }
-    else {
+    if( curr->getSize() != size ) {
         std::size_t remaining = curr->getSize()-size;
-        Block *newBlock = new Block(curr->getData() + size, remaining, curr->getNext(), stolen);
-        if( !newBlock ) {
-            return CNMEM_STATUS_OUT_OF_MEMORY;
-        }
-        next = newBlock;
+        Block *newBlock = mBlockPool.create(curr->getData() + size, remaining, stolen);
         curr->setSize(size);
-    }
-    
-    // Redo the "branching" in the nodes.
-    if( prev ) {
-        prev->setNext(next);
-    }
-    else {
-        mFreeBlocks = next;
+        insertFreeBlockUnsafe(newBlock);
     }
     return CNMEM_STATUS_SUCCESS;
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
-cnmemStatus_t Manager::findBestBlockUnsafe(Block *&best, Block *&prev, std::size_t size) {
-    best = NULL, prev = NULL;
-    for( Block *temp = mFreeBlocks, *tempPrev = NULL ; temp ; temp = temp->getNext() ) {
-        if( temp->getSize() >= size && (!best || temp->getSize() < best->getSize()) ) {
-            best = temp;
-            prev = tempPrev;
-        }
-        tempPrev = temp;
-    }
+cnmemStatus_t Manager::findBestBlockUnsafe(Block *&best, std::size_t size) {
+    // The smallest block of at least size bytes, at the lowest address among those of its size.
+    Block key(NULL, size, false);
+    BlocksBySize::iterator it = mFreeBlocksBySize.lower_bound(key);
+    best = (it != mFreeBlocksBySize.end()) ? &*it : NULL;
     return CNMEM_STATUS_SUCCESS;
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
-cnmemStatus_t Manager::getChildFromStream(Manager *&manager, cudaStream_t stream) const {
+void Manager::insertFreeBlockUnsafe(Block *curr) {
+    mFreeBlocks.insert(*curr);
+    mFreeBlocksBySize.insert(*curr);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void Manager::eraseFreeBlockUnsafe(Block *curr) {
+    mFreeBlocks.erase(mFreeBlocks.iterator_to(*curr));
+    mFreeBlocksBySize.erase(mFreeBlocksBySize.iterator_to(*curr));
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+cnmemStatus_t Manager::getChildFromStream(Manager *&manager, void *stream) const {
     CNMEM_CHECK(mMutex.lock());
     std::size_t i = 0, numChildren = mChildren.size();
     for( ; i < numChildren ; ++i ) {
@@ -615,31 +500,60 @@ cnmemStatus_t Manager::getChild(Manager *&manager, std::size_t i) const {
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
-cnmemStatus_t Manager::getMemoryUnsafe(std::size_t &size, const Block *head) const {
+cnmemStatus_t Manager::getMemoryUnsafe(std::size_t &size, const BlocksByAddress &blocks) const {
     size = 0;
-    for( Block *curr = (Block*) head ; curr ; curr = curr->getNext() ) {
-        size += curr->getSize();
+    for( BlocksByAddress::const_iterator it = blocks.begin() ; it != blocks.end() ; ++it ) {
+        size += it->getSize();
     }
     return CNMEM_STATUS_SUCCESS;
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
-#if 0
-cnmemStatus_t Manager::getMemory(std::size_t &size, const Block *head) const {
+cnmemStatus_t Manager::getNumChildren(std::size_t &numChildren) const {
     CNMEM_CHECK(mMutex.lock());
-    CNMEM_CHECK_OR_UNLOCK(getMemoryUnsafe(size, head));
+    numChildren = mChildren.size();
     CNMEM_CHECK(mMutex.unlock());
-    return status;
+    return CNMEM_STATUS_SUCCESS;
 }
-#endif
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
-cnmemStatus_t Manager::getNumChildren(std::size_t &numChildren) const {
-    CNMEM_CHECK(mMutex.lock());
-    numChildren = mChildren.size();
-    CNMEM_CHECK(mMutex.unlock());
+cnmemStatus_t Manager::getStateUnsafe(MemoryState &state) const {
+    state = MemoryState();
+    CNMEM_CHECK(getLargestFreeBlockUnsafe(state.largestFreeBlock));
+    state.blocks.reserve(mUsedBlocks.size() + mFreeBlocks.size());
+
+    // Merge the used and the free blocks, which are both ordered by address.
+    BlocksByAddress::const_iterator used = mUsedBlocks.begin(), free = mFreeBlocks.begin();
+    const char *head = NULL;
+    while( used != mUsedBlocks.end() || free != mFreeBlocks.end() ) {
+        bool isUsed = free == mFreeBlocks.end() || 
+            (used != mUsedBlocks.end() && std::less<const char*>()(used->getData(), free->getData()));
+        const Block &block = isUsed ? *used++ : *free++;
+        if( block.isHead() || head == NULL ) {
+            head = block.getData();
+        }
+
+        BlockState blockState;
+        blockState.data = block.getData();
+        blockState.offset = (std::size_t) (block.getData() - head);
+        blockState.size = block.getSize();
+        blockState.isUsed = isUsed;
+        blockState.isHead = block.isHead();
+        state.blocks.push_back(blockState);
+
+        if( isUsed ) {
+            state.usedMemory += block.getSize();
+            continue;
+        }
+        state.freeMemory += block.getSize();
+        int bucket = 0;
+        for( std::size_t size = block.getSize() ; size > 1 ; size >>= 1 ) {
+            ++bucket;
+        }
+        state.freeHistogram[bucket]++;
+    }
     return CNMEM_STATUS_SUCCESS;
 }
 
@@ -648,47 +562,49 @@ cnmemStatus_t Manager::getNumChildren(std::size_t &numChildren) const {
 cnmemStatus_t Manager::giveBlockUnsafe(void *&blockData, std::size_t &blockSize, std::size_t size) {
     // Make sure the block is not in use any more. It could be too coarse grain and we may change 
     // it in the future.
-    CNMEM_CHECK_CUDA(cudaStreamSynchronize(mStream));
+    if( mBacking ) {
+        CNMEM_CHECK(mBacking->synchronize(mStream));
+    }
     
     // Init the returned values to 0.
     blockData = NULL;
     blockSize = 0;
     
     // Find the best node to steal and reserve it.
-    Block *best = NULL, *prev = NULL;
-    CNMEM_CHECK(findBestBlockUnsafe(best, prev, size));
+    Block *best = NULL;
+    CNMEM_CHECK(findBestBlockUnsafe(best, size));
     if( !best ) {
         return CNMEM_STATUS_OUT_OF_MEMORY;
     }
-    CNMEM_CHECK(extractBlockUnsafe(best, prev, size, true));
+    CNMEM_CHECK(extractBlockUnsafe(best, size, true));
     blockData = best->getData();
     blockSize = best->getSize();
     
     // Release the memory used by that block.
-    delete best;
+    mBlockPool.destroy(best);
     return CNMEM_STATUS_SUCCESS;
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
-cnmemStatus_t Manager::printListUnsafe(FILE *file, const char *name, const Block *head) const {
+cnmemStatus_t Manager::printListUnsafe(FILE *file, const char *name, const BlocksByAddress &blocks) const {
     std::size_t size = 0;
-    for( Block *curr = (Block*) head; curr; curr = curr->getNext() ) {
-        size += curr->getSize();
-    }
+    CNMEM_CHECK(getMemoryUnsafe(size, blocks));
 #ifdef CNMEM_BUILD_WITH_32_BIT_POINTERS
     fprintf(file, "| list=\"%s\", size=%u\n", name, size);
-    for( Block *curr = (Block*) head ; curr ; curr = curr->getNext() ) {
-        fprintf(file, "| | node=0x%08x, data=0x%08x, size=%u, next=0x%08x, head=%2u\n", 
 #else
     fprintf(file, "| list=\"%s\", size=%lu\n", name, size);
-    for( Block *curr = (Block*) head ; curr ; curr = curr->getNext() ) {
-        fprintf(file, "| | node=0x%016lx, data=0x%016lx, size=%lu, next=0x%016lx, head=%2lu\n", 
+#endif
+    for( BlocksByAddress::const_iterator it = blocks.begin() ; it != blocks.end() ; ++it ) {
+        const Block *curr = &*it;
+#ifdef CNMEM_BUILD_WITH_32_BIT_POINTERS
+        fprintf(file, "| | node=0x%08x, data=0x%08x, size=%u, head=%2u\n", 
+#else
+        fprintf(file, "| | node=0x%016lx, data=0x%016lx, size=%lu, head=%2lu\n", 
 #endif
             (std::size_t) curr, 
             (std::size_t) curr->getData(),
             (std::size_t) curr->getSize(),
-            (std::size_t) curr->getNext(),
             (std::size_t) curr->isHead ());
     }
     fprintf(file, "|\n");
@@ -705,12 +621,11 @@ cnmemStatus_t Manager::printMemoryState(FILE *file) const {
     CNMEM_CHECK_OR_UNLOCK(getFreeMemoryUnsafe(freeMemory), mMutex);
 
 #ifdef CNMEM_BUILD_WITH_32_BIT_POINTERS
-    fprintf(file, ">> [%s] device=%d, stream=0x%08x, used=%uB, free=%uB\n", 
+    fprintf(file, ">> [%s] stream=0x%08x, used=%uB, free=%uB\n", 
 #else
-    fprintf(file, ">> [%s] device=%d, stream=0x%016lx, used=%luB, free=%luB\n", 
+    fprintf(file, ">> [%s] stream=0x%016lx, used=%luB, free=%luB\n", 
 #endif
             mParent ? "child" : "root",
-            mDevice, 
             streamCode,
             usedMemory,
             freeMemory);
@@ -727,6 +642,46 @@ cnmemStatus_t Manager::printMemoryState(FILE *file) const {
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
+cnmemStatus_t Manager::printMemoryStateJson(FILE *file) const {
+    MemoryState state;
+    CNMEM_CHECK(mMutex.lock());
+    CNMEM_CHECK_OR_UNLOCK(getStateUnsafe(state), mMutex);
+    CNMEM_CHECK(mMutex.unlock());
+
+    // Print after unlocking, the file may be slow.
+    fprintf(file, "{\"stream\":\"0x%016llx\",\"root\":%s,\"used\":%llu,\"free\":%llu,"
+        "\"largestFree\":%llu,\"fragmentation\":%.6f,\"freeHistogram\":[",
+        (unsigned long long) (std::size_t) mStream,
+        mParent ? "false" : "true",
+        (unsigned long long) state.usedMemory,
+        (unsigned long long) state.freeMemory,
+        (unsigned long long) state.largestFreeBlock,
+        state.getFragmentation());
+    const char *separator = "";
+    for( int i = 0 ; i < MemoryState::NUM_HISTOGRAM_BUCKETS ; ++i ) {
+        if( state.freeHistogram[i] == 0 ) {
+            continue;
+        }
+        fprintf(file, "%s{\"minSize\":%llu,\"count\":%llu}", separator,
+            1ULL << i, (unsigned long long) state.freeHistogram[i]);
+        separator = ",";
+    }
+    fprintf(file, "],\"blocks\":[");
+    for( std::size_t i = 0 ; i < state.blocks.size() ; ++i ) {
+        const BlockState &block = state.blocks[i];
+        fprintf(file, "%s{\"offset\":%llu,\"size\":%llu,\"used\":%s,\"head\":%s}", 
+            i == 0 ? "" : ",",
+            (unsigned long long) block.offset,
+            (unsigned long long) block.size,
+            block.isUsed ? "true" : "false",
+            block.isHead ? "true" : "false");
+    }
+    fprintf(file, "]}\n");
+    return CNMEM_STATUS_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
 cnmemStatus_t Manager::release(void *ptr) {
     // Skip if ptr is NULL.
     if( ptr == NULL ) {
@@ -736,20 +691,17 @@ cnmemStatus_t Manager::release(void *ptr) {
     // Lock to make sure only one thread execute that fragment of code.
     CNMEM_CHECK(mMutex.lock());
     
-    // Find the node in the list of used blocks.
-    Block *curr = mUsedBlocks, *prev = NULL;
-    for( ; curr && curr->getData() != ptr ; curr = curr->getNext() ) {
-        prev = curr;
-    }
+    // Find the node in the used blocks.
+    BlocksByAddress::iterator it = mUsedBlocks.find((const char*) ptr);
     
     // Make sure we have found a node.
-    if( curr == NULL ) {
+    if( it == mUsedBlocks.end() ) {
         CNMEM_CHECK(mMutex.unlock());
         return CNMEM_STATUS_INVALID_ARGUMENT;
     }
 
     // We have the node so release it.
-    cnmemStatus_t result = releaseBlockUnsafe(curr, prev);
+    cnmemStatus_t result = releaseBlockUnsafe(&*it);
     CNMEM_CHECK(mMutex.unlock());
     return result;
 }
@@ -767,25 +719,24 @@ cnmemStatus_t Manager::releaseAllUnsafe() {
 
     // Destroy used blocks. It's a kind of panic mode to avoid leaks. NOTE: Do that only with roots!!!
     if( !mParent ) {
-        while( mUsedBlocks ) {
-            CNMEM_CHECK(releaseBlockUnsafe(mUsedBlocks, NULL));
+        while( !mUsedBlocks.empty() ) {
+            CNMEM_CHECK(releaseBlockUnsafe(&*mUsedBlocks.begin()));
         }
     }
 
     // We should be having only free blocks that are head blocks. Release those blocks.
-    while( mFreeBlocks ) {
+    while( !mFreeBlocks.empty() ) {
+        Block *block = &*mFreeBlocks.begin();
         if( mParent ) {
-            CNMEM_CHECK(mParent->release(mFreeBlocks->getData()));
+            CNMEM_CHECK(mParent->release(block->getData()));
         }
-        else if( mFreeBlocks->isHead() ) {
-            void *data = mFreeBlocks->getData();
-            CNMEM_DEBUG_INFO("cudaFree(%lu, 0x%016lx)\n", mFreeBlocks->getSize(), (size_t) data);
-            CNMEM_CHECK_CUDA(cudaFree(data));
+        else if( block->isHead() ) {
+            CNMEM_DEBUG_INFO("release(%lu, 0x%016lx)\n", block->getSize(), (size_t) block->getData());
+            CNMEM_CHECK(mBacking->release(block->getData()));
             CNMEM_DEBUG_INFO(">> success\n");
         }
-        Block *block = mFreeBlocks;
-        mFreeBlocks = mFreeBlocks->getNext();
-        delete block;
+        eraseFreeBlockUnsafe(block);
+        mBlockPool.destroy(block);
     }
 
     // We shouldn't have any used block left. Or, it means the user is causing memory leaks!
@@ -794,50 +745,36 @@ cnmemStatus_t Manager::releaseAllUnsafe() {
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
-cnmemStatus_t Manager::releaseBlockUnsafe(Block *curr, Block *prev) {
+cnmemStatus_t Manager::releaseBlockUnsafe(Block *curr) {
     // The current node cannot be NULL!
     CNMEM_ASSERT(curr != NULL);
     
-    // Change the connection of the node.
-    if( prev ) {
-        prev->setNext(curr->getNext());
-    }
-    else {
-        mUsedBlocks = curr->getNext();
-    }
+    // Remove the node from the used blocks.
+    mUsedBlocks.erase(mUsedBlocks.iterator_to(*curr));
         
-    // Find the location where this block should be added to the free list.
-    prev = NULL;
-    Block *iter = mFreeBlocks;
-    for( ; iter && iter->getData() < curr->getData() ; iter = iter->getNext() ) {
-        prev = iter;
-    }
-    
-    // Keep track of the successor of pred. We may lose track of it in the following "else".
-    Block *next = prev ? prev->getNext() : mFreeBlocks;
+    // Find the free neighbours of the block.
+    BlocksByAddress::iterator it = mFreeBlocks.lower_bound(curr->getData());
+    Block *next = (it != mFreeBlocks.end()) ? &*it : NULL;
+    Block *prev = (it != mFreeBlocks.begin()) ? &*(--BlocksByAddress::iterator(it)) : NULL;
     
     // We first check if we can merge the block with its predecessor in the list and curr can be merged.
     if( prev && prev->getData() + prev->getSize() == curr->getData() && !curr->isHead() ) {
+        mFreeBlocksBySize.erase(mFreeBlocksBySize.iterator_to(*prev));
         prev->setSize(prev->getSize() + curr->getSize());
-        delete curr;
+        mBlockPool.destroy(curr);
         curr = prev;
     }
-    else if( prev ) {
-        prev->setNext(curr);
-    }
     else {
-        mFreeBlocks = curr;
+        mFreeBlocks.insert(it, *curr);
     }
     
-    // Check if we can merge curr and next. We can't merge over "cudaMalloc" boundaries.
+    // Check if we can merge curr and next. We can't merge over backing allocation boundaries.
     if( next && curr->getData() + curr->getSize() == next->getData() && !next->isHead() ) {
+        eraseFreeBlockUnsafe(next);
         curr->setSize(curr->getSize() + next->getSize());
-        curr->setNext(next->getNext());
-        delete next;
-    }
-    else {
-        curr->setNext(next);
+        mBlockPool.destroy(next);
     }
+    mFreeBlocksBySize.insert(*curr);
     return CNMEM_STATUS_SUCCESS;
 }
 
@@ -845,8 +782,8 @@ cnmemStatus_t Manager::releaseBlockUnsafe(Block *curr, Block *prev) {
 
 cnmemStatus_t Manager::reserve(std::size_t size) {
     CNMEM_CHECK(mMutex.lock());
-    Block *curr, *prev;
-    CNMEM_CHECK_OR_UNLOCK(allocateBlockUnsafe(curr, prev, size), mMutex);
+    Block *curr;
+    CNMEM_CHECK_OR_UNLOCK(allocateBlockUnsafe(curr, size), mMutex);
     mSize = size;
     CNMEM_CHECK(mMutex.unlock());
     return CNMEM_STATUS_SUCCESS;
@@ -876,10 +813,10 @@ cnmemStatus_t Manager::stealUnsafe(void *&stolen, std::size_t size) {
         return CNMEM_STATUS_OUT_OF_MEMORY;
     }
 
-    // Push the block in the used list.
-    mUsedBlocks = new Block((char*) data, dataSize, mUsedBlocks, true);
-    if( !mUsedBlocks ) {
-        return CNMEM_STATUS_OUT_OF_MEMORY;
+    // Add the block to the used blocks. A block stolen from a child already is one of them, split
+    // by stealBlockUnsafe.
+    if( mChildren.empty() ) {
+        mUsedBlocks.insert(*mBlockPool.create((char*) data, dataSize, true));
     }
 
     // Return the new pointer into memory.
@@ -904,65 +841,109 @@ cnmemStatus_t Manager::stealBlockUnsafe(void *&data, std::size_t &dataSize, ::si
         return CNMEM_STATUS_OUT_OF_MEMORY;
     }
 
-    // We have got a node from a children. We need to update our "used" list before we can do 
-    // anything with it.
-    Block *curr = mUsedBlocks, *prev = NULL;
-    for( ; curr ; curr = curr->getNext() ) { 
-        if( curr->getData() <= data && data < curr->getData()+curr->getSize() ) {
-            break;
-        }
-        prev = curr;
-    }
-    
-    // Curr points to the node which contains that memory region.
-    CNMEM_ASSERT(curr);
+    // We have got a node from a children. We need to update our used blocks before we can do 
+    // anything with it. Find the node which contains that memory region.
+    BlocksByAddress::iterator it = mUsedBlocks.upper_bound((const char*) data);
+    CNMEM_ASSERT(it != mUsedBlocks.begin());
+    Block *curr = &*(--it);
+    CNMEM_ASSERT(curr->getData() <= data && (char*) data < curr->getData()+curr->getSize());
 
     // If it is exactly the same memory region, we are done!!!
     if( curr->getData() == data && curr->getSize() == dataSize ) {
         return CNMEM_STATUS_SUCCESS;
     }
     
-    // Track the blocks before and after curr.
-    Block *next = curr->getNext();
-    
     // We may have up to 3 blocks.
     std::size_t sizeBefore = (std::size_t) ((char*) data - curr->getData());
     std::size_t sizeAfter = (curr->getSize() - sizeBefore - dataSize);
 
-    // The resulting block.
-    Block *result = curr;
-    
     // If we have no space between curr->getData and block->getData.
     if( sizeBefore == 0 ) {
         curr->setSize(dataSize);
     }
     else {
         curr->setSize(sizeBefore);
-        Block *block = new Block((char*) data, dataSize, next, false);
-        if( !block ) {
-            return CNMEM_STATUS_OUT_OF_MEMORY;
-        }
-        curr->setNext(block);
+        Block *block = mBlockPool.create((char*) data, dataSize, false);
+        mUsedBlocks.insert(*block);
         curr = block;
-        data = (char*) data + dataSize;
-        dataSize = sizeAfter; 
-        result = block;
     }
     
     // We have space at the end so we may need to add a new node.
     if( sizeAfter > 0 ) {
-        Block *block = new Block(curr->getData() + curr->getSize(), sizeAfter, next, false);
-        if( !block ) {
-            return CNMEM_STATUS_OUT_OF_MEMORY;
-        }
-        curr->setNext(block);
-        curr = block;
+        Block *block = mBlockPool.create(curr->getData() + curr->getSize(), sizeAfter, false);
+        mUsedBlocks.insert(*block);
     }
     return CNMEM_STATUS_SUCCESS;
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
+#ifdef HERCULES_ENABLE_GPU
+
+/// Backing memory from cudaMalloc, or cudaMallocManaged with CNMEM_FLAGS_MANAGED.
+class CudaBacking : public Backing {
+    /// The GPU device where the memory is allocated.
+    int mDevice;
+    /// Use managed memory.
+    bool mIsManaged;
+
+public:
+    CudaBacking() : mDevice(-1), mIsManaged(false) {}
+
+    /// Define the device and the kind of memory.
+    inline void setDevice(int device, bool isManaged) { mDevice = device; mIsManaged = isManaged; }
+    /// The device, -1 if none.
+    inline int getDevice() const { return mDevice; }
+
+    cnmemStatus_t allocate(void *&ptr, std::size_t size) {
+        ptr = NULL;
+        if( mIsManaged ) {
+            CNMEM_DEBUG_INFO("cudaMallocManaged(%lu)\n", size);
+            CNMEM_CHECK_CUDA(cudaMallocManaged(&ptr, size));
+            CNMEM_CHECK_CUDA(cudaMemPrefetchAsync(ptr, size, mDevice));
+        }
+        else {
+            CNMEM_DEBUG_INFO("cudaMalloc(%lu)\n", size);
+            CNMEM_CHECK_CUDA(cudaMalloc(&ptr, size));
+        }
+        CNMEM_DEBUG_INFO(">> returned address=0x%016lx\n", (size_t) ptr);
+        return CNMEM_STATUS_SUCCESS;
+    }
+
+    cnmemStatus_t release(void *ptr) {
+        CNMEM_CHECK_CUDA(cudaFree(ptr));
+        return CNMEM_STATUS_SUCCESS;
+    }
+
+    cnmemStatus_t activate() {
+        CNMEM_CHECK_TRUE(mDevice != -1, CNMEM_STATUS_INVALID_ARGUMENT);
+        CNMEM_CHECK_CUDA(cudaSetDevice(mDevice));
+        return CNMEM_STATUS_SUCCESS;
+    }
+
+    cnmemStatus_t synchronize(void *stream) {
+        CNMEM_CHECK_CUDA(cudaStreamSynchronize((cudaStream_t) stream));
+        return CNMEM_STATUS_SUCCESS;
+    }
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+/// Associate a manager with a CUDA stream.
+static cnmemStatus_t setStream(Manager &manager, cudaStream_t stream) {
+#ifdef CUDA_API_PER_THREAD_DEFAULT_STREAM
+    bool isStreamBlocking = false;
+#elif CUDART_VERSION < 5050
+    bool isStreamBlocking = true;
+#else
+    unsigned flags = 0;
+    CNMEM_CHECK_CUDA(cudaStreamGetFlags(stream, &flags));
+    bool isStreamBlocking = !stream || !(flags & cudaStreamNonBlocking);
+#endif
+    manager.setStream(stream, isStreamBlocking);
+    return CNMEM_STATUS_SUCCESS;
+}
+
 class Context {
     /// Use a magic number to specify that the context is valid.
     enum { CTX_VALID = 0x1f5632a3 };
@@ -973,6 +954,8 @@ class Context {
     Mutex mMutex;
     /// The memory managers.
     std::vector<Manager> mManagers;
+    /// The device memory of the managers.
+    std::vector<CudaBacking> mBackings;
     /// The global context.
     static Context *sCtx;
     /// Use a magic number to specify that the context was created.
@@ -987,6 +970,10 @@ public:
     inline std::vector<Manager>& getManagers() { return mManagers; }
     /// Get a single manager associated with a device.
     inline Manager& getManager(int i) { return mManagers[i]; }
+    /// Get the backing memories.
+    inline std::vector<CudaBacking>& getBackings() { return mBackings; }
+    /// Get the backing memory of a device.
+    inline CudaBacking& getBacking(int i) { return mBackings[i]; }
 
     /// Create the global context.
     static cnmemStatus_t create();
@@ -1009,12 +996,13 @@ Context::~Context() {
     int oldDevice;
     cudaGetDevice(&oldDevice);
     for( std::size_t i = 0 ; i < mManagers.size() ; ++i ) {
-        if( mManagers[i].getDevice() != -1 ) { // Skip invalid managers.
-            cudaSetDevice(mManagers[i].getDevice());
+        if( mManagers[i].getBacking() != NULL ) { // Skip invalid managers.
+            mManagers[i].getBacking()->activate();
             mManagers[i].releaseAllUnsafe();
         }
     }
     mManagers.clear();
+    mBackings.clear();
     mMutex.finalize();
     cudaSetDevice(oldDevice);
 }
@@ -1058,16 +1046,18 @@ cnmemStatus_t Context::release() {
     return CNMEM_STATUS_SUCCESS;
 }
 
+#endif  // HERCULES_ENABLE_GPU
+
 } // namespace cnmem
 
+#ifdef HERCULES_ENABLE_GPU
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
 extern "C" {
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
-///////////////////////////////////////////////////////////////////////////////////////////////////
-
 cnmemStatus_t cnmemInit(int numDevices, const cnmemDevice_t *devices, unsigned flags) {
     // Make sure we have at least one device declared.
     CNMEM_CHECK_TRUE(numDevices > 0, CNMEM_STATUS_INVALID_ARGUMENT);
@@ -1086,8 +1076,9 @@ cnmemStatus_t cnmemInit(int numDevices, const cnmemDevice_t *devices, unsigned f
         
     // Allocate enough managers.
     CNMEM_CHECK_TRUE(maxDevice >= 0, CNMEM_STATUS_INVALID_ARGUMENT);
-    std::vector<cnmem::Manager> &managers = ctx->getManagers();
-    managers.resize(maxDevice+1);
+    // Managers own the links of their blocks and can't be copied, so they are built in place.
+    std::vector<cnmem::Manager>(maxDevice+1).swap(ctx->getManagers());
+    ctx->getBackings().resize(maxDevice+1);
 
     // Create a root manager for each device and create the children.
     int oldDevice;
@@ -1103,8 +1094,10 @@ cnmemStatus_t cnmemInit(int numDevices, const cnmemDevice_t *devices, unsigned f
         CNMEM_CHECK_TRUE(
             size > 0 && size < props.totalGlobalMem, CNMEM_STATUS_INVALID_ARGUMENT);
         
+        cnmem::CudaBacking &backing = ctx->getBacking(devices[i].device);
+        backing.setDevice(devices[i].device, (flags & CNMEM_FLAGS_MANAGED) != 0);
         cnmem::Manager &manager = ctx->getManager(devices[i].device);
-        manager.setDevice(devices[i].device);
+        manager.setBacking(&backing);
         manager.setFlags(flags);
         
         size = cnmem::ceilInt(size, CNMEM_GRANULARITY);
@@ -1113,8 +1106,8 @@ cnmemStatus_t cnmemInit(int numDevices, const cnmemDevice_t *devices, unsigned f
         for( int j = 0 ; j < devices[i].numStreams ; ++j ) {
             cnmem::Manager *child = new cnmem::Manager;
             child->setParent(&manager);
-            child->setDevice(devices[i].device);
-            child->setStream(devices[i].streams[j]);
+            child->setBacking(&backing);
+            cnmem::setStream(*child, devices[i].streams[j]);
             child->setFlags(flags & ~CNMEM_FLAGS_CANNOT_GROW);
             if( devices[i].streamSizes && devices[i].streamSizes[j] > 0 ) {
                 //https://docs.nvidia.com/cuda/cuda-c-best-practices-guide/index.html#sequential-but-misaligned-access-pattern
@@ -1162,8 +1155,8 @@ cnmemStatus_t cnmemRegisterStream(cudaStream_t stream) {
     cnmem::Manager &root = cnmem::Context::get()->getManager(device);
     cnmem::Manager *child = new cnmem::Manager;
     child->setParent(&root);
-    child->setDevice(device);
-    child->setStream(stream);
+    child->setBacking(root.getBacking());
+    cnmem::setStream(*child, stream);
     child->setFlags(root.getFlags() & ~CNMEM_FLAGS_CANNOT_GROW);
     root.addChild(child);
 
@@ -1292,6 +1285,28 @@ cnmemStatus_t cnmemMemGetInfo(size_t *freeMem, size_t *totalMem, cudaStream_t st
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
+cnmemStatus_t cnmemMetadataGetInfo(size_t *metadataMem, size_t *numBlocks, cudaStream_t stream) {
+    CNMEM_CHECK_TRUE(cnmem::Context::check(), CNMEM_STATUS_NOT_INITIALIZED);
+    CNMEM_CHECK_TRUE(metadataMem && numBlocks, CNMEM_STATUS_INVALID_ARGUMENT);
+
+    int device;
+    CNMEM_CHECK_CUDA(cudaGetDevice(&device));
+    cnmem::Manager &root = cnmem::Context::get()->getManager(device);
+    cnmem::Manager *manager = &root;
+    if( stream ) {
+        CNMEM_CHECK(root.getChildFromStream(manager, stream));
+    }
+    CNMEM_ASSERT(manager);
+
+    const cnmem::Mutex *mutex = manager->getMutex();
+    CNMEM_CHECK(mutex->lock());
+    CNMEM_CHECK_OR_UNLOCK(manager->getMetadataUnsafe(*metadataMem, *numBlocks), *mutex);
+    CNMEM_CHECK(mutex->unlock());
+    return CNMEM_STATUS_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
 cnmemStatus_t cnmemPrintMemoryState(FILE *file, cudaStream_t stream) {
     CNMEM_CHECK_TRUE(cnmem::Context::check(), CNMEM_STATUS_NOT_INITIALIZED);
 
@@ -1308,6 +1323,23 @@ cnmemStatus_t cnmemPrintMemoryState(FILE *file, cudaStream_t stream) {
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
+cnmemStatus_t cnmemPrintMemoryStateJson(FILE *file, cudaStream_t stream) {
+    CNMEM_CHECK_TRUE(cnmem::Context::check(), CNMEM_STATUS_NOT_INITIALIZED);
+    CNMEM_CHECK_TRUE(file, CNMEM_STATUS_INVALID_ARGUMENT);
+
+    int device;
+    CNMEM_CHECK_CUDA(cudaGetDevice(&device));
+    cnmem::Manager &root = cnmem::Context::get()->getManager(device);
+    cnmem::Manager *manager = &root;
+    if( stream ) {
+        CNMEM_CHECK(root.getChildFromStream(manager, stream));
+    }
+    CNMEM_ASSERT(manager);
+    return manager->printMemoryStateJson(file);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
 } // extern "C"
 
 #endif  // HERCULES_ENABLE_GPU
@@ -26,13 +26,14 @@
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  * ********************************************************************** */
 #pragma once
-#ifdef HERCULES_ENABLE_GPU
 #ifdef __cplusplus
 #include "cstdio"
 #else
 #include "stdio.h"
 #endif
+#ifdef HERCULES_ENABLE_GPU
 #include "cuda_runtime_api.h"
+#endif  // HERCULES_ENABLE_GPU
 
 #if defined(_MSC_VER) || defined(WIN32)
 #ifdef CNMEM_DLLEXPORT
@@ -50,6 +51,9 @@
 
 #define CNMEM_VERSION 100 // It corresponds to 1.0.0
 
+/// The granularity of the allocations made through the C API.
+#define CNMEM_GRANULARITY 512
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -78,6 +82,8 @@ typedef enum
 
 /* ********************************************************************************************* */
 
+#ifdef HERCULES_ENABLE_GPU
+
 typedef struct cnmemDevice_t_
 {
   /** The device number. */
@@ -236,6 +242,21 @@ cnmemStatus_t CNMEM_API cnmemFree(void *ptr, cudaStream_t stream);
  */
 cnmemStatus_t CNMEM_API cnmemMemGetInfo(size_t *freeMem, size_t *totalMem, cudaStream_t stream);
 
+/**
+ * \brief Returns the host memory used by the memory manager associated with a stream to track
+ * its blocks, and the number of those blocks (used or free).
+ *
+ * The pointers metadataMem and numBlocks must be valid. The memory of the blocks is recycled by
+ * the manager and only released when the library is finalized. This function is thread safe.
+ *
+ * \return
+ * CNMEM_STATUS_SUCCESS,          if everything goes fine,
+ * CNMEM_STATUS_NOT_INITIALIZED,  if the ::cnmemInit function has not been called,
+ * CNMEM_STATUS_INVALID_ARGUMENT, if one of the argument is invalid,
+ * CNMEM_STATUS_CUDA_ERROR,       if an error happens in one of the CUDA functions.
+ */
+cnmemStatus_t CNMEM_API cnmemMetadataGetInfo(size_t *metadataMem, size_t *numBlocks, cudaStream_t stream);
+
 /**
  * \brief Print a list of nodes to a file. 
  * 
@@ -251,6 +272,24 @@ cnmemStatus_t CNMEM_API cnmemMemGetInfo(size_t *freeMem, size_t *totalMem, cudaS
  */
 cnmemStatus_t CNMEM_API cnmemPrintMemoryState(FILE *file, cudaStream_t stream);
 
+/**
+ * \brief Print the state of the memory manager associated with a stream as a JSON object.
+ *
+ * Unlike ::cnmemPrintMemoryState, the output is meant to be parsed, i.e. to monitor the
+ * fragmentation of the memory. It lists the used and free blocks with their offset and size,
+ * the largest free block, the fragmentation ratio and a histogram of the sizes of the free
+ * blocks. The parent manager is not printed. It is thread safe.
+ *
+ * \return
+ * CNMEM_STATUS_SUCCESS,          if everything goes fine,
+ * CNMEM_STATUS_NOT_INITIALIZED,  if the ::cnmemInit function has not been called,
+ * CNMEM_STATUS_INVALID_ARGUMENT, if one of the argument is invalid. For example, file == 0,
+ * CNMEM_STATUS_CUDA_ERROR,       if an error happens in one of the CUDA functions.
+ */
+cnmemStatus_t CNMEM_API cnmemPrintMemoryStateJson(FILE *file, cudaStream_t stream);
+
+#endif  // HERCULES_ENABLE_GPU
+
 /**
  * \brief Converts a cnmemStatus_t value to a string.
  */
@@ -262,4 +301,356 @@ const char CNMEM_API * cnmemGetErrorString(cnmemStatus_t status);
 } // extern "C"
 #endif
 
-#endif  // HERCULES_ENABLE_GPU
\ No newline at end of file
+/* ********************************************************************************************* */
+/* The arena behind the C API.                                                                   */
+/* ********************************************************************************************* */
+
+#ifdef __cplusplus
+#include <cstddef>
+#include <functional>
+#include <vector>
+#include <boost/intrusive/set.hpp>
+
+#if !defined(WIN32) && defined(_MSC_VER)
+#define WIN32
+#endif
+
+#ifdef WIN32
+#include <Windows.h>
+#else
+#include <pthread.h>
+#endif
+
+namespace cnmem {
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+/// The memory a root manager carves its blocks from. The C API backs its managers with CUDA device
+/// memory, HostBacking with host memory.
+class Backing {
+public:
+    virtual ~Backing() {}
+
+    /// Allocate a region of size bytes.
+    virtual cnmemStatus_t allocate(void *&ptr, std::size_t size) = 0;
+    /// Release a region returned by allocate.
+    virtual cnmemStatus_t release(void *ptr) = 0;
+    /// Make the memory current before it is released, i.e. select its CUDA device.
+    virtual cnmemStatus_t activate() { return CNMEM_STATUS_SUCCESS; }
+    /// Wait for the pending work on the stream, which may still use blocks being handed out.
+    virtual cnmemStatus_t synchronize(void * /*stream*/) { return CNMEM_STATUS_SUCCESS; }
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+/// Backing memory from the host heap, aligned to CNMEM_GRANULARITY.
+class HostBacking : public Backing {
+public:
+    cnmemStatus_t allocate(void *&ptr, std::size_t size);
+    cnmemStatus_t release(void *ptr);
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+class Mutex {
+#ifdef WIN32
+    mutable CRITICAL_SECTION mCriticalSection;
+#else
+    pthread_mutex_t  mMutex;
+#endif
+
+public:
+    /// Initialize the mutex.
+    cnmemStatus_t initialize();
+    /// Finalize the mutex.
+    cnmemStatus_t finalize();
+    /// Lock the mutex.
+    cnmemStatus_t lock() const;
+    /// Unlock the mutex.
+    cnmemStatus_t unlock() const;
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+class Block {
+    /// The pointer to the memory region on the device. 
+    char *mData;
+    /// The size of the memory buffer.
+    std::size_t mSize;
+    /// Is it a head node (i.e. a node obtained from parent->allocate or the backing memory).
+    bool mIsHead;
+
+public:
+    /// The links of the block in the used or free blocks of its manager, by address.
+    boost::intrusive::set_member_hook<> mAddressHook;
+    /// The links of a free block in the free blocks of its manager, by size.
+    boost::intrusive::set_member_hook<> mSizeHook;
+
+    /// Create a block.
+    Block(char *data, std::size_t size, bool isHead)
+        : mData(data)
+        , mSize(size)
+        , mIsHead(isHead) {
+    }
+    
+    /// The data.
+    inline const char* getData() const { return mData; }
+    /// The data (mutable).
+    inline char* getData() { return mData; }
+    
+    /// The size of the block.
+    inline std::size_t getSize() const { return mSize; }
+
+    /// Is it a head block.
+    inline bool isHead() const { return mIsHead; }
+
+    /// Change the size of the block.
+    inline void setSize(std::size_t size) { mSize = size; }
+    /// Set the head flag.
+    inline void setHeadFlag(bool isHead) { mIsHead = isHead; }
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+/// The key of the blocks ordered by address.
+struct BlockAddress {
+    typedef const char* type;
+    type operator()(const Block &block) const { return block.getData(); }
+};
+
+/// Orders blocks by size, then by address.
+struct BlockSizeLess {
+    bool operator()(const Block &lhs, const Block &rhs) const {
+        if( lhs.getSize() != rhs.getSize() ) {
+            return lhs.getSize() < rhs.getSize();
+        }
+        return std::less<const char*>()(lhs.getData(), rhs.getData());
+    }
+};
+
+/// The blocks are linked into their lists, so inserting or removing a block doesn't allocate.
+typedef boost::intrusive::set<Block,
+    boost::intrusive::member_hook<Block, boost::intrusive::set_member_hook<>, &Block::mAddressHook>,
+    boost::intrusive::key_of_value<BlockAddress> > BlocksByAddress;
+typedef boost::intrusive::set<Block,
+    boost::intrusive::member_hook<Block, boost::intrusive::set_member_hook<>, &Block::mSizeHook>,
+    boost::intrusive::compare<BlockSizeLess> > BlocksBySize;
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+/// A block in a snapshot of a manager.
+struct BlockState {
+    /// The data.
+    const char *data;
+    /// The offset of the block from the start of its head block, i.e. of the region of the backing
+    /// memory or of the parent it was carved from.
+    std::size_t offset;
+    /// The size of the block.
+    std::size_t size;
+    /// Is the block used.
+    bool isUsed;
+    /// Is it a head block.
+    bool isHead;
+};
+
+/// A snapshot of the blocks of a manager.
+struct MemoryState {
+    /// The number of buckets of the histogram of free blocks.
+    static const int NUM_HISTOGRAM_BUCKETS = 64;
+
+    /// The amount of used memory.
+    std::size_t usedMemory;
+    /// The amount of free memory.
+    std::size_t freeMemory;
+    /// The size of the largest free block.
+    std::size_t largestFreeBlock;
+    /// The number of free blocks of [2^i, 2^(i+1)) bytes, in bucket i.
+    std::size_t freeHistogram[NUM_HISTOGRAM_BUCKETS];
+    /// The used and free blocks, by address.
+    std::vector<BlockState> blocks;
+
+    /// Create an empty snapshot.
+    MemoryState();
+
+    /// The share of the free memory which can't serve a request as large as all of it. It is 0
+    /// when the free memory is a single block and gets close to 1 as it is split up.
+    double getFragmentation() const;
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+/// Recycles the blocks of a manager. Blocks are carved from slabs which are kept until the pool is
+/// destroyed, so splitting and merging blocks doesn't go through the heap once the pool is warm.
+class BlockPool {
+    /// The number of blocks in a slab.
+    static const std::size_t BLOCKS_PER_SLAB = 64;
+
+    /// The slabs.
+    std::vector<void*> mSlabs;
+    /// The unused blocks, linked through their first bytes.
+    void *mFreeList;
+    /// The number of blocks handed out.
+    std::size_t mNumBlocks;
+
+    /// Add a slab to the unused blocks. It throws std::bad_alloc like new Block(...) would.
+    void grow();
+
+    BlockPool(const BlockPool&);
+    BlockPool& operator=(const BlockPool&);
+
+public:
+    /// Create an empty pool.
+    BlockPool();
+    /// Dtor. The blocks must have been unlinked from their lists.
+    ~BlockPool();
+
+    /// Create a block.
+    Block* create(char *data, std::size_t size, bool isHead);
+    /// Destroy a block. It must be unlinked from its lists.
+    void destroy(Block *block);
+
+    /// The number of blocks in use.
+    inline std::size_t getNumBlocks() const { return mNumBlocks; }
+    /// The heap memory held by the pool.
+    inline std::size_t getMemorySize() const {
+        return mSlabs.size() * BLOCKS_PER_SLAB * sizeof(Block) + mSlabs.capacity() * sizeof(void*);
+    }
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+class Manager {
+
+    /// The parent manager.
+    Manager *mParent;
+    /// The children managers.
+    std::vector<Manager*> mChildren;
+    /// The memory of the root manager, shared with the children. Not owned.
+    Backing *mBacking;
+    /// The stream this manager is associated with. It could be NULL.
+    void *mStream;
+    /// Is the stream blocking?
+    bool mIsStreamBlocking;
+    /// The blocks of the lists below. It outlives the lists, which unlink the blocks when destroyed.
+    BlockPool mBlockPool;
+    /// The used blocks, by address.
+    BlocksByAddress mUsedBlocks;
+    /// The free blocks, by address to merge neighbours and by size for the best fit.
+    BlocksByAddress mFreeBlocks;
+    BlocksBySize mFreeBlocksBySize;
+    /// The managed memory size.
+    std::size_t mSize;
+    /// The flags.
+    unsigned mFlags;
+    /// To support multi-threading. Each manager has its own mutex.
+    Mutex mMutex;
+
+public:
+    /// Create an unitialized manager.
+    Manager();
+    /// Dtor.
+    ~Manager();
+
+    /// Allocate a block of memory.
+    cnmemStatus_t allocate(void *&ptr, std::size_t size, bool isBlocking = true);
+    /// Release a block of memory.
+    cnmemStatus_t release(void *ptr);
+    /// Release memory. It returns true if we have no memory leak.
+    cnmemStatus_t releaseAllUnsafe();
+    /// Reserve memory for a manager.
+    cnmemStatus_t reserve(std::size_t size);
+    /// Steal memory from another manager.
+    cnmemStatus_t stealUnsafe(void *&ptr, std::size_t size);
+
+    /// Print the full memory state.
+    cnmemStatus_t printMemoryState(FILE *file) const;
+    /// Print the state of the manager as a JSON object, see ::cnmemPrintMemoryStateJson.
+    cnmemStatus_t printMemoryStateJson(FILE *file) const;
+    /// Take a snapshot of the blocks.
+    cnmemStatus_t getStateUnsafe(MemoryState &state) const;
+
+    /// The amount of used memory.
+    inline cnmemStatus_t getUsedMemoryUnsafe(std::size_t &usedMemory) const { 
+        return getMemoryUnsafe(usedMemory, mUsedBlocks); 
+    }
+    /// The amount of used memory.
+    inline cnmemStatus_t getFreeMemoryUnsafe(std::size_t &freeMemory) const { 
+        return getMemoryUnsafe(freeMemory, mFreeBlocks); 
+    }
+    /// The size of the largest free block.
+    inline cnmemStatus_t getLargestFreeBlockUnsafe(std::size_t &size) const {
+        size = mFreeBlocksBySize.empty() ? 0 : mFreeBlocksBySize.rbegin()->getSize();
+        return CNMEM_STATUS_SUCCESS;
+    }
+    /// The heap memory used to track the blocks and the number of blocks, used or free.
+    inline cnmemStatus_t getMetadataUnsafe(std::size_t &metadataMemory, std::size_t &numBlocks) const {
+        metadataMemory = mBlockPool.getMemorySize();
+        numBlocks = mBlockPool.getNumBlocks();
+        return CNMEM_STATUS_SUCCESS;
+    }
+    
+    /// Get a specific child based on the stream id. 
+    cnmemStatus_t getChildFromStream(Manager *&manager, void *stream) const;
+    /// Get a specific child based on the stream id. 
+    cnmemStatus_t getChild(Manager *&manager, std::size_t i) const;
+    /// Add a new child.
+    cnmemStatus_t addChild(Manager *manager);
+    /// The number of children.
+    cnmemStatus_t getNumChildren(std::size_t &numChildren) const;
+
+    /// The backing memory.
+    inline Backing* getBacking() const { return mBacking; }
+    /// The flags.
+    inline unsigned getFlags() const { return mFlags; }
+    /// Get the mutex.
+    inline const Mutex* getMutex() const { return &mMutex; }
+    /// The size allocated to that manager.
+    inline std::size_t getSize() const { return mSize; }
+    /// The stream.
+    inline void* getStream() const { return mStream; }
+    
+    /// Define the parent.
+    inline void setParent(Manager *parent) { mParent = parent; }
+    /// Define the backing memory.
+    inline void setBacking(Backing *backing) { mBacking = backing; }
+    /// Define the stream.
+    inline void setStream(void *stream, bool isBlocking) { 
+        mStream = stream; 
+        mIsStreamBlocking = isBlocking;
+    }
+    /// Define the flags.
+    inline void setFlags(unsigned flags) { mFlags = flags; }
+    
+private:
+    /// The member functions below which are marked "Unsafe" are not thread-safe when called on a
+    /// same Manager object. Make sure they are called by a single thread in that case.
+
+    /// Allocate a new block and add it to the free list.
+    cnmemStatus_t allocateBlockUnsafe(Block *&curr, std::size_t size);
+    /// Release a block from the active list.
+    cnmemStatus_t releaseBlockUnsafe(Block *curr);
+    /// Find the best free node based on the size.
+    cnmemStatus_t findBestBlockUnsafe(Block *&curr, std::size_t size);
+    /// Extract a node from the list of free blocks.
+    cnmemStatus_t extractBlockUnsafe(Block *curr, std::size_t size, bool stolen);
+    /// Add a node to the free blocks.
+    void insertFreeBlockUnsafe(Block *curr);
+    /// Remove a node from the free blocks.
+    void eraseFreeBlockUnsafe(Block *curr);
+    
+    /// Give a free block from that manager.
+    cnmemStatus_t giveBlockUnsafe(void *&data, std::size_t &dataSize, std::size_t size);
+    /// Steal a block from another manager.
+    cnmemStatus_t stealBlockUnsafe(void *&data, std::size_t &dataSize, std::size_t size);
+    
+    /// The memory consumption of a list.
+    cnmemStatus_t getMemoryUnsafe(std::size_t &memSize, const BlocksByAddress &blocks) const;
+    /// Print an internal list.
+    cnmemStatus_t printListUnsafe(FILE *file, const char *name, const BlocksByAddress &blocks) const;
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+} // namespace cnmem
+
+#endif // __cplusplus
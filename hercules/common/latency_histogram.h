@@ -0,0 +1,102 @@
+/****************************************************************
+ * Copyright (c) 2022, liyinbin
+ * All rights reserved.
+ * Author by liyinbin (jeff.li) lijippy@163.com
+ *****************************************************************/
+
+#ifndef HERCULES_COMMON_LATENCY_HISTOGRAM_H_
+#define HERCULES_COMMON_LATENCY_HISTOGRAM_H_
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace hercules::common {
+
+    //
+    // Histogram of durations in nanoseconds with power of two buckets: bucket
+    // 0 counts durations below 2ns, and bucket i > 0 counts the durations in
+    // [2^i, 2^(i+1)) ns. Recording is wait-free and meant to be done by a
+    // single thread, i.e. one histogram per worker, while any thread may take
+    // snapshots.
+    //
+    class latency_histogram {
+    public:
+        static constexpr size_t kBucketCount = 64;
+
+        // A copy of the histogram at one point in time.
+        struct snapshot {
+            uint64_t count_ = 0;
+            uint64_t sum_ns_ = 0;
+            uint64_t max_ns_ = 0;
+            std::array<uint64_t, kBucketCount> buckets_{};
+
+            void merge(const snapshot &other) {
+                count_ += other.count_;
+                sum_ns_ += other.sum_ns_;
+                max_ns_ = (other.max_ns_ > max_ns_) ? other.max_ns_ : max_ns_;
+                for (size_t i = 0; i < kBucketCount; ++i) {
+                    buckets_[i] += other.buckets_[i];
+                }
+            }
+
+            uint64_t mean_ns() const { return (count_ == 0) ? 0 : (sum_ns_ / count_); }
+
+            // Return the upper bound of the bucket holding the 'quantile'
+            // (in [0, 1]) of the recorded durations, capped by the largest
+            // recorded duration. Return 0 if nothing was recorded.
+            uint64_t percentile_ns(double quantile) const {
+                if (count_ == 0) {
+                    return 0;
+                }
+                const auto rank = static_cast<uint64_t>(quantile * static_cast<double>(count_));
+                uint64_t seen = 0;
+                for (size_t i = 0; i < kBucketCount; ++i) {
+                    seen += buckets_[i];
+                    if (seen > rank || seen == count_) {
+                        const uint64_t bound =
+                                (i + 1 < kBucketCount) ? ((uint64_t(1) << (i + 1)) - 1) : UINT64_MAX;
+                        return (bound < max_ns_) ? bound : max_ns_;
+                    }
+                }
+                return max_ns_;
+            }
+        };
+
+        static size_t bucket(uint64_t ns) {
+            return (ns < 2) ? 0 : (63 - __builtin_clzll(ns));
+        }
+
+        void record(uint64_t ns) {
+            buckets_[bucket(ns)].fetch_add(1, std::memory_order_relaxed);
+            count_.fetch_add(1, std::memory_order_relaxed);
+            sum_ns_.fetch_add(ns, std::memory_order_relaxed);
+            if (ns > max_ns_.load(std::memory_order_relaxed)) {
+                max_ns_.store(ns, std::memory_order_relaxed);
+            }
+        }
+
+        // The counts are read one by one, so a snapshot taken while recording
+        // may be off by the durations recorded meanwhile.
+        snapshot get_snapshot() const {
+            snapshot result;
+            result.count_ = count_.load(std::memory_order_relaxed);
+            result.sum_ns_ = sum_ns_.load(std::memory_order_relaxed);
+            result.max_ns_ = max_ns_.load(std::memory_order_relaxed);
+            for (size_t i = 0; i < kBucketCount; ++i) {
+                result.buckets_[i] = buckets_[i].load(std::memory_order_relaxed);
+            }
+            return result;
+        }
+
+    private:
+        std::atomic<uint64_t> count_{0};
+        std::atomic<uint64_t> sum_ns_{0};
+        std::atomic<uint64_t> max_ns_{0};
+        std::array<std::atomic<uint64_t>, kBucketCount> buckets_{};
+    };
+
+}  // namespace hercules::common
+
+#endif  // HERCULES_COMMON_LATENCY_HISTOGRAM_H_
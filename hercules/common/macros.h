@@ -7,6 +7,10 @@
 
 #include <flare/base/result_status.h>
 
+// Size of a cache line, used to pad data touched by different threads so
+// that they don't share a line.
+#define HERCULES_CACHELINE_SIZE 64
+
 #define RETURN_IF_ERROR(S)        \
   do {                            \
     const flare::result_status& status__ = (S); \
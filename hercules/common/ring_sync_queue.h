@@ -0,0 +1,255 @@
+/****************************************************************
+ * Copyright (c) 2022, liyinbin
+ * All rights reserved.
+ * Author by liyinbin (jeff.li) lijippy@163.com
+ *****************************************************************/
+
+#ifndef HERCULES_COMMON_RING_SYNC_QUEUE_H_
+#define HERCULES_COMMON_RING_SYNC_QUEUE_H_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
+#include "hercules/common/macros.h"
+#include "hercules/common/wait_strategy.h"
+
+namespace hercules::common {
+
+    //
+    // Bounded lock-free multi-producer multi-consumer queue with the same
+    // surface as sync_queue. Items live in a ring of cache line padded cells,
+    // each with a sequence number telling whether it is ready to be written
+    // or read, so producers and consumers only contend on the ring indices.
+    // Mutexes are only used to park threads that have to block, and are not
+    // touched at all when nobody is parked.
+    //
+    template<typename Item>
+    class ring_sync_queue {
+    public:
+        // 'capacity' is rounded up to a power of two. 'wait' selects how Get()
+        // and Put() wait when the queue is empty or full.
+        explicit ring_sync_queue(
+                size_t capacity = 1024, const wait_options &wait = wait_options())
+                : wait_(wait) {
+            size_t size = 2;
+            while (size < capacity) {
+                size <<= 1;
+            }
+            mask_ = size - 1;
+            cells_.reset(new cell[size]);
+            for (size_t i = 0; i < size; ++i) {
+                cells_[i].sequence_.store(i, std::memory_order_relaxed);
+            }
+        }
+
+        ~ring_sync_queue() {
+            Item item;
+            while (TryGet(&item)) {
+            }
+        }
+
+        ring_sync_queue(const ring_sync_queue &) = delete;
+
+        ring_sync_queue &operator=(const ring_sync_queue &) = delete;
+
+        size_t Capacity() const { return mask_ + 1; }
+
+        bool Empty() {
+            const size_t head = head_.load(std::memory_order_acquire);
+            const auto &c = cells_[head & mask_];
+            return static_cast<intptr_t>(c.sequence_.load(std::memory_order_acquire) -
+                                         (head + 1)) < 0;
+        }
+
+        bool Full() {
+            const size_t tail = tail_.load(std::memory_order_acquire);
+            const auto &c = cells_[tail & mask_];
+            return static_cast<intptr_t>(c.sequence_.load(std::memory_order_acquire) -
+                                         tail) < 0;
+        }
+
+        // Remove the next item into 'item' if there is one. Never blocks.
+        bool TryGet(Item *item) {
+            size_t head = head_.load(std::memory_order_relaxed);
+            while (true) {
+                cell &c = cells_[head & mask_];
+                const size_t seq = c.sequence_.load(std::memory_order_acquire);
+                const auto diff = static_cast<intptr_t>(seq - (head + 1));
+                if (diff == 0) {
+                    if (head_.compare_exchange_weak(
+                            head, head + 1, std::memory_order_relaxed)) {
+                        Item *value = c.item();
+                        *item = std::move(*value);
+                        value->~Item();
+                        c.sequence_.store(head + mask_ + 1, std::memory_order_release);
+                        notify(&not_full_);
+                        return true;
+                    }
+                } else if (diff < 0) {
+                    return false;
+                } else {
+                    head = head_.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        Item Get() {
+            Item item;
+            while (!TryGet(&item)) {
+                park(&not_empty_, [this]() { return !Empty(); });
+            }
+            return item;
+        }
+
+        // Wait up to 'timeout' for an item. Return false if none arrived.
+        template<typename Rep, typename Period>
+        bool Get(Item *item, const std::chrono::duration<Rep, Period> &timeout) {
+            const auto deadline = std::chrono::steady_clock::now() + timeout;
+            while (!TryGet(item)) {
+                if (!park_until(&not_empty_, deadline, [this]() { return !Empty(); })) {
+                    return TryGet(item);
+                }
+            }
+            return true;
+        }
+
+        // Wait for at least one item, then move up to 'max_items' items that are
+        // immediately available to the end of 'items'. Return the number of
+        // items moved.
+        size_t GetBatch(std::vector<Item> *items, size_t max_items) {
+            if (max_items == 0) {
+                return 0;
+            }
+            items->push_back(Get());
+            size_t count = 1;
+            Item item;
+            while ((count < max_items) && TryGet(&item)) {
+                items->push_back(std::move(item));
+                ++count;
+            }
+            return count;
+        }
+
+        // Add 'value' if the queue is not full. Never blocks.
+        bool TryPut(Item &&value) { return try_emplace(std::move(value)); }
+
+        bool TryPut(const Item &value) { return try_emplace(value); }
+
+        // Add 'value', waiting for room if the queue is full.
+        void Put(const Item &value) {
+            while (!try_emplace(value)) {
+                park(&not_full_, [this]() { return !Full(); });
+            }
+        }
+
+        void Put(Item &&value) {
+            while (!try_emplace(std::move(value))) {
+                park(&not_full_, [this]() { return !Full(); });
+            }
+        }
+
+        // Returns how often a blocking call was resolved while spinning, and
+        // how often it had to block.
+        wait_counters GetWaitCounters() const { return wait_.counters(); }
+
+    private:
+        struct alignas(HERCULES_CACHELINE_SIZE) cell {
+            Item *item() { return std::launder(reinterpret_cast<Item *>(&storage_)); }
+
+            std::atomic<size_t> sequence_;
+            alignas(Item) unsigned char storage_[sizeof(Item)];
+        };
+
+        // Only consumes 'value' on success.
+        template<typename V>
+        bool try_emplace(V &&value) {
+            size_t tail = tail_.load(std::memory_order_relaxed);
+            while (true) {
+                cell &c = cells_[tail & mask_];
+                const size_t seq = c.sequence_.load(std::memory_order_acquire);
+                const auto diff = static_cast<intptr_t>(seq - tail);
+                if (diff == 0) {
+                    if (tail_.compare_exchange_weak(
+                            tail, tail + 1, std::memory_order_relaxed)) {
+                        new(&c.storage_) Item(std::forward<V>(value));
+                        c.sequence_.store(tail + 1, std::memory_order_release);
+                        notify(&not_empty_);
+                        return true;
+                    }
+                } else if (diff < 0) {
+                    return false;
+                } else {
+                    tail = tail_.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        // Threads blocked on one condition of the queue.
+        struct parking_lot {
+            std::atomic<size_t> waiters_{0};
+            std::mutex mtx_;
+            std::condition_variable cv_;
+        };
+
+        // Wake a thread parked in 'lot'. The fence pairs with the one in park()
+        // so that either the parking thread sees the change to the queue, or
+        // this sees the parking thread.
+        void notify(parking_lot *lot) {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (lot->waiters_.load(std::memory_order_relaxed) != 0) {
+                { std::lock_guard<std::mutex> lk(lot->mtx_); }
+                lot->cv_.notify_one();
+            }
+        }
+
+        // Block until 'pred' holds. 'pred' must only read the queue.
+        template<typename Pred>
+        void park(parking_lot *lot, Pred &&pred) {
+            if (wait_.spin(pred)) {
+                return;
+            }
+            wait_.count_park();
+            std::unique_lock<std::mutex> lk(lot->mtx_);
+            lot->waiters_.fetch_add(1);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            lot->cv_.wait(lk, pred);
+            lot->waiters_.fetch_sub(1);
+        }
+
+        template<typename Pred>
+        bool park_until(
+                parking_lot *lot, const std::chrono::steady_clock::time_point &deadline,
+                Pred &&pred) {
+            // Busy polling would ignore the deadline, only the bounded spin applies
+            if ((wait_.options().policy_ == wait_policy::kSpinThenBlock) &&
+                wait_.spin(pred)) {
+                return true;
+            }
+            wait_.count_park();
+            std::unique_lock<std::mutex> lk(lot->mtx_);
+            lot->waiters_.fetch_add(1);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            const bool ready = lot->cv_.wait_until(lk, deadline, pred);
+            lot->waiters_.fetch_sub(1);
+            return ready;
+        }
+
+        std::unique_ptr<cell[]> cells_;
+        size_t mask_;
+        alignas(HERCULES_CACHELINE_SIZE) std::atomic<size_t> head_{0};
+        alignas(HERCULES_CACHELINE_SIZE) std::atomic<size_t> tail_{0};
+        alignas(HERCULES_CACHELINE_SIZE) parking_lot not_empty_;
+        alignas(HERCULES_CACHELINE_SIZE) parking_lot not_full_;
+        wait_strategy wait_;
+    };
+
+}  // namespace hercules::common
+
+#endif  // HERCULES_COMMON_RING_SYNC_QUEUE_H_
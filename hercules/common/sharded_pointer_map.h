@@ -0,0 +1,188 @@
+/****************************************************************
+ * Copyright (c) 2022, liyinbin
+ * All rights reserved.
+ * Author by liyinbin (jeff.li) lijippy@163.com
+ *****************************************************************/
+
+#ifndef HERCULES_COMMON_SHARDED_POINTER_MAP_H_
+#define HERCULES_COMMON_SHARDED_POINTER_MAP_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+#include "hercules/common/macros.h"
+
+namespace hercules::common {
+
+    //
+    // Map from non-null pointers to 'Value', i.e. to track the owner of live
+    // allocations. Keys are hashed to one of a fixed number of shards, each an
+    // open-addressing table with linear probing under its own lock, so threads
+    // working on different pointers rarely contend and every operation is
+    // O(1) on average.
+    //
+    template<typename Value>
+    class sharded_pointer_map {
+    public:
+        // 'shard_count' is rounded up to a power of two.
+        explicit sharded_pointer_map(size_t shard_count = 64) {
+            size_t count = 1;
+            while (count < shard_count) {
+                count <<= 1;
+            }
+            shard_bits_ = 0;
+            while ((size_t(1) << shard_bits_) < count) {
+                ++shard_bits_;
+            }
+            shards_.reset(new shard[count]);
+            shard_count_ = count;
+        }
+
+        sharded_pointer_map(const sharded_pointer_map &) = delete;
+
+        sharded_pointer_map &operator=(const sharded_pointer_map &) = delete;
+
+        // Add 'key' with 'value'. Return false if 'key' is already present.
+        bool insert(void *key, const Value &value) {
+            const uint64_t h = hash(key);
+            auto &s = shards_[shard_index(h)];
+            std::lock_guard<std::mutex> lk(s.mtx_);
+            // Keep the load factor at most 1/2
+            if ((s.count_ + 1) * 2 > s.slots_.size()) {
+                grow(&s);
+            }
+            const size_t mask = s.slots_.size() - 1;
+            for (size_t i = h & mask;; i = (i + 1) & mask) {
+                auto &slot = s.slots_[i];
+                if (slot.key_ == nullptr) {
+                    slot.key_ = key;
+                    slot.value_ = value;
+                    ++s.count_;
+                    return true;
+                }
+                if (slot.key_ == key) {
+                    return false;
+                }
+            }
+        }
+
+        // Remove 'key' and return its value in 'value'. Return false if 'key'
+        // is not present.
+        bool erase(void *key, Value *value) {
+            const uint64_t h = hash(key);
+            auto &s = shards_[shard_index(h)];
+            std::lock_guard<std::mutex> lk(s.mtx_);
+            if (s.count_ == 0) {
+                return false;
+            }
+            const size_t mask = s.slots_.size() - 1;
+            size_t i = h & mask;
+            for (;; i = (i + 1) & mask) {
+                if (s.slots_[i].key_ == nullptr) {
+                    return false;
+                }
+                if (s.slots_[i].key_ == key) {
+                    break;
+                }
+            }
+            *value = std::move(s.slots_[i].value_);
+            --s.count_;
+
+            // Shift the following entries of the probe sequence back, so that no
+            // tombstones are needed.
+            size_t hole = i;
+            for (size_t j = (i + 1) & mask; s.slots_[j].key_ != nullptr; j = (j + 1) & mask) {
+                const size_t home = hash(s.slots_[j].key_) & mask;
+                // Move the entry if its home slot is not in (hole, j]
+                if (((j - home) & mask) >= ((j - hole) & mask)) {
+                    s.slots_[hole] = std::move(s.slots_[j]);
+                    hole = j;
+                }
+            }
+            s.slots_[hole].key_ = nullptr;
+            return true;
+        }
+
+        // Call 'fn(key, value)' for each entry. Entries added or removed
+        // meanwhile may or may not be visited.
+        template<typename F>
+        void for_each(F &&fn) {
+            for (size_t i = 0; i < shard_count_; ++i) {
+                auto &s = shards_[i];
+                std::lock_guard<std::mutex> lk(s.mtx_);
+                for (auto &slot : s.slots_) {
+                    if (slot.key_ != nullptr) {
+                        fn(slot.key_, slot.value_);
+                    }
+                }
+            }
+        }
+
+        size_t size() {
+            size_t size = 0;
+            for (size_t i = 0; i < shard_count_; ++i) {
+                std::lock_guard<std::mutex> lk(shards_[i].mtx_);
+                size += shards_[i].count_;
+            }
+            return size;
+        }
+
+    private:
+        struct slot {
+            void *key_ = nullptr;
+            Value value_{};
+        };
+
+        struct alignas(HERCULES_CACHELINE_SIZE) shard {
+            std::mutex mtx_;
+            // Size is always zero or a power of two.
+            std::vector<slot> slots_;
+            size_t count_ = 0;
+        };
+
+        static uint64_t hash(void *key) {
+            // The fmix64 finalizer of MurmurHash3, so that every bit of the
+            // key reaches both the high and the low bits. A plain multiply
+            // leaves the low bits of page aligned keys, i.e. chunks and large
+            // blocks, all equal, and these would share one home slot.
+            uint64_t h = reinterpret_cast<uintptr_t>(key);
+            h ^= h >> 33;
+            h *= 0xff51afd7ed558ccdull;
+            h ^= h >> 33;
+            h *= 0xc4ceb9fe1a85ec53ull;
+            h ^= h >> 33;
+            return h;
+        }
+
+        // The shard comes from the high bits, the slot from the low ones.
+        size_t shard_index(uint64_t h) const {
+            return (shard_bits_ == 0) ? 0 : static_cast<size_t>(h >> (64 - shard_bits_));
+        }
+
+        void grow(shard *s) {
+            std::vector<slot> slots(s->slots_.empty() ? 16 : s->slots_.size() * 2);
+            const size_t mask = slots.size() - 1;
+            for (auto &old : s->slots_) {
+                if (old.key_ == nullptr) {
+                    continue;
+                }
+                size_t i = hash(old.key_) & mask;
+                while (slots[i].key_ != nullptr) {
+                    i = (i + 1) & mask;
+                }
+                slots[i] = std::move(old);
+            }
+            s->slots_.swap(slots);
+        }
+
+        std::unique_ptr<shard[]> shards_;
+        size_t shard_count_ = 0;
+        size_t shard_bits_ = 0;
+    };
+
+}  // namespace hercules::common
+
+#endif  // HERCULES_COMMON_SHARDED_POINTER_MAP_H_
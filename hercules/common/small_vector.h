@@ -0,0 +1,204 @@
+/****************************************************************
+ * Copyright (c) 2022, liyinbin
+ * All rights reserved.
+ * Author by liyinbin (jeff.li) lijippy@163.com
+ *****************************************************************/
+
+#ifndef HERCULES_COMMON_SMALL_VECTOR_H_
+#define HERCULES_COMMON_SMALL_VECTOR_H_
+
+#include <cstddef>
+#include <new>
+#include <utility>
+
+namespace hercules::common {
+
+    //
+    // Sequence that keeps up to 'N' elements inline, so that short sequences
+    // don't allocate, and that can grow at both ends. The elements are
+    // contiguous, in the middle of the storage when there is room, so
+    // emplace_front() and emplace_back() are amortized O(1) and indexing is a
+    // single addition. The storage moves to the heap past 'N' elements and
+    // stays there until the sequence is destroyed.
+    //
+    template<typename T, size_t N>
+    class small_vector {
+    public:
+        static_assert(N > 0, "small_vector needs an inline capacity");
+
+        using value_type = T;
+        using iterator = T *;
+        using const_iterator = const T *;
+
+        small_vector() = default;
+
+        small_vector(const small_vector &other) {
+            append(other);
+        }
+
+        small_vector(small_vector &&other) noexcept {
+            steal(&other);
+        }
+
+        small_vector &operator=(const small_vector &other) {
+            if (this != &other) {
+                clear();
+                append(other);
+            }
+            return *this;
+        }
+
+        small_vector &operator=(small_vector &&other) noexcept {
+            if (this != &other) {
+                clear();
+                release_heap();
+                steal(&other);
+            }
+            return *this;
+        }
+
+        ~small_vector() {
+            clear();
+            release_heap();
+        }
+
+        size_t size() const { return size_; }
+
+        bool empty() const { return size_ == 0; }
+
+        size_t capacity() const { return capacity_; }
+
+        T &operator[](size_t i) { return data_[begin_ + i]; }
+
+        const T &operator[](size_t i) const { return data_[begin_ + i]; }
+
+        T &front() { return data_[begin_]; }
+
+        T &back() { return data_[begin_ + size_ - 1]; }
+
+        iterator begin() { return data_ + begin_; }
+
+        iterator end() { return data_ + begin_ + size_; }
+
+        const_iterator begin() const { return data_ + begin_; }
+
+        const_iterator end() const { return data_ + begin_ + size_; }
+
+        template<typename... Args>
+        T &emplace_back(Args &&... args) {
+            if (begin_ + size_ == capacity_) {
+                make_room(false);
+            }
+            T *slot = new(data_ + begin_ + size_) T(std::forward<Args>(args)...);
+            ++size_;
+            return *slot;
+        }
+
+        template<typename... Args>
+        T &emplace_front(Args &&... args) {
+            if (begin_ == 0) {
+                make_room(true);
+            }
+            T *slot = new(data_ + begin_ - 1) T(std::forward<Args>(args)...);
+            --begin_;
+            ++size_;
+            return *slot;
+        }
+
+        // Destroy the elements, the storage is kept.
+        void clear() {
+            for (size_t i = 0; i < size_; ++i) {
+                data_[begin_ + i].~T();
+            }
+            begin_ = 0;
+            size_ = 0;
+        }
+
+    private:
+        T *inline_data() { return reinterpret_cast<T *>(inline_); }
+
+        bool is_inline() const { return data_ == reinterpret_cast<const T *>(inline_); }
+
+        void append(const small_vector &other) {
+            for (const auto &value : other) {
+                emplace_back(value);
+            }
+        }
+
+        // Take the elements of the empty, inline 'this' from 'other'.
+        void steal(small_vector *other) {
+            if (other->is_inline()) {
+                for (auto &value : *other) {
+                    emplace_back(std::move(value));
+                }
+                other->clear();
+                return;
+            }
+            data_ = other->data_;
+            capacity_ = other->capacity_;
+            begin_ = other->begin_;
+            size_ = other->size_;
+            other->data_ = other->inline_data();
+            other->capacity_ = N;
+            other->begin_ = 0;
+            other->size_ = 0;
+        }
+
+        void release_heap() {
+            if (!is_inline()) {
+                ::operator delete(data_);
+                data_ = inline_data();
+                capacity_ = N;
+            }
+        }
+
+        // Make room for one element at the front or at the back. Spare slots
+        // at the other end are split between both ends first, the storage
+        // doubles once there are none.
+        void make_room(bool front) {
+            const size_t spare = capacity_ - size_;
+            if (spare != 0) {
+                shift(front ? (spare + 1) / 2 : spare / 2);
+                return;
+            }
+            const size_t capacity = capacity_ * 2;
+            T *data = static_cast<T *>(::operator new(capacity * sizeof(T)));
+            const size_t begin = front ? (capacity - size_ + 1) / 2 : 0;
+            for (size_t i = 0; i < size_; ++i) {
+                new(data + begin + i) T(std::move(data_[begin_ + i]));
+                data_[begin_ + i].~T();
+            }
+            release_heap();
+            data_ = data;
+            capacity_ = capacity;
+            begin_ = begin;
+        }
+
+        // Move the elements within the storage to start at 'begin'.
+        void shift(size_t begin) {
+            if (begin > begin_) {
+                // Backwards, the slots ahead are vacated first
+                for (size_t i = size_; i-- > 0;) {
+                    new(data_ + begin + i) T(std::move(data_[begin_ + i]));
+                    data_[begin_ + i].~T();
+                }
+            } else {
+                for (size_t i = 0; i < size_; ++i) {
+                    new(data_ + begin + i) T(std::move(data_[begin_ + i]));
+                    data_[begin_ + i].~T();
+                }
+            }
+            begin_ = begin;
+        }
+
+        T *data_ = inline_data();
+        size_t capacity_ = N;
+        // The elements are [begin_, begin_ + size_) of 'data_'.
+        size_t begin_ = 0;
+        size_t size_ = 0;
+        alignas(T) unsigned char inline_[N * sizeof(T)];
+    };
+
+}  // namespace hercules::common
+
+#endif  // HERCULES_COMMON_SMALL_VECTOR_H_
@@ -8,9 +8,13 @@
 #ifndef HERCULES_COMMON_SYNC_QUEUE_H_
 #define HERCULES_COMMON_SYNC_QUEUE_H_
 
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
 #include <deque>
 #include <mutex>
+#include <vector>
+#include "hercules/common/wait_strategy.h"
 
 namespace hercules::common {
 
@@ -22,41 +26,117 @@ namespace hercules::common {
     public:
         sync_queue() {}
 
+        // 'wait' selects how Get() waits for an item, i.e. whether it spins
+        // before blocking.
+        explicit sync_queue(const wait_options &wait) : wait_(wait) {}
+
         bool Empty() {
             std::lock_guard<std::mutex> lk(mu_);
             return queue_.empty();
         }
 
         Item Get() {
+            spin();
             std::unique_lock<std::mutex> lk(mu_);
             if (queue_.empty()) {
+                wait_.count_park();
                 cv_.wait(lk, [this] { return !queue_.empty(); });
             }
             auto res = std::move(queue_.front());
-            queue_.pop_front();
+            pop_front();
             return res;
         }
 
+        // Remove the next item into 'item' if there is one. Never blocks.
+        bool TryGet(Item *item) {
+            std::lock_guard<std::mutex> lk(mu_);
+            if (queue_.empty()) {
+                return false;
+            }
+            *item = std::move(queue_.front());
+            pop_front();
+            return true;
+        }
+
+        // Wait up to 'timeout' for an item. Return false if none arrived.
+        template<typename Rep, typename Period>
+        bool Get(Item *item, const std::chrono::duration<Rep, Period> &timeout) {
+            // Busy polling would ignore the timeout, only the bounded spin applies
+            if (wait_.options().policy_ == wait_policy::kSpinThenBlock) {
+                spin();
+            }
+            std::unique_lock<std::mutex> lk(mu_);
+            if (queue_.empty()) {
+                wait_.count_park();
+                if (!cv_.wait_for(lk, timeout, [this] { return !queue_.empty(); })) {
+                    return false;
+                }
+            }
+            *item = std::move(queue_.front());
+            pop_front();
+            return true;
+        }
+
+        // Wait for at least one item, then move up to 'max_items' items to the
+        // end of 'items'. Return the number of items moved.
+        size_t GetBatch(std::vector<Item> *items, size_t max_items) {
+            if (max_items == 0) {
+                return 0;
+            }
+            spin();
+            std::unique_lock<std::mutex> lk(mu_);
+            if (queue_.empty()) {
+                wait_.count_park();
+                cv_.wait(lk, [this] { return !queue_.empty(); });
+            }
+            size_t count = 0;
+            for (; (count < max_items) && !queue_.empty(); ++count) {
+                items->push_back(std::move(queue_.front()));
+                pop_front();
+            }
+            return count;
+        }
+
+        // Each item can only satisfy one waiter, so only wake one.
         void Put(const Item &value) {
             {
                 std::lock_guard<std::mutex> lk(mu_);
                 queue_.push_back(value);
+                size_.store(queue_.size(), std::memory_order_relaxed);
             }
-            cv_.notify_all();
+            cv_.notify_one();
         }
 
         void Put(Item &&value) {
             {
                 std::lock_guard<std::mutex> lk(mu_);
                 queue_.push_back(std::move(value));
+                size_.store(queue_.size(), std::memory_order_relaxed);
             }
-            cv_.notify_all();
+            cv_.notify_one();
         }
 
+        // Returns how often Get() found an item while spinning, and how often
+        // it blocked.
+        wait_counters GetWaitCounters() const { return wait_.counters(); }
+
     private:
+        // Spin as 'wait_' allows until an item seems available.
+        void spin() {
+            wait_.spin([this] { return size_.load(std::memory_order_relaxed) != 0; });
+        }
+
+        void pop_front() {
+            queue_.pop_front();
+            size_.store(queue_.size(), std::memory_order_relaxed);
+        }
+
         std::mutex mu_;
         std::condition_variable cv_;
         std::deque<Item> queue_;
+        // Mirror of 'queue_.size()' to spin on without taking the lock.
+        std::atomic<size_t> size_{0};
+        wait_strategy wait_;
     };
 
 }  // namespace hercules::common
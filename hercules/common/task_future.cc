@@ -0,0 +1,154 @@
+/****************************************************************
+ * Copyright (c) 2022, liyinbin
+ * All rights reserved.
+ * Author by liyinbin (jeff.li) lijippy@163.com
+ *****************************************************************/
+
+#include "hercules/common/task_future.h"
+#include <atomic>
+#include "hercules/common/async_work_queue.h"
+#include "hercules/common/error_code.h"
+
+namespace hercules::common {
+
+    task_future
+    task_future::make_ready(const flare::result_status &status) {
+        task_promise promise;
+        promise.set_value(status);
+        return promise.get_future();
+    }
+
+    task_future
+    task_future::when_all(const std::vector<task_future> &futures) {
+        struct join_state {
+            explicit join_state(size_t count) : remaining_(count) {}
+
+            std::atomic<size_t> remaining_;
+            std::mutex mtx_;
+            flare::result_status status_;
+            task_promise promise_;
+        };
+
+        if (futures.empty()) {
+            return make_ready(flare::result_status::success());
+        }
+
+        auto join = std::make_shared<join_state>(futures.size());
+        task_future all = join->promise_.get_future();
+        for (const auto &future : futures) {
+            // The counting is cheap, run it on the thread completing 'future'
+            future.on_ready(
+                    [join, parent = future.state_]() {
+                        if (!parent->status_.is_ok()) {
+                            std::lock_guard<std::mutex> lk(join->mtx_);
+                            if (join->status_.is_ok()) {
+                                join->status_ = parent->status_;
+                            }
+                        }
+                        if (join->remaining_.fetch_sub(1) == 1) {
+                            flare::result_status status;
+                            {
+                                std::lock_guard<std::mutex> lk(join->mtx_);
+                                status = join->status_;
+                            }
+                            join->promise_.set_value(status);
+                        }
+                    },
+                    true);
+        }
+        return all;
+    }
+
+    bool
+    task_future::is_ready() const {
+        if (state_ == nullptr) {
+            return false;
+        }
+        std::lock_guard<std::mutex> lk(state_->mtx_);
+        return state_->ready_;
+    }
+
+    void
+    task_future::wait() const {
+        if (state_ == nullptr) {
+            return;
+        }
+        std::unique_lock<std::mutex> lk(state_->mtx_);
+        state_->cv_.wait(lk, [this]() { return state_->ready_; });
+    }
+
+    flare::result_status
+    task_future::get() const {
+        if (state_ == nullptr) {
+            return flare::result_status(ERROR_INVALID_ARG, "task future has no state");
+        }
+        std::unique_lock<std::mutex> lk(state_->mtx_);
+        state_->cv_.wait(lk, [this]() { return state_->ready_; });
+        return state_->status_;
+    }
+
+    void
+    task_future::on_ready(unique_task &&callback, bool run_inline) const {
+        // An invalid future never becomes ready, dropping 'callback' breaks the
+        // promise it holds, if any.
+        if (state_ == nullptr) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lk(state_->mtx_);
+            if (!state_->ready_) {
+                state_->callbacks_.emplace_back(std::move(callback), run_inline);
+                return;
+            }
+        }
+
+        // Already ready, run the callback right away from the calling thread
+        if (run_inline || !async_work_queue::add_task(std::move(callback)).is_ok()) {
+            callback();
+        }
+    }
+
+    task_promise::task_promise() : state_(std::make_shared<task_future::state>()) {}
+
+    task_promise &
+    task_promise::operator=(task_promise &&other) noexcept {
+        if (this != &other) {
+            if (state_ != nullptr) {
+                set_value(flare::result_status(ERROR_INTERNAL, "task promise is broken"));
+            }
+            state_ = std::move(other.state_);
+        }
+        return *this;
+    }
+
+    task_promise::~task_promise() {
+        if (state_ != nullptr) {
+            set_value(flare::result_status(ERROR_INTERNAL, "task promise is broken"));
+        }
+    }
+
+    void
+    task_promise::set_value(const flare::result_status &status) {
+        std::vector<std::pair<unique_task, bool>> callbacks;
+        {
+            std::lock_guard<std::mutex> lk(state_->mtx_);
+            if (state_->ready_) {
+                return;
+            }
+            state_->ready_ = true;
+            state_->status_ = status;
+            callbacks.swap(state_->callbacks_);
+        }
+        state_->cv_.notify_all();
+
+        for (auto &callback : callbacks) {
+            // Fall back to running inline if the work queue doesn't take the
+            // continuation, so that the chain is never dropped.
+            if (callback.second ||
+                !async_work_queue::add_task(std::move(callback.first)).is_ok()) {
+                callback.first();
+            }
+        }
+    }
+
+}  // namespace hercules::common
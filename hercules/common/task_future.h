@@ -0,0 +1,123 @@
+/****************************************************************
+ * Copyright (c) 2022, liyinbin
+ * All rights reserved.
+ * Author by liyinbin (jeff.li) lijippy@163.com
+ *****************************************************************/
+
+#ifndef HERCULES_COMMON_TASK_FUTURE_H_
+#define HERCULES_COMMON_TASK_FUTURE_H_
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+#include <flare/base/result_status.h>
+#include "hercules/common/unique_task.h"
+
+namespace hercules::common {
+
+    class task_promise;
+
+    // The completion of a task submitted to the async work queue, carrying the
+    // status returned by the task. Continuations attached with then() run on
+    // the async work queue once the future is ready, so stages of a pipeline
+    // can be chained without a thread blocking on each of them.
+    class task_future {
+    public:
+        // Create an invalid future, which is never ready.
+        task_future() = default;
+
+        // Create a future that is already ready with 'status'.
+        static task_future make_ready(const flare::result_status &status);
+
+        // Return a future that is ready once all 'futures' are ready. Its status
+        // is the first non-OK status among 'futures', or success.
+        static task_future when_all(const std::vector<task_future> &futures);
+
+        bool valid() const { return state_ != nullptr; }
+
+        bool is_ready() const;
+
+        // Block until the future is ready.
+        void wait() const;
+
+        // Block until the future is ready and return the status of the task.
+        flare::result_status get() const;
+
+        // Run 'fn', a callable returning flare::result_status, on the async work
+        // queue once this future is ready. 'fn' is only run if this future
+        // completes with success, otherwise the returned future completes with
+        // the same error without running 'fn'.
+        template<typename F>
+        task_future then(F &&fn) const;
+
+    private:
+        friend class task_promise;
+
+        struct state {
+            std::mutex mtx_;
+            std::condition_variable cv_;
+            bool ready_ = false;
+            flare::result_status status_;
+            // Callbacks to run once ready, and whether to run them inline
+            // instead of on the async work queue.
+            std::vector<std::pair<unique_task, bool>> callbacks_;
+        };
+
+        explicit task_future(std::shared_ptr<state> state) : state_(std::move(state)) {}
+
+        // Run 'callback' once this future is ready. If 'run_inline' is true the
+        // callback runs on the thread completing the future, otherwise it is
+        // added to the async work queue.
+        void on_ready(unique_task &&callback, bool run_inline) const;
+
+        std::shared_ptr<state> state_;
+    };
+
+    // The producing side of a task_future. If a promise is destroyed without a
+    // value being set, its future completes with an internal error.
+    class task_promise {
+    public:
+        task_promise();
+
+        task_promise(task_promise &&other) noexcept = default;
+
+        task_promise &operator=(task_promise &&other) noexcept;
+
+        task_promise(const task_promise &) = delete;
+
+        task_promise &operator=(const task_promise &) = delete;
+
+        ~task_promise();
+
+        task_future get_future() const { return task_future(state_); }
+
+        // Complete the future with 'status'. Only the first call has effect.
+        void set_value(const flare::result_status &status);
+
+    private:
+        std::shared_ptr<task_future::state> state_;
+    };
+
+    template<typename F>
+    task_future
+    task_future::then(F &&fn) const {
+        task_promise promise;
+        task_future next = promise.get_future();
+        on_ready(
+                [parent = state_, promise = std::move(promise),
+                        fn = std::forward<F>(fn)]() mutable {
+                    if (parent->status_.is_ok()) {
+                        promise.set_value(fn());
+                    } else {
+                        promise.set_value(parent->status_);
+                    }
+                },
+                false);
+        return next;
+    }
+
+}  // namespace hercules::common
+
+#endif  // HERCULES_COMMON_TASK_FUTURE_H_
@@ -1,4 +1,3 @@
-
 /****************************************************************
  * Copyright (c) 2022, liyinbin
  * All rights reserved.
@@ -6,69 +5,548 @@
  *****************************************************************/
 
 #include "hercules/common/thread_pool.h"
+#include <algorithm>
 #include <stdexcept>
 
 namespace hercules::common {
 
-    thread_pool::thread_pool(size_t thread_count) {
-        if (!thread_count) {
+    namespace {
+        // The pool and the worker index of the calling thread, if the calling
+        // thread is a pool worker.
+        thread_local const thread_pool *current_pool = nullptr;
+        thread_local size_t current_index = 0;
+    }  // namespace
+
+    thread_pool::thread_pool(size_t thread_count)
+            : thread_pool(options(thread_count)) {
+    }
+
+    thread_pool::thread_pool(const options &options)
+            : options_(options), wait_(options.wait_) {
+        // Without explicit groups the pool is a single group
+        if (options_.groups_.empty()) {
+            options_.groups_.emplace_back(options_.thread_count_);
+        } else {
+            options_.work_stealing_ = true;
+            options_.thread_count_ = 0;
+            for (const auto &group : options_.groups_) {
+                options_.thread_count_ += group.thread_count_;
+            }
+        }
+        if (!options_.thread_count_) {
             throw std::invalid_argument("Thread count must be greater than zero.");
         }
+        // Reserve the queues and slots of all the workers an elastic pool may
+        // grow to. Idle slots' queues are drained by stealing.
+        elastic_ = (options_.groups_.size() == 1) &&
+                   (options_.max_thread_count_ > options_.thread_count_);
+        if (elastic_) {
+            options_.groups_[0].thread_count_ = options_.max_thread_count_;
+        }
+        options_.priority_levels_ = std::max<uint32_t>(options_.priority_levels_, 1);
+        options_.default_priority_ =
+                std::min(options_.default_priority_, options_.priority_levels_ - 1);
+        const bool aging = (options_.priority_levels_ > 1) &&
+                           (options_.priority_aging_.count() != 0);
+        timestamped_ = options_.instrumentation_ || elastic_ || aging;
+
+        for (const auto &group : options_.groups_) {
+            if (!group.thread_count_) {
+                throw std::invalid_argument(
+                        "Thread count of a worker group must be greater than zero.");
+            }
+            auto state = std::make_unique<group_state>();
+            state->node_ = group.node_;
+            state->initializer_ = group.initializer_;
+            state->first_queue_ = queues_.size();
+            state->queue_count_ = options_.work_stealing_ ? group.thread_count_ : 1;
+            for (size_t i = 0; i < state->queue_count_; ++i) {
+                queues_.emplace_back(new task_queue());
+                queues_.back()->levels_.resize(options_.priority_levels_);
+                queue_group_.push_back(groups_.size());
+            }
+            worker_group_.insert(worker_group_.end(), group.thread_count_, groups_.size());
+            groups_.emplace_back(std::move(state));
+        }
+
+        const size_t slot_count = worker_group_.size();
+        worker_states_.reserve(slot_count);
+        for (size_t i = 0; i < slot_count; ++i) {
+            worker_states_.emplace_back(new worker_state());
+        }
+        workers_.resize(slot_count);
+        std::lock_guard<std::mutex> lk(resize_mtx_);
+        for (size_t i = 0; i < options_.thread_count_; ++i) {
+            worker_states_[i]->live_ = true;
+            live_count_.fetch_add(1);
+            workers_[i] = std::thread(&thread_pool::worker_loop, this, i);
+        }
+    }
+
+    thread_pool::~thread_pool() {
+        // Signal to each worker that it should exit loop when tasks are finished
+        stop_ = true;
+        // Wait for a worker being started, later ones see 'stop_'
+        { std::lock_guard<std::mutex> lk(resize_mtx_); }
+        // Wake all threads to clean up. The lock orders the wake-up after a
+        // parking worker has checked 'stop_'.
+        for (auto &group : groups_) {
+            { std::lock_guard<std::mutex> lk(group->park_mtx_); }
+            group->park_cv_.notify_all();
+        }
+        for (auto &t : workers_) {
+            if (t.joinable()) {
+                t.join();
+            }
+        }
+    }
 
-        // Define infinite loop for each thread to wait for a task to complete
-        const auto worker_loop = [this]() {
-            while (true) {
-                func_task task;
-                {
-                    std::unique_lock<std::mutex> lk(queue_mtx_);
-                    // Wake if there's a task to do, or the pool has been stopped.
-                    cv_.wait(lk, [&]() { return !task_queue_.empty() || stop_; });
-                    // Exit condition
-                    if (stop_ && task_queue_.empty()) {
-                        break;
+    void
+    thread_pool::worker_loop(size_t index) {
+        current_pool = this;
+        current_index = index;
+        const size_t group_index = worker_group_[index];
+        auto &group = *groups_[group_index];
+        if (group.initializer_) {
+            group.initializer_();
+        }
+
+        const bool grouped = groups_.size() > 1;
+        // Whether the worker may steal from other groups
+        const bool eager_remote = grouped && (options_.cross_group_steal_delay_.count() == 0);
+        bool remote = eager_remote;
+        // Busy polling workers never park, so they retire from the spin
+        const bool spin_retires =
+                elastic_ && (wait_.options().policy_ == wait_policy::kBusyPoll);
+        // Since when the worker has run out of work of its own group
+        bool idle = false;
+        std::chrono::steady_clock::time_point idle_since;
+        auto &counters = *worker_states_[index];
+        while (true) {
+            queued_task task;
+            if (try_pop(index, remote, &task)) {
+                idle = false;
+                remote = eager_remote;
+                if (elastic_ && (clock::now() - task.enqueued_ > options_.grow_queue_delay_) &&
+                    (group.idle_.load() == 0)) {
+                    grow();
+                }
+                // Execute task - ensure function has a valid target
+                if (task.task_) {
+                    if (options_.instrumentation_) {
+                        run_instrumented(index, &task);
+                    } else {
+                        task.task_();
                     }
-                    task = std::move(task_queue_.front());
-                    task_queue_.pop();
                 }
+                counters.tasks_run_.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
 
-                // Execute task - ensure function has a valid target
-                if (task) {
-                    task();
+            // Exit condition
+            if (stop_.load() && group.pending_.load() == 0) {
+                break;
+            }
+
+            if (grouped && !remote) {
+                const auto now = std::chrono::steady_clock::now();
+                if (!idle) {
+                    idle = true;
+                    idle_since = now;
+                } else if (now - idle_since >= options_.cross_group_steal_delay_) {
+                    // Other groups have been backlogged for long enough, help them
+                    remote = true;
+                    continue;
+                }
+            }
+
+            const auto has_work = [&group, group_index, grouped, this]() {
+                return group.pending_.load() != 0 || stop_.load() ||
+                       (grouped && remote_pending(group_index));
+            };
+            if (spin_retires) {
+                const auto spin_since = clock::now();
+                wait_.spin([&has_work, &spin_since, this]() {
+                    return has_work() || (clock::now() - spin_since >= options_.idle_timeout_);
+                });
+                if (!has_work() && retire(index)) {
+                    break;
                 }
+                continue;
             }
+            if (wait_.spin(has_work)) {
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lk(group.park_mtx_);
+            group.idle_.fetch_add(1);
+            if (!has_work()) {
+                wait_.count_park();
+            }
+            if (!remote && grouped && remote_pending(group_index)) {
+                // Only sleep until it is time to steal from the other groups
+                group.park_cv_.wait_until(
+                        lk, idle_since + options_.cross_group_steal_delay_, [&group, this]() {
+                            return group.pending_.load() != 0 || stop_.load();
+                        });
+            } else if (elastic_) {
+                // Retire when idle for too long, 'pending_' is checked under
+                // the lock so a submitter wakes another worker if needed.
+                if (!group.park_cv_.wait_for(lk, options_.idle_timeout_, has_work) &&
+                    retire(index)) {
+                    group.idle_.fetch_sub(1);
+                    break;
+                }
+            } else {
+                // Wake if there's a task to do, or the pool has been stopped.
+                group.park_cv_.wait(lk, has_work);
+            }
+            group.idle_.fetch_sub(1);
+        }
+
+        current_pool = nullptr;
+    }
+
+    void
+    thread_pool::run_instrumented(size_t index, queued_task *task) {
+        auto &state = *worker_states_[index];
+        const auto start = clock::now();
+        task->task_();
+        const auto end = clock::now();
+        const auto to_ns = [](clock::duration d) {
+            return static_cast<uint64_t>(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(d).count());
         };
+        state.queue_wait_.record(to_ns(start - task->enqueued_));
+        const uint64_t run_ns = to_ns(end - start);
+        state.run_time_.record(run_ns);
+        state.busy_ns_.fetch_add(run_ns, std::memory_order_relaxed);
+    }
 
-        workers_.reserve(thread_count);
-        for (size_t i = 0; i < thread_count; ++i) {
-            workers_.emplace_back(worker_loop);
+    thread_pool::stats
+    thread_pool::get_stats() const {
+        stats result;
+        result.instrumented_ = options_.instrumentation_;
+        result.worker_count_ = size();
+        for (const auto &group : groups_) {
+            result.queued_tasks_ += group->pending_.load(std::memory_order_relaxed);
         }
+        result.wait_ = wait_.counters();
+        result.workers_.resize(worker_states_.size());
+        for (size_t i = 0; i < worker_states_.size(); ++i) {
+            const auto &state = *worker_states_[i];
+            auto &worker = result.workers_[i];
+            worker.tasks_run_ = state.tasks_run_.load(std::memory_order_relaxed);
+            worker.tasks_stolen_ = state.tasks_stolen_.load(std::memory_order_relaxed);
+            worker.busy_ns_ = state.busy_ns_.load(std::memory_order_relaxed);
+            worker.queue_wait_ = state.queue_wait_.get_snapshot();
+            worker.run_time_ = state.run_time_.get_snapshot();
+            result.queue_wait_.merge(worker.queue_wait_);
+            result.run_time_.merge(worker.run_time_);
+        }
+        return result;
     }
 
-    thread_pool::~thread_pool() {
+    bool
+    thread_pool::try_pop_queue(size_t queue_index, queued_task *task) {
+        auto &queue = *queues_[queue_index];
+        if (queue.size_.load(std::memory_order_relaxed) == 0) {
+            return false;
+        }
+        std::lock_guard<std::mutex> lk(queue.mtx_);
+        const size_t size = queue.size_.load(std::memory_order_relaxed);
+        if (size == 0) {
+            return false;
+        }
+        const size_t level = select_level(queue);
+        *task = queue.levels_[level].pop_front();
+        if (queue.levels_[level].empty() &&
+            (level == queue.top_level_.load(std::memory_order_relaxed))) {
+            uint32_t top = level + 1;
+            while ((top < queue.levels_.size()) && queue.levels_[top].empty()) {
+                ++top;
+            }
+            queue.top_level_.store(
+                    (top < queue.levels_.size()) ? top : UINT32_MAX, std::memory_order_relaxed);
+        }
+        queue.size_.store(size - 1, std::memory_order_relaxed);
+        groups_[queue_group_[queue_index]]->pending_.fetch_sub(1);
+        return true;
+    }
+
+    size_t
+    thread_pool::select_level(const task_queue &queue) const {
+        const size_t level_count = queue.levels_.size();
+        size_t best = level_count;
+        if ((level_count == 1) || (options_.priority_aging_.count() == 0)) {
+            for (best = 0; queue.levels_[best].empty(); ++best) {
+            }
+            return best;
+        }
+
+        // Score each level by its rank minus the levels its front task has
+        // gained by waiting, the lowest score wins and ties go to the higher
+        // priority.
+        const auto now = clock::now();
+        const auto aging = std::chrono::duration_cast<clock::duration>(
+                options_.priority_aging_).count();
+        clock::rep best_score = 0;
+        for (size_t level = 0; level < level_count; ++level) {
+            const auto &tasks = queue.levels_[level];
+            if (tasks.empty()) {
+                continue;
+            }
+            const clock::rep score = static_cast<clock::rep>(level) * aging -
+                                     (now - tasks.front().enqueued_).count();
+            if ((best == level_count) || (score < best_score)) {
+                best = level;
+                best_score = score;
+            }
+        }
+        return best;
+    }
+
+    size_t
+    thread_pool::select_urgent_queue(size_t first, size_t count, size_t start) const {
+        size_t best = SIZE_MAX;
+        uint32_t best_level = UINT32_MAX;
+        for (size_t i = 0; (i < count) && (best_level != 0); ++i) {
+            const size_t queue_index = first + (start + i) % count;
+            const uint32_t level =
+                    queues_[queue_index]->top_level_.load(std::memory_order_relaxed);
+            if (level < best_level) {
+                best = queue_index;
+                best_level = level;
+            }
+        }
+        return best;
+    }
+
+    bool
+    thread_pool::try_pop(size_t index, bool remote, queued_task *task) {
+        const size_t group_index = worker_group_[index];
+        const auto &group = *groups_[group_index];
+        // With work stealing, worker 'index' owns queue 'index'.
+        const size_t own = options_.work_stealing_ ? (index - group.first_queue_) : 0;
+        if ((options_.priority_levels_ > 1) && (group.queue_count_ > 1)) {
+            // Take the most urgent task of the group rather than the front of
+            // the own queue. The levels are read without the locks, so fall
+            // back to the walk below if the task is gone.
+            const size_t queue_index =
+                    select_urgent_queue(group.first_queue_, group.queue_count_, own);
+            if ((queue_index != SIZE_MAX) && try_pop_queue(queue_index, task)) {
+                if (queue_index != group.first_queue_ + own) {
+                    worker_states_[index]->tasks_stolen_.fetch_add(1, std::memory_order_relaxed);
+                }
+                return true;
+            }
+        }
+        // Look at the own queue first, then walk the group peers starting next
+        // to it.
+        for (size_t i = 0; i < group.queue_count_; ++i) {
+            if (try_pop_queue(group.first_queue_ + (own + i) % group.queue_count_, task)) {
+                if (options_.work_stealing_ && (i != 0)) {
+                    worker_states_[index]->tasks_stolen_.fetch_add(1, std::memory_order_relaxed);
+                }
+                return true;
+            }
+        }
+        if (!remote) {
+            return false;
+        }
+        for (size_t g = 1; g < groups_.size(); ++g) {
+            const auto &other = *groups_[(group_index + g) % groups_.size()];
+            if (other.pending_.load(std::memory_order_relaxed) == 0) {
+                continue;
+            }
+            if (options_.priority_levels_ > 1) {
+                const size_t queue_index =
+                        select_urgent_queue(other.first_queue_, other.queue_count_, 0);
+                if ((queue_index != SIZE_MAX) && try_pop_queue(queue_index, task)) {
+                    worker_states_[index]->tasks_stolen_.fetch_add(1, std::memory_order_relaxed);
+                    return true;
+                }
+            }
+            for (size_t i = 0; i < other.queue_count_; ++i) {
+                if (try_pop_queue(other.first_queue_ + i, task)) {
+                    worker_states_[index]->tasks_stolen_.fetch_add(1, std::memory_order_relaxed);
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    bool
+    thread_pool::remote_pending(size_t group) const {
+        for (size_t g = 0; g < groups_.size(); ++g) {
+            if ((g != group) && (groups_[g]->pending_.load() != 0)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    size_t
+    thread_pool::select_group() {
+        if (current_pool == this) {
+            return worker_group_[current_index];
+        }
+        if (groups_.size() == 1) {
+            return 0;
+        }
+        return next_group_.fetch_add(1, std::memory_order_relaxed) % groups_.size();
+    }
+
+    size_t
+    thread_pool::select_queue(size_t group) {
+        auto &state = *groups_[group];
+        if (state.queue_count_ == 1) {
+            return state.first_queue_;
+        }
+        if ((current_pool == this) && (worker_group_[current_index] == group)) {
+            return current_index;
+        }
+        return state.first_queue_ +
+               state.next_queue_.fetch_add(1, std::memory_order_relaxed) % state.queue_count_;
+    }
+
+    void
+    thread_pool::push(size_t group, func_task *tasks, size_t count, uint32_t priority) {
+        // Don't accept more work if pool is shutting down
+        if (stop_.load() || count == 0) {
+            return;
+        }
+
+        // Count the tasks before publishing them so that 'pending_' never drops
+        // below the number of queued tasks.
+        groups_[group]->pending_.fetch_add(count);
+        const auto enqueued = timestamped_ ? clock::now() : clock::time_point();
         {
-            std::lock_guard<std::mutex> lk(queue_mtx_);
-            // Signal to each worker that it should exit loop when tasks are finished
-            stop_ = true;
+            auto &queue = *queues_[select_queue(group)];
+            const uint32_t level_index = std::min(priority, options_.priority_levels_ - 1);
+            auto &level = queue.levels_[level_index];
+            std::lock_guard<std::mutex> lk(queue.mtx_);
+            for (size_t i = 0; i < count; ++i) {
+                level.push_back(std::move(tasks[i]), enqueued);
+            }
+            if (level_index < queue.top_level_.load(std::memory_order_relaxed)) {
+                queue.top_level_.store(level_index, std::memory_order_relaxed);
+            }
+            queue.size_.store(
+                    queue.size_.load(std::memory_order_relaxed) + count,
+                    std::memory_order_relaxed);
         }
-        // Wake all threads to clean up
-        cv_.notify_all();
-        for (auto &t : workers_) {
-            t.join();
+
+        wake(group, count);
+        if (elastic_) {
+            maybe_grow();
         }
     }
 
     void
     thread_pool::enqueue(func_task &&task) {
-        {
-            std::lock_guard<std::mutex> lk(queue_mtx_);
-            // Don't accept more work if pool is shutting down
-            if (stop_) {
+        // Only wake one thread per task
+        push(select_group(), &task, 1, options_.default_priority_);
+    }
+
+    void
+    thread_pool::enqueue(func_task &&task, int node_hint) {
+        enqueue(std::move(task), node_hint, options_.default_priority_);
+    }
+
+    void
+    thread_pool::enqueue(func_task &&task, int node_hint, uint32_t priority) {
+        for (size_t g = 0; g < groups_.size(); ++g) {
+            if (groups_[g]->node_ == node_hint) {
+                push(g, &task, 1, priority);
                 return;
             }
-            task_queue_.push(std::move(task));
         }
-        // Only wake one thread per task
-        cv_.notify_one();
+        push(select_group(), &task, 1, priority);
+    }
+
+    void
+    thread_pool::enqueue_bulk(func_task *tasks, size_t count) {
+        push(select_group(), tasks, count, options_.default_priority_);
+    }
+
+    void
+    thread_pool::wake(size_t group, size_t count) {
+        // Only signal if some thread is parked. The lock orders the wake-up after
+        // a parking worker has checked 'pending_'.
+        auto &state = *groups_[group];
+        const size_t idle = state.idle_.load();
+        if (idle != 0) {
+            { std::lock_guard<std::mutex> lk(state.park_mtx_); }
+            if (count >= idle) {
+                state.park_cv_.notify_all();
+            } else {
+                for (size_t i = 0; i < count; ++i) {
+                    state.park_cv_.notify_one();
+                }
+            }
+        }
+
+        // Let an idle worker of another group know that this group is short of
+        // workers, it steals if the backlog outlives the steal delay.
+        if (count > idle) {
+            for (size_t g = 1; g < groups_.size(); ++g) {
+                auto &other = *groups_[(group + g) % groups_.size()];
+                if (other.idle_.load() != 0) {
+                    { std::lock_guard<std::mutex> lk(other.park_mtx_); }
+                    other.park_cv_.notify_one();
+                    break;
+                }
+            }
+        }
+    }
+
+    void
+    thread_pool::maybe_grow() {
+        const auto &group = *groups_[0];
+        if (group.idle_.load() != 0) {
+            return;
+        }
+        const size_t live = live_count_.load();
+        if ((live < options_.max_thread_count_) &&
+            (group.pending_.load() > live * options_.grow_backlog_)) {
+            grow();
+        }
+    }
+
+    void
+    thread_pool::grow() {
+        // Don't hold up the submitter if another thread is already resizing
+        std::unique_lock<std::mutex> lk(resize_mtx_, std::try_to_lock);
+        if (!lk.owns_lock() || stop_.load() ||
+            (live_count_.load() >= options_.max_thread_count_)) {
+            return;
+        }
+        for (size_t i = 0; i < workers_.size(); ++i) {
+            if (worker_states_[i]->live_) {
+                continue;
+            }
+            // A retired worker has left its loop, it only has to return
+            if (workers_[i].joinable()) {
+                workers_[i].join();
+            }
+            worker_states_[i]->live_ = true;
+            live_count_.fetch_add(1);
+            workers_[i] = std::thread(&thread_pool::worker_loop, this, i);
+            return;
+        }
+    }
+
+    bool
+    thread_pool::retire(size_t index) {
+        std::lock_guard<std::mutex> lk(resize_mtx_);
+        if (live_count_.load() <= options_.thread_count_) {
+            return false;
+        }
+        worker_states_[index]->live_ = false;
+        live_count_.fetch_sub(1);
+        return true;
     }
 
 }  // namespace hercules::common
@@ -1,5 +1,3 @@
-
-
 /****************************************************************
  * Copyright (c) 2022, liyinbin
  * All rights reserved.
@@ -10,40 +8,319 @@
 #ifndef HERCULES_COMMON_THREAD_POOL_H_
 #define HERCULES_COMMON_THREAD_POOL_H_
 
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <cstdint>
 #include <functional>
-#include <queue>
+#include <memory>
+#include <mutex>
 #include <thread>
+#include <vector>
+#include "hercules/common/latency_histogram.h"
+#include "hercules/common/macros.h"
+#include "hercules/common/unique_task.h"
+#include "hercules/common/wait_strategy.h"
 
 namespace hercules::common {
 
     class thread_pool {
     public:
+        // A set of workers that prefer each other's tasks, i.e. the workers
+        // pinned to one NUMA node.
+        struct worker_group {
+            worker_group(
+                    std::size_t thread_count = 1, int node = 0,
+                    std::function<void()> initializer = nullptr)
+                    : thread_count_(thread_count), node_(node),
+                      initializer_(std::move(initializer)) {
+            }
+
+            std::size_t thread_count_;
+            // The node that 'enqueue(task, node_hint)' matches against.
+            int node_;
+            // Run on each worker of the group before it takes any task, i.e. to
+            // set the thread affinity and memory policy.
+            std::function<void()> initializer_;
+        };
+
+        // Options to configure the thread pool.
+        struct options {
+            options(std::size_t thread_count = 1, bool work_stealing = false)
+                    : thread_count_(thread_count), work_stealing_(work_stealing) {
+            }
+
+            std::size_t thread_count_;
+            // If true, each worker owns a task queue. Tasks submitted by a worker
+            // go to its own queue, tasks submitted by other threads are spread
+            // over the worker queues, and idle workers steal from their peers.
+            // Otherwise all workers share a single task queue.
+            bool work_stealing_;
+            // If not empty, the pool is made of these groups instead of
+            // 'thread_count_' workers, and work stealing is implied. Workers
+            // steal within their group first, and only steal from other groups
+            // after having been idle for 'cross_group_steal_delay_'.
+            std::vector<worker_group> groups_;
+            std::chrono::microseconds cross_group_steal_delay_{100};
+            // How idle workers wait for tasks.
+            wait_options wait_;
+            // If true, workers record how long each task waited in the queue
+            // and how long it ran. This costs two clock reads per task.
+            bool instrumentation_ = false;
+            // If greater than 'thread_count_', the pool is elastic. It starts
+            // with 'thread_count_' workers and adds workers, up to
+            // 'max_thread_count_', while more than 'grow_backlog_' tasks per
+            // worker are pending or a task waited longer than
+            // 'grow_queue_delay_' to start. Workers idle for 'idle_timeout_'
+            // retire until 'thread_count_' are left. Ignored with 'groups_'.
+            std::size_t max_thread_count_ = 0;
+            std::size_t grow_backlog_ = 4;
+            std::chrono::microseconds grow_queue_delay_{1000};
+            std::chrono::milliseconds idle_timeout_{10000};
+            // Number of task priority levels. Tasks of level 0 run first, and
+            // tasks without a priority get 'default_priority_'. Every
+            // 'priority_aging_' a task waits raises it by one level so that
+            // low priority tasks aren't starved, zero disables aging. Workers
+            // take the highest priority task of any queue of their group, and
+            // of the other groups when stealing from them, while aging only
+            // orders the tasks within a queue.
+            uint32_t priority_levels_ = 1;
+            uint32_t default_priority_ = 0;
+            std::chrono::microseconds priority_aging_{1000};
+        };
+
+        // Counters of one worker.
+        struct worker_stats {
+            uint64_t tasks_run_ = 0;
+            // Tasks taken from the queue of another worker.
+            uint64_t tasks_stolen_ = 0;
+            // The following are only recorded with 'instrumentation_'.
+            // Time spent running tasks.
+            uint64_t busy_ns_ = 0;
+            // Time from enqueue to the start of the task, and from its start to
+            // its end.
+            latency_histogram::snapshot queue_wait_;
+            latency_histogram::snapshot run_time_;
+        };
+
+        // A snapshot of the pool counters.
+        struct stats {
+            bool instrumented_ = false;
+            // Workers currently running. Retired workers of an elastic pool
+            // keep their entry in 'workers_'.
+            size_t worker_count_ = 0;
+            // Tasks submitted but not picked up yet.
+            size_t queued_tasks_ = 0;
+            wait_counters wait_;
+            std::vector<worker_stats> workers_;
+            // The histograms of all workers merged.
+            latency_histogram::snapshot queue_wait_;
+            latency_histogram::snapshot run_time_;
+        };
+
         explicit thread_pool(std::size_t thread_count);
 
+        explicit thread_pool(const options &options);
+
         ~thread_pool();
 
         thread_pool(const thread_pool &) = delete;
 
         thread_pool &operator=(const thread_pool &) = delete;
 
-        using func_task = std::function<void(void)>;
+        using func_task = unique_task;
+
+        // The 'node_hint' to submit a task to any worker group.
+        static constexpr int kAnyNode = -1;
 
         // Assigns "task" to the task queue for a worker thread to execute when
         // available. This will not track the return value of the task.
         void enqueue(func_task &&task);
 
+        // Similar to the above, but prefer the workers of the group whose node
+        // is 'node_hint'. Fall back to enqueue(task) if there is no such group.
+        void enqueue(func_task &&task, int node_hint);
+
+        // Similar to the above, with the priority level of the task. Levels past
+        // the last one are clamped to it.
+        void enqueue(func_task &&task, int node_hint, uint32_t priority);
+
+        // Assigns the 'count' tasks starting at 'tasks' to the task queue under
+        // a single lock acquisition, and wakes at most 'count' idle workers. The
+        // tasks are moved from.
+        void enqueue_bulk(func_task *tasks, size_t count);
+
         // Returns the number of threads in thread pool
-        size_t size() { return workers_.size(); }
+        size_t size() const { return live_count_.load(std::memory_order_relaxed); }
+
+        // Returns how often idle workers found work while spinning, and how
+        // often they blocked.
+        wait_counters get_wait_counters() const { return wait_.counters(); }
+
+        // Returns the current counters of the pool and its workers.
+        stats get_stats() const;
 
     private:
-        std::queue<func_task> task_queue_;
-        std::mutex queue_mtx_;
-        std::condition_variable cv_;
+        using clock = std::chrono::steady_clock;
+
+        struct queued_task {
+            func_task task_;
+            // Only set with 'instrumentation_'.
+            clock::time_point enqueued_;
+        };
+
+        // FIFO ring of tasks. It grows by doubling and never shrinks, so a warmed
+        // up queue doesn't allocate.
+        class task_ring {
+        public:
+            bool empty() const { return count_ == 0; }
+
+            size_t size() const { return count_; }
+
+            void push_back(func_task &&task, clock::time_point enqueued) {
+                if (count_ == slots_.size()) {
+                    grow();
+                }
+                auto &slot = slots_[(head_ + count_) & (slots_.size() - 1)];
+                slot.task_ = std::move(task);
+                slot.enqueued_ = enqueued;
+                ++count_;
+            }
+
+            const queued_task &front() const { return slots_[head_]; }
+
+            queued_task pop_front() {
+                queued_task task = std::move(slots_[head_]);
+                head_ = (head_ + 1) & (slots_.size() - 1);
+                --count_;
+                return task;
+            }
+
+        private:
+            void grow() {
+                std::vector<queued_task> slots(slots_.empty() ? 64 : slots_.size() * 2);
+                for (size_t i = 0; i < count_; ++i) {
+                    slots[i] = std::move(slots_[(head_ + i) & (slots_.size() - 1)]);
+                }
+                slots_.swap(slots);
+                head_ = 0;
+            }
+
+            // Size is always zero or a power of two.
+            std::vector<queued_task> slots_;
+            size_t head_ = 0;
+            size_t count_ = 0;
+        };
+
+        struct alignas(HERCULES_CACHELINE_SIZE) task_queue {
+            std::mutex mtx_;
+            // One FIFO per priority level.
+            std::vector<task_ring> levels_;
+            // Number of tasks over all levels. Only written under 'mtx_', and
+            // read without it so that thieves can skip empty queues.
+            std::atomic<size_t> size_{0};
+            // The highest priority level holding tasks, UINT32_MAX if none.
+            // Only written under 'mtx_', and read without it to find the
+            // queue with the most urgent task.
+            std::atomic<uint32_t> top_level_{UINT32_MAX};
+        };
+
+        // Only written by the worker, read by get_stats().
+        struct alignas(HERCULES_CACHELINE_SIZE) worker_state {
+            std::atomic<uint64_t> tasks_run_{0};
+            std::atomic<uint64_t> tasks_stolen_{0};
+            std::atomic<uint64_t> busy_ns_{0};
+            latency_histogram queue_wait_;
+            latency_histogram run_time_;
+            // Whether a thread runs in this worker slot. Guarded by
+            // 'resize_mtx_'.
+            bool live_ = false;
+        };
+
+        struct alignas(HERCULES_CACHELINE_SIZE) group_state {
+            int node_ = 0;
+            std::function<void()> initializer_;
+            // The queues [first_queue_, first_queue_ + queue_count_) belong to
+            // the workers of this group.
+            size_t first_queue_ = 0;
+            size_t queue_count_ = 0;
+            // Number of tasks in the group's queues that have been submitted but
+            // not yet picked up.
+            std::atomic<size_t> pending_{0};
+            // Number of the group's workers parked on 'park_cv_'.
+            std::atomic<size_t> idle_{0};
+            std::atomic<size_t> next_queue_{0};
+            std::mutex park_mtx_;
+            std::condition_variable park_cv_;
+        };
+
+        void worker_loop(size_t index);
+
+        // Pop a task from the queue owned by worker 'index', or steal one from
+        // the other workers of its group, or from any worker if 'remote' is
+        // true. Return false if no task is found.
+        bool try_pop(size_t index, bool remote, queued_task *task);
+
+        bool try_pop_queue(size_t queue_index, queued_task *task);
+
+        // Run 'task' on worker 'index' and record its timings.
+        void run_instrumented(size_t index, queued_task *task);
+
+        // Return the index of the queue in 'group' that a newly submitted task
+        // goes to.
+        size_t select_queue(size_t group);
+
+        // Return the group a task submitted by the calling thread goes to.
+        size_t select_group();
+
+        void push(size_t group, func_task *tasks, size_t count, uint32_t priority);
+
+        // Return the level of 'queue' to pop from, the non-empty level whose
+        // front task has the highest priority after aging.
+        size_t select_level(const task_queue &queue) const;
+
+        // Return the queue among the 'count' queues from 'first' that holds
+        // the highest priority level, trying queue 'first + start' first so
+        // that it wins ties. Return SIZE_MAX if the queues are all empty.
+        size_t select_urgent_queue(size_t first, size_t count, size_t start) const;
+
+        // Wake up to 'count' parked workers of 'group', and a worker of another
+        // group if that's not enough.
+        void wake(size_t group, size_t count);
+
+        // Return true if groups other than 'group' have pending tasks.
+        bool remote_pending(size_t group) const;
+
+        // Start a worker in a free slot of an elastic pool, unless the pool is
+        // at its maximum size or another thread is resizing it.
+        void grow();
+
+        // Add a worker if the backlog of an elastic pool is too long.
+        void maybe_grow();
+
+        // Let worker 'index' of an elastic pool exit if the pool is above its
+        // minimum size. Return true if the worker has to exit.
+        bool retire(size_t index);
+
+        options options_;
+        wait_strategy wait_;
+        std::vector<std::unique_ptr<task_queue>> queues_;
+        std::vector<std::unique_ptr<group_state>> groups_;
+        std::vector<std::unique_ptr<worker_state>> worker_states_;
+        // The group of each worker, and of each queue.
+        std::vector<size_t> worker_group_;
+        std::vector<size_t> queue_group_;
+        std::atomic<size_t> next_group_{0};
+        // One slot per worker, up to the maximum size of an elastic pool.
         std::vector<std::thread> workers_;
+        bool elastic_ = false;
+        // Whether tasks are stamped with their enqueue time.
+        bool timestamped_ = false;
+        std::atomic<size_t> live_count_{0};
+        std::mutex resize_mtx_;
         // If true, tells pool to stop accepting work and tells awake worker threads
         // to exit when no tasks are left on the queue.
-        bool stop_ = false;
+        std::atomic<bool> stop_{false};
     };
 
 }  // namespace hercules::common
@@ -0,0 +1,143 @@
+/****************************************************************
+ * Copyright (c) 2022, liyinbin
+ * All rights reserved.
+ * Author by liyinbin (jeff.li) lijippy@163.com
+ *****************************************************************/
+
+#ifndef HERCULES_COMMON_UNIQUE_TASK_H_
+#define HERCULES_COMMON_UNIQUE_TASK_H_
+
+#include <cstddef>
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace hercules::common {
+
+    // A move-only 'void()' callable. Unlike std::function, callables up to
+    // 'kInlineSize' bytes are stored inline so that wrapping a capturing lambda
+    // doesn't touch the heap. Larger callables, or callables that may throw on
+    // move, are stored on the heap.
+    class unique_task {
+    public:
+        static constexpr std::size_t kInlineSize = 120;
+
+        unique_task() noexcept = default;
+
+        unique_task(std::nullptr_t) noexcept {}
+
+        template<typename F, typename = std::enable_if_t<
+                !std::is_same<std::decay_t<F>, unique_task>::value>>
+        unique_task(F &&f) {
+            using Fn = std::decay_t<F>;
+            if (is_null(f)) {
+                return;
+            }
+            if constexpr (fits_inline<Fn>()) {
+                new(storage_) Fn(std::forward<F>(f));
+                ops_ = &inline_ops<Fn>::value;
+            } else {
+                *reinterpret_cast<Fn **>(storage_) = new Fn(std::forward<F>(f));
+                ops_ = &heap_ops<Fn>::value;
+            }
+        }
+
+        unique_task(unique_task &&other) noexcept {
+            move_from(other);
+        }
+
+        unique_task &operator=(unique_task &&other) noexcept {
+            if (this != &other) {
+                reset();
+                move_from(other);
+            }
+            return *this;
+        }
+
+        unique_task(const unique_task &) = delete;
+
+        unique_task &operator=(const unique_task &) = delete;
+
+        ~unique_task() { reset(); }
+
+        explicit operator bool() const noexcept { return ops_ != nullptr; }
+
+        void operator()() { ops_->invoke(storage_); }
+
+        // Destroy the stored callable, leaving the task empty.
+        void reset() noexcept {
+            if (ops_ != nullptr) {
+                ops_->destroy(storage_);
+                ops_ = nullptr;
+            }
+        }
+
+    private:
+        struct ops {
+            void (*invoke)(void *storage);
+
+            // Move-construct the callable in 'dst' from 'src' and destroy 'src'.
+            void (*relocate)(void *dst, void *src) noexcept;
+
+            void (*destroy)(void *storage) noexcept;
+        };
+
+        template<typename Fn>
+        static constexpr bool fits_inline() {
+            return sizeof(Fn) <= kInlineSize &&
+                   alignof(Fn) <= alignof(std::max_align_t) &&
+                   std::is_nothrow_move_constructible<Fn>::value;
+        }
+
+        template<typename Fn>
+        struct inline_ops {
+            static void invoke(void *storage) { (*static_cast<Fn *>(storage))(); }
+
+            static void relocate(void *dst, void *src) noexcept {
+                new(dst) Fn(std::move(*static_cast<Fn *>(src)));
+                static_cast<Fn *>(src)->~Fn();
+            }
+
+            static void destroy(void *storage) noexcept { static_cast<Fn *>(storage)->~Fn(); }
+
+            static constexpr ops value{&invoke, &relocate, &destroy};
+        };
+
+        template<typename Fn>
+        struct heap_ops {
+            static void invoke(void *storage) { (**static_cast<Fn **>(storage))(); }
+
+            static void relocate(void *dst, void *src) noexcept {
+                *static_cast<Fn **>(dst) = *static_cast<Fn **>(src);
+            }
+
+            static void destroy(void *storage) noexcept { delete *static_cast<Fn **>(storage); }
+
+            static constexpr ops value{&invoke, &relocate, &destroy};
+        };
+
+        template<typename Fn>
+        static bool is_null(const Fn &) { return false; }
+
+        template<typename Sig>
+        static bool is_null(const std::function<Sig> &f) { return !f; }
+
+        template<typename R, typename... Args>
+        static bool is_null(R (*const &f)(Args...)) { return f == nullptr; }
+
+        void move_from(unique_task &other) noexcept {
+            if (other.ops_ != nullptr) {
+                other.ops_->relocate(storage_, other.storage_);
+                ops_ = other.ops_;
+                other.ops_ = nullptr;
+            }
+        }
+
+        alignas(std::max_align_t) unsigned char storage_[kInlineSize];
+        const ops *ops_ = nullptr;
+    };
+
+}  // namespace hercules::common
+
+#endif  // HERCULES_COMMON_UNIQUE_TASK_H_
@@ -0,0 +1,113 @@
+/****************************************************************
+ * Copyright (c) 2022, liyinbin
+ * All rights reserved.
+ * Author by liyinbin (jeff.li) lijippy@163.com
+ *****************************************************************/
+
+#ifndef HERCULES_COMMON_WAIT_STRATEGY_H_
+#define HERCULES_COMMON_WAIT_STRATEGY_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+namespace hercules::common {
+
+    // How a thread waits for work.
+    enum class wait_policy {
+        // Block on the condition variable right away.
+        kBlock,
+        // Spin for a while, then block.
+        kSpinThenBlock,
+        // Never block. Lowest wake-up latency, but burns a core per waiter.
+        kBusyPoll
+    };
+
+    // Options to configure how threads wait.
+    struct wait_options {
+        wait_options(wait_policy policy = wait_policy::kBlock, size_t spin_count = 4096)
+                : policy_(policy), spin_count_(spin_count) {
+        }
+
+        wait_policy policy_;
+        // Number of pause rounds before blocking, for kSpinThenBlock.
+        size_t spin_count_;
+    };
+
+    // Counts of how waits were resolved.
+    struct wait_counters {
+        // Waits that ended while spinning.
+        uint64_t spins_ = 0;
+        // Waits that blocked.
+        uint64_t parks_ = 0;
+    };
+
+    // Hint the CPU that the thread is spinning.
+    inline void
+    cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+        _mm_pause();
+#elif defined(__aarch64__)
+        asm volatile("yield" ::: "memory");
+#else
+        std::this_thread::yield();
+#endif
+    }
+
+    // The spinning part of a wait, and the counters telling how often waits
+    // were resolved by spinning rather than blocking.
+    class wait_strategy {
+    public:
+        explicit wait_strategy(const wait_options &options = wait_options())
+                : options_(options) {
+        }
+
+        const wait_options &options() const { return options_; }
+
+        // Spin as the policy allows until 'ready()' returns true. Return false if
+        // the caller has to block. kBusyPoll never gives up.
+        template<typename Pred>
+        bool spin(Pred &&ready) {
+            if (options_.policy_ == wait_policy::kBlock) {
+                return false;
+            }
+            const bool forever = options_.policy_ == wait_policy::kBusyPoll;
+            for (size_t i = 0; forever || i < options_.spin_count_; ++i) {
+                if (ready()) {
+                    spins_.fetch_add(1, std::memory_order_relaxed);
+                    return true;
+                }
+                // Let other threads on the core run once in a while
+                if ((i & 1023) == 1023) {
+                    std::this_thread::yield();
+                } else {
+                    cpu_relax();
+                }
+            }
+            return false;
+        }
+
+        // Record that a wait blocked.
+        void count_park() { parks_.fetch_add(1, std::memory_order_relaxed); }
+
+        wait_counters counters() const {
+            wait_counters counters;
+            counters.spins_ = spins_.load(std::memory_order_relaxed);
+            counters.parks_ = parks_.load(std::memory_order_relaxed);
+            return counters;
+        }
+
+    private:
+        wait_options options_;
+        std::atomic<uint64_t> spins_{0};
+        std::atomic<uint64_t> parks_{0};
+    };
+
+}  // namespace hercules::common
+
+#endif  // HERCULES_COMMON_WAIT_STRATEGY_H_
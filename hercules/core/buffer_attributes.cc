@@ -63,9 +63,8 @@ namespace hercules::core {
             int64_t memory_type_id, char *cuda_ipc_handle)
             : byte_size_(byte_size), memory_type_(memory_type),
               memory_type_id_(memory_type_id) {
-        // cuda ipc handle size
-        cuda_ipc_handle_.reserve(kCudaIpcStructSize);
-
+        // Only buffers shared through CUDA IPC hold a handle, the others
+        // don't allocate
         if (cuda_ipc_handle != nullptr) {
             std::copy(
                     cuda_ipc_handle, cuda_ipc_handle + kCudaIpcStructSize,
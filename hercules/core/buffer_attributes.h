@@ -26,7 +26,6 @@ namespace hercules::core {
         buffer_attributes() {
             memory_type_ = hercules::proto::MEMORY_CPU;
             memory_type_id_ = 0;
-            cuda_ipc_handle_.reserve(64);
         }
 
         // Set the buffer byte size
@@ -7,11 +7,100 @@
 
 
 #include "hercules/core/cuda_util.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include "hercules/common/async_work_queue.h"
 #include "hercules/common/error_code.h"
 #include "hercules/common/nvtx.h"
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif  // __SSE2__
+
 namespace hercules::core {
 
+    namespace {
+
+        std::atomic<size_t> parallel_copy_threshold{0};
+        std::atomic<size_t> parallel_copy_chunk_byte_size{4 << 20};
+
+        // memcpy() with non-temporal stores, so that the copy doesn't evict the
+        // working set from the caches.
+        void
+        StreamMemcpy(void *dst, const void *src, size_t byte_size) {
+#if defined(__SSE2__)
+            auto *d = static_cast<char *>(dst);
+            auto *s = static_cast<const char *>(src);
+            // Stores must be 16 bytes aligned, copy the head normally
+            const size_t head = std::min(
+                    byte_size, (16 - (reinterpret_cast<uintptr_t>(d) & 15)) & 15);
+            memcpy(d, s, head);
+            d += head;
+            s += head;
+            byte_size -= head;
+
+            for (; byte_size >= 64; byte_size -= 64, d += 64, s += 64) {
+                const __m128i v0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s));
+                const __m128i v1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s + 16));
+                const __m128i v2 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s + 32));
+                const __m128i v3 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s + 48));
+                _mm_stream_si128(reinterpret_cast<__m128i *>(d), v0);
+                _mm_stream_si128(reinterpret_cast<__m128i *>(d + 16), v1);
+                _mm_stream_si128(reinterpret_cast<__m128i *>(d + 32), v2);
+                _mm_stream_si128(reinterpret_cast<__m128i *>(d + 48), v3);
+            }
+            // Make the streamed data visible before the copy is reported done
+            _mm_sfence();
+            memcpy(d, s, byte_size);
+#else
+            memcpy(dst, src, byte_size);
+#endif  // __SSE2__
+        }
+
+        bool
+        UseParallelCopy(size_t byte_size) {
+            const size_t threshold = parallel_copy_threshold.load(std::memory_order_relaxed);
+            return (threshold != 0) && (byte_size >= threshold) &&
+                   (hercules::common::async_work_queue::worker_count() >= 2);
+        }
+
+        // Keep chunk boundaries cache line aligned relative to the destination
+        size_t
+        ParallelCopyChunkByteSize() {
+            return (std::max<size_t>(
+                    parallel_copy_chunk_byte_size.load(std::memory_order_relaxed), 64) +
+                    63) & ~size_t(63);
+        }
+
+        void
+        ChunkMemcpy(void *dst, const void *src, size_t byte_size, bool non_temporal) {
+            if (non_temporal) {
+                StreamMemcpy(dst, src, byte_size);
+            } else {
+                memcpy(dst, src, byte_size);
+            }
+        }
+
+        void
+        HostMemcpy(void *dst, const void *src, size_t byte_size, bool non_temporal) {
+            if (!UseParallelCopy(byte_size)) {
+                ChunkMemcpy(dst, src, byte_size, non_temporal);
+                return;
+            }
+
+            const size_t chunk_byte_size = ParallelCopyChunkByteSize();
+            auto *d = static_cast<char *>(dst);
+            auto *s = static_cast<const char *>(src);
+            hercules::common::async_work_queue::parallel_for(
+                    0, byte_size, chunk_byte_size,
+                    [d, s, non_temporal](size_t begin, size_t end) {
+                        ChunkMemcpy(d + begin, s + begin, end - begin, non_temporal);
+                    });
+        }
+
+    }  // namespace
+
 #ifdef HERCULES_ENABLE_GPU
     void CUDART_CB
 MemcpyHost(void* args)
@@ -22,6 +111,12 @@ MemcpyHost(void* args)
 }
 #endif  // HERCULES_ENABLE_GPU
 
+    void
+    set_host_copy_options(const host_copy_options &options) {
+        parallel_copy_chunk_byte_size = options.chunk_byte_size_;
+        parallel_copy_threshold = options.parallel_threshold_;
+    }
+
     flare::result_status
     GetDeviceMemoryInfo(const int device_id, size_t *free, size_t *total) {
         *free = 0;
@@ -95,13 +190,55 @@ MemcpyHost(void* args)
         return flare::result_status::success();
     }
 
+    void
+    GatherHostBuffers(
+            const std::vector<std::pair<const char *, size_t>> &srcs, char *dst,
+            bool non_temporal) {
+        NVTX_RANGE(nvtx_, "GatherHostBuffers");
+
+        // offsets[i] is where 'srcs[i]' starts in 'dst'
+        std::vector<size_t> offsets(srcs.size() + 1, 0);
+        for (size_t i = 0; i < srcs.size(); ++i) {
+            offsets[i + 1] = offsets[i] + srcs[i].second;
+        }
+        const size_t byte_size = offsets.back();
+        if (!UseParallelCopy(byte_size)) {
+            for (size_t i = 0; i < srcs.size(); ++i) {
+                if (srcs[i].second != 0) {
+                    ChunkMemcpy(dst + offsets[i], srcs[i].first, srcs[i].second, non_temporal);
+                }
+            }
+            return;
+        }
+
+        // Split the destination, not the sources, so that many small buffers
+        // are spread across the workers as well as a few large ones
+        hercules::common::async_work_queue::parallel_for(
+                0, byte_size, ParallelCopyChunkByteSize(),
+                [&srcs, &offsets, dst, non_temporal](size_t begin, size_t end) {
+                    size_t idx = std::upper_bound(
+                            offsets.begin(), offsets.end(), begin) - offsets.begin() - 1;
+                    for (; (idx < srcs.size()) && (offsets[idx] < end); ++idx) {
+                        const size_t from = std::max(begin, offsets[idx]);
+                        const size_t to = std::min(end, offsets[idx + 1]);
+                        if (to == from) {
+                            continue;
+                        }
+                        ChunkMemcpy(
+                                dst + from, srcs[idx].first + (from - offsets[idx]),
+                                to - from, non_temporal);
+                    }
+                });
+    }
+
     flare::result_status
     CopyBuffer(
             const std::string &msg, const hercules::proto::MemoryType src_memory_type,
             const int64_t src_memory_type_id,
             const hercules::proto::MemoryType dst_memory_type,
             const int64_t dst_memory_type_id, const size_t byte_size, const void *src,
-            void *dst, cudaStream_t cuda_stream, bool *cuda_used, bool copy_on_stream) {
+            void *dst, cudaStream_t cuda_stream, bool *cuda_used, bool copy_on_stream,
+            bool non_temporal) {
         NVTX_RANGE(nvtx_, "CopyBuffer");
 
         *cuda_used = false;
@@ -118,10 +255,10 @@ MemcpyHost(void* args)
           cuda_stream, MemcpyHost, reinterpret_cast<void*>(params));
       *cuda_used = true;
     } else {
-      memcpy(dst, src, byte_size);
+      HostMemcpy(dst, src, byte_size, non_temporal);
     }
 #else
-            memcpy(dst, src, byte_size);
+            HostMemcpy(dst, src, byte_size, non_temporal);
 #endif  // HERCULES_ENABLE_GPU
         } else {
 #ifdef HERCULES_ENABLE_GPU
@@ -140,22 +277,6 @@ MemcpyHost(void* args)
         return flare::result_status::success();
     }
 
-    void
-    copy_buffer_handler(
-            const std::string &msg, const hercules::proto::MemoryType src_memory_type,
-            const int64_t src_memory_type_id,
-            const hercules::proto::MemoryType dst_memory_type,
-            const int64_t dst_memory_type_id, const size_t byte_size, const void *src,
-            void *dst, cudaStream_t cuda_stream, void *response_ptr,
-            hercules::common::sync_queue <std::tuple<flare::result_status, bool, void *>> *
-            completion_queue) {
-        bool cuda_used = false;
-        flare::result_status status = CopyBuffer(
-                msg, src_memory_type, src_memory_type_id, dst_memory_type,
-                dst_memory_type_id, byte_size, src, dst, cuda_stream, &cuda_used);
-        completion_queue->Put(std::make_tuple(status, cuda_used, response_ptr));
-    }
-
 #ifdef HERCULES_ENABLE_GPU
     flare::result_status
 check_gpu_compatibility(const int gpu_id, const double min_compute_capability)
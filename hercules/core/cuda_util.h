@@ -9,7 +9,11 @@
 #define HERCULES_CORE_CUDA_UTIL_H_
 
 #include <set>
+#include <tuple>
+#include <utility>
+#include <vector>
 #include <flare/base/result_status.h>
+#include "hercules/common/ring_sync_queue.h"
 #include "hercules/common/sync_queue.h"
 #include "hercules/core/memory_type.h"
 
@@ -47,6 +51,25 @@ namespace hercules::core {
     /// \return The error status. A non-OK status means not all pairs are enabled
     flare::result_status EnablePeerAccess(const double min_compute_capability);
 
+    /// Options for the host to host copies performed by CopyBuffer.
+    struct host_copy_options {
+        host_copy_options(size_t parallel_threshold = 0, size_t chunk_byte_size = 4 << 20)
+                : parallel_threshold_(parallel_threshold),
+                  chunk_byte_size_(chunk_byte_size) {
+        }
+
+        /// Copies of at least this many bytes are split into chunks of
+        /// 'chunk_byte_size_' and run on the async work queue workers. 0
+        /// disables parallel copies.
+        size_t parallel_threshold_;
+        size_t chunk_byte_size_;
+    };
+
+    /// Set the options used by CopyBuffer for host to host copies. The default
+    /// is a single-threaded memcpy.
+    /// \param options The host copy options.
+    void set_host_copy_options(const host_copy_options &options);
+
     /// Copy buffer from 'src' to 'dst' for given 'byte_size'. The buffer location
     /// is identified by the memory type and id, and the corresponding copy will be
     /// initiated.
@@ -64,7 +87,12 @@ namespace hercules::core {
     /// the caller should synchronize on the given 'cuda_stream' to ensure data copy
     /// is completed.
     /// \param copy_on_stream whether the memory copies should be performed in cuda
-    /// host functions on the 'cuda_stream'.
+    /// host functions on the 'cuda_stream'. Otherwise large host to host copies
+    /// may be split across the async work queue, see set_host_copy_options().
+    /// \param non_temporal whether host to host copies not on the 'cuda_stream'
+    /// should be written with non-temporal stores, which bypass the caches. Only
+    /// set it if 'dst' is not read soon after, i.e. an output handed to the
+    /// network.
     /// \return The error status. A non-ok status indicates failure to copy the
     /// buffer.
     flare::result_status CopyBuffer(
@@ -73,7 +101,19 @@ namespace hercules::core {
             const hercules::proto::MemoryType dst_memory_type,
             const int64_t dst_memory_type_id, const size_t byte_size, const void *src,
             void *dst, cudaStream_t cuda_stream, bool *cuda_used,
-            bool copy_on_stream = false);
+            bool copy_on_stream = false, bool non_temporal = false);
+
+    /// Copy the host buffers 'srcs', given as address and byte size, back to
+    /// back into 'dst'. Large gathers are split into chunks of the destination
+    /// and run on the async work queue workers, like the CopyBuffer host to
+    /// host copies, see set_host_copy_options().
+    /// \param srcs The source buffers, in order.
+    /// \param dst The destination, at least the total byte size of 'srcs'.
+    /// \param non_temporal whether to write 'dst' with non-temporal stores, see
+    /// CopyBuffer.
+    void GatherHostBuffers(
+            const std::vector<std::pair<const char *, size_t>> &srcs, char *dst,
+            bool non_temporal = false);
 
 #ifdef HERCULES_ENABLE_GPU
     /// Validates the compute capability of the GPU indexed
@@ -103,16 +143,31 @@ namespace hercules::core {
     flare::result_status supports_integrated_zero_copy(const int gpu_id, bool* zero_copy_support);
 #endif
 
+    // Host outputs of at least this many bytes are copied by copy_buffer_handler
+    // with non-temporal stores. They would mostly be evicted before the frontend
+    // serializes them anyway, while smaller ones are still cached then.
+    constexpr size_t kNonTemporalOutputByteSize = 4 << 20;
+
     // Helper around CopyBuffer that updates the completion queue with the returned
-    // status and cuda_used flag.
+    // status and cuda_used flag. 'CompletionQueue' is any queue with the Put()
+    // of hercules::common::sync_queue, i.e. hercules::common::ring_sync_queue
+    // for completion-heavy paths.
+    template<typename CompletionQueue =
+    hercules::common::sync_queue<std::tuple<flare::result_status, bool, void *>>>
     void copy_buffer_handler(
             const std::string &msg, const hercules::proto::MemoryType src_memory_type,
             const int64_t src_memory_type_id,
             const hercules::proto::MemoryType dst_memory_type,
             const int64_t dst_memory_type_id, const size_t byte_size, const void *src,
             void *dst, cudaStream_t cuda_stream, void *response_ptr,
-            hercules::common::sync_queue <std::tuple<flare::result_status, bool, void *>> *
-            completion_queue);
+            CompletionQueue *completion_queue) {
+        bool cuda_used = false;
+        flare::result_status status = CopyBuffer(
+                msg, src_memory_type, src_memory_type_id, dst_memory_type,
+                dst_memory_type_id, byte_size, src, dst, cuda_stream, &cuda_used,
+                false /* copy_on_stream */, byte_size >= kNonTemporalOutputByteSize);
+        completion_queue->Put(std::make_tuple(status, cuda_used, response_ptr));
+    }
 
     struct copy_params {
         copy_params(void *dst, const void *src, const size_t byte_size)
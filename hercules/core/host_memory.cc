@@ -0,0 +1,138 @@
+/****************************************************************
+ * Copyright (c) 2022, liyinbin
+ * All rights reserved.
+ * Author by liyinbin (jeff.li) lijippy@163.com
+ *****************************************************************/
+
+#include "hercules/core/host_memory.h"
+
+#include <sys/mman.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include "hercules/common/error_code.h"
+
+namespace hercules::core {
+
+    namespace {
+
+        // Used to align transparent huge page mappings when the system
+        // reports no huge page size.
+        constexpr uint64_t kDefaultHugePageSize = 2 << 20;
+
+        uint64_t
+        RoundUp(uint64_t size, uint64_t alignment) {
+            return (size + alignment - 1) / alignment * alignment;
+        }
+
+        uint64_t
+        ReadHugePageSize() {
+            std::ifstream meminfo("/proc/meminfo");
+            std::string line;
+            while (std::getline(meminfo, line)) {
+                // i.e. "Hugepagesize:       2048 kB"
+                if (line.compare(0, 13, "Hugepagesize:") == 0) {
+                    return std::stoull(line.substr(13)) << 10;
+                }
+            }
+            return 0;
+        }
+
+        flare::result_status
+        MmapError(uint64_t size) {
+            return flare::result_status(
+                    hercules::common::ERROR_UNAVAILABLE,
+                    "failed to map " + std::to_string(size) + " bytes of host memory: " +
+                    std::strerror(errno));
+        }
+
+    }  // namespace
+
+    uint64_t
+    base_page_size() {
+        static const auto size = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+        return size;
+    }
+
+    uint64_t
+    huge_page_size() {
+        static const uint64_t size = ReadHugePageSize();
+        return size;
+    }
+
+    flare::result_status
+    map_host_memory(uint64_t size, huge_page_mode mode, host_mapping *mapping) {
+        if (size == 0) {
+            return flare::result_status(
+                    hercules::common::ERROR_INVALID_ARG, "can't map 0 bytes of host memory");
+        }
+        *mapping = host_mapping();
+        const uint64_t huge_size = (huge_page_size() != 0) ? huge_page_size() : kDefaultHugePageSize;
+
+#ifdef MAP_HUGETLB
+        if ((mode == huge_page_mode::kExplicit) && (huge_page_size() != 0)) {
+            const uint64_t length = RoundUp(size, huge_size);
+            void *addr = mmap(
+                    nullptr, length, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (addr != MAP_FAILED) {
+                mapping->addr_ = addr;
+                mapping->size_ = length;
+                mapping->page_size_ = huge_size;
+                return flare::result_status::success();
+            }
+            // The reserved pool is empty or not configured
+        }
+#endif  // MAP_HUGETLB
+
+        if (mode == huge_page_mode::kNone) {
+            const uint64_t length = RoundUp(size, base_page_size());
+            void *addr = mmap(
+                    nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (addr == MAP_FAILED) {
+                return MmapError(length);
+            }
+            mapping->addr_ = addr;
+            mapping->size_ = length;
+            mapping->page_size_ = base_page_size();
+            return flare::result_status::success();
+        }
+
+        // Transparent huge pages only back aligned ranges, so map one huge
+        // page more than needed and trim the unaligned ends.
+        const uint64_t length = RoundUp(size, huge_size);
+        void *raw = mmap(
+                nullptr, length + huge_size, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (raw == MAP_FAILED) {
+            return MmapError(length + huge_size);
+        }
+        char *begin = static_cast<char *>(raw);
+        char *aligned = reinterpret_cast<char *>(
+                RoundUp(reinterpret_cast<uintptr_t>(begin), huge_size));
+        if (aligned != begin) {
+            munmap(begin, aligned - begin);
+        }
+        const uint64_t tail = (begin + length + huge_size) - (aligned + length);
+        if (tail != 0) {
+            munmap(aligned + length, tail);
+        }
+        mapping->addr_ = aligned;
+        mapping->size_ = length;
+        mapping->page_size_ = base_page_size();
+#ifdef MADV_HUGEPAGE
+        mapping->transparent_huge_pages_ = (madvise(aligned, length, MADV_HUGEPAGE) == 0);
+#endif  // MADV_HUGEPAGE
+        return flare::result_status::success();
+    }
+
+    void
+    unmap_host_memory(const host_mapping &mapping) {
+        if (mapping.addr_ != nullptr) {
+            munmap(mapping.addr_, mapping.size_);
+        }
+    }
+
+}  // namespace hercules::core
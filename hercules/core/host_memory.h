@@ -0,0 +1,52 @@
+/****************************************************************
+ * Copyright (c) 2022, liyinbin
+ * All rights reserved.
+ * Author by liyinbin (jeff.li) lijippy@163.com
+ *****************************************************************/
+
+#ifndef HERCULES_CORE_HOST_MEMORY_H_
+#define HERCULES_CORE_HOST_MEMORY_H_
+
+#include <cstdint>
+#include <flare/base/result_status.h>
+
+namespace hercules::core {
+
+    // The pages backing large host buffers. Huge pages cut the TLB misses of
+    // walking buffers of many megabytes.
+    enum class huge_page_mode {
+        // Regular pages.
+        kNone,
+        // Advise the kernel to back the memory with transparent huge pages.
+        kTransparent,
+        // Reserved huge pages from the hugetlbfs pool, or kTransparent if
+        // none are available.
+        kExplicit
+    };
+
+    // Anonymous host memory mapped by map_host_memory().
+    struct host_mapping {
+        void *addr_ = nullptr;
+        // The mapped length, a multiple of 'page_size_'.
+        uint64_t size_ = 0;
+        // The page size of the mapping, the huge page size for reserved huge
+        // pages and the base page size otherwise.
+        uint64_t page_size_ = 0;
+        // Whether the kernel accepted the advice to use transparent huge
+        // pages. It still decides whether and when to use them.
+        bool transparent_huge_pages_ = false;
+    };
+
+    uint64_t base_page_size();
+
+    // The default huge page size of the system, or 0 if it has none.
+    uint64_t huge_page_size();
+
+    // Map at least 'size' bytes of zeroed memory with the pages of 'mode'.
+    flare::result_status map_host_memory(uint64_t size, huge_page_mode mode, host_mapping *mapping);
+
+    void unmap_host_memory(const host_mapping &mapping);
+
+}  // namespace hercules::core
+
+#endif  // HERCULES_CORE_HOST_MEMORY_H_
@@ -0,0 +1,505 @@
+/****************************************************************
+ * Copyright (c) 2022, liyinbin
+ * All rights reserved.
+ * Author by liyinbin (jeff.li) lijippy@163.com
+ *****************************************************************/
+
+#include "hercules/core/host_pool_allocator.h"
+
+#include <algorithm>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <boost/interprocess/managed_external_buffer.hpp>
+#include "hercules/common/cnmem.h"
+
+namespace hercules::core {
+
+    namespace {
+
+        class best_fit_pool_allocator : public host_pool_allocator {
+        public:
+            best_fit_pool_allocator(void *buffer, uint64_t size)
+                    : size_(size),
+                      managed_memory_(boost::interprocess::create_only_t{}, buffer, size) {
+            }
+
+            void *allocate(uint64_t size) override {
+                return managed_memory_.allocate(size, std::nothrow_t{});
+            }
+
+            void deallocate(void *ptr) override { managed_memory_.deallocate(ptr); }
+
+            host_pool_stats get_stats() const override {
+                host_pool_stats stats;
+                stats.capacity_bytes_ = size_;
+                stats.free_bytes_ = managed_memory_.get_free_memory();
+                stats.used_bytes_ = size_ - stats.free_bytes_;
+                // The tree doesn't expose its largest block, and probing it
+                // with allocations would stall the allocating threads.
+                stats.has_largest_free_block_ = false;
+                return stats;
+            }
+
+        private:
+            uint64_t size_;
+            boost::interprocess::managed_external_buffer managed_memory_;
+        };
+
+        // The pool buffer, handed whole to the arena as its only region.
+        class buffer_backing : public cnmem::Backing {
+        public:
+            buffer_backing(void *buffer, uint64_t size) : buffer_(buffer), size_(size) {
+            }
+
+            cnmemStatus_t allocate(void *&ptr, std::size_t size) override {
+                if (taken_ || (size > size_)) {
+                    ptr = nullptr;
+                    return CNMEM_STATUS_OUT_OF_MEMORY;
+                }
+                taken_ = true;
+                ptr = buffer_;
+                return CNMEM_STATUS_SUCCESS;
+            }
+
+            cnmemStatus_t release(void * /*ptr*/) override {
+                taken_ = false;
+                return CNMEM_STATUS_SUCCESS;
+            }
+
+        private:
+            void *buffer_;
+            uint64_t size_;
+            bool taken_ = false;
+        };
+
+        class arena_pool_allocator : public host_pool_allocator {
+        public:
+            arena_pool_allocator(void *buffer, uint64_t size)
+                    : base_(static_cast<const char *>(buffer)), size_(size), backing_(buffer, size) {
+                manager_.setBacking(&backing_);
+                manager_.setFlags(CNMEM_FLAGS_CANNOT_GROW | CNMEM_FLAGS_CANNOT_STEAL);
+                const uint64_t usable = size / CNMEM_GRANULARITY * CNMEM_GRANULARITY;
+                if ((usable == 0) || (manager_.reserve(usable) != CNMEM_STATUS_SUCCESS)) {
+                    throw std::runtime_error(
+                            "unable to set up an arena of " + std::to_string(size) + " bytes");
+                }
+            }
+
+            void *allocate(uint64_t size) override {
+                const uint64_t rounded =
+                        std::max<uint64_t>(
+                                (size + CNMEM_GRANULARITY - 1) / CNMEM_GRANULARITY, 1) *
+                        CNMEM_GRANULARITY;
+                void *ptr = nullptr;
+                if (manager_.allocate(ptr, rounded) != CNMEM_STATUS_SUCCESS) {
+                    return nullptr;
+                }
+                return ptr;
+            }
+
+            void deallocate(void *ptr) override { manager_.release(ptr); }
+
+            host_pool_stats get_stats() const override {
+                std::size_t used = 0;
+                std::size_t free = 0;
+                std::size_t largest = 0;
+                std::size_t metadata = 0;
+                std::size_t blocks = 0;
+                manager_.getUsedMemoryUnsafe(used);
+                manager_.getFreeMemoryUnsafe(free);
+                manager_.getLargestFreeBlockUnsafe(largest);
+                manager_.getMetadataUnsafe(metadata, blocks);
+                host_pool_stats stats;
+                stats.capacity_bytes_ = size_;
+                stats.used_bytes_ = used;
+                stats.free_bytes_ = free;
+                stats.largest_free_block_ = largest;
+                stats.metadata_bytes_ = metadata;
+                return stats;
+            }
+
+            bool get_blocks(std::vector<host_pool_block> *blocks) const override {
+                cnmem::MemoryState state;
+                if (manager_.getStateUnsafe(state) != CNMEM_STATUS_SUCCESS) {
+                    return false;
+                }
+                blocks->reserve(blocks->size() + state.blocks.size());
+                for (const auto &b : state.blocks) {
+                    host_pool_block block;
+                    block.offset_ = b.data - base_;
+                    block.size_ = b.size;
+                    block.used_ = b.isUsed;
+                    blocks->push_back(block);
+                }
+                return true;
+            }
+
+        private:
+            const char *base_;
+            uint64_t size_;
+            // Outlives 'manager_', which releases the buffer to it.
+            buffer_backing backing_;
+            cnmem::Manager manager_;
+        };
+
+        // The bucket of the free size histogram of 'size' bytes.
+        size_t
+        HistogramBucket(uint64_t size) {
+            return 63 - __builtin_clzll(std::max<uint64_t>(size, 1));
+        }
+
+    }  // namespace
+
+    std::string
+    host_pool_snapshot::to_json() const {
+        std::string json;
+        json.append("{\"capacity_bytes\":" + std::to_string(stats_.capacity_bytes_));
+        json.append(",\"used_bytes\":" + std::to_string(stats_.used_bytes_));
+        json.append(",\"free_bytes\":" + std::to_string(stats_.free_bytes_));
+        if (stats_.has_largest_free_block_) {
+            json.append(
+                    ",\"largest_free_block\":" + std::to_string(stats_.largest_free_block_));
+            json.append(",\"fragmentation\":" + std::to_string(stats_.fragmentation()));
+        } else {
+            json.append(",\"largest_free_block\":null,\"fragmentation\":null");
+        }
+        json.append(",\"huge_page_bytes\":" + std::to_string(stats_.huge_page_bytes_));
+        json.append(
+                ",\"transparent_huge_page_bytes\":" +
+                std::to_string(stats_.transparent_huge_page_bytes_));
+        json.append(",\"metadata_bytes\":" + std::to_string(stats_.metadata_bytes_));
+        if (has_blocks_) {
+            json.append(",\"free_histogram\":[");
+            bool first = true;
+            for (size_t i = 0; i < free_histogram_.size(); ++i) {
+                if (free_histogram_[i] == 0) {
+                    continue;
+                }
+                json.append(first ? "{" : ",{");
+                json.append("\"min_size\":" + std::to_string(uint64_t(1) << i));
+                json.append(",\"count\":" + std::to_string(free_histogram_[i]) + "}");
+                first = false;
+            }
+            json.append("],\"blocks\":[");
+            for (size_t i = 0; i < blocks_.size(); ++i) {
+                const auto &block = blocks_[i];
+                json.append((i == 0) ? "{" : ",{");
+                json.append("\"offset\":" + std::to_string(block.offset_));
+                json.append(",\"size\":" + std::to_string(block.size_));
+                json.append(",\"count\":" + std::to_string(block.count_));
+                json.append(block.used_ ? ",\"used\":true}" : ",\"used\":false}");
+            }
+            json.append("]");
+        }
+        json.append("}");
+        return json;
+    }
+
+    host_pool_snapshot
+    host_pool_allocator::get_snapshot() const {
+        host_pool_snapshot snapshot;
+        snapshot.stats_ = get_stats();
+        snapshot.has_blocks_ = get_blocks(&snapshot.blocks_);
+        for (const auto &block : snapshot.blocks_) {
+            if (!block.used_) {
+                snapshot.free_histogram_[HistogramBucket(block.size_)] += block.count_;
+            }
+        }
+        return snapshot;
+    }
+
+    std::unique_ptr<host_pool_allocator>
+    create_host_pool_allocator(host_pool_backend backend, void *buffer, uint64_t size) {
+        switch (backend) {
+            case host_pool_backend::kSlab:
+                return std::make_unique<slab_pool_allocator>(buffer, size);
+            case host_pool_backend::kArena:
+                return std::make_unique<arena_pool_allocator>(buffer, size);
+            case host_pool_backend::kBestFit:
+            default:
+                return std::make_unique<best_fit_pool_allocator>(buffer, size);
+        }
+    }
+
+    slab_pool_allocator::slab_pool_allocator(void *buffer, uint64_t size)
+            : base_(static_cast<char *>(buffer)), page_count_(size / kPageSize) {
+        // Four size classes per power of two from 64 bytes, all multiples of 16
+        for (uint64_t base = 64; base <= kMaxSlabBlockSize; base *= 2) {
+            for (uint64_t step = 0; step < 4; ++step) {
+                const uint64_t class_size = base + step * (base / 4);
+                if (class_size <= kMaxSlabBlockSize) {
+                    class_sizes_.push_back(class_size);
+                }
+            }
+        }
+        partial_.resize(class_sizes_.size());
+        pages_.resize(page_count_);
+        if (page_count_ != 0) {
+            free_by_addr_.emplace(0, page_count_);
+            free_by_size_.emplace(page_count_, 0);
+        }
+    }
+
+    slab_pool_allocator::~slab_pool_allocator() {
+        // Full slabs are only referenced from their pages
+        for (uint64_t i = 0; i < page_count_;) {
+            slab *s = pages_[i].slab_;
+            if (s == nullptr) {
+                ++i;
+                continue;
+            }
+            i = s->first_page_ + s->page_count_;
+            delete s;
+        }
+    }
+
+    void *
+    slab_pool_allocator::allocate(uint64_t size) {
+        size = std::max<uint64_t>(size, 1);
+        if (size > kMaxSlabBlockSize) {
+            const uint64_t count = (size + kPageSize - 1) / kPageSize;
+            const uint64_t first = alloc_pages(count);
+            if (first == UINT64_MAX) {
+                return nullptr;
+            }
+            pages_[first].large_pages_ = count;
+            used_bytes_ += count * kPageSize;
+            return base_ + first * kPageSize;
+        }
+
+        const auto size_class = static_cast<uint32_t>(
+                std::lower_bound(class_sizes_.begin(), class_sizes_.end(), size) -
+                class_sizes_.begin());
+        auto &partial = partial_[size_class];
+        if (partial.empty() && (new_slab(size_class) == nullptr)) {
+            return nullptr;
+        }
+        slab *s = partial.back();
+        const uint64_t class_size = class_sizes_[size_class];
+        void *ptr;
+        if (s->free_list_ != nullptr) {
+            ptr = s->free_list_;
+            s->free_list_ = *static_cast<void **>(ptr);
+        } else {
+            ptr = base_ + s->first_page_ * kPageSize + s->next_unused_ * class_size;
+            ++s->next_unused_;
+        }
+        if (++s->used_ == s->capacity_) {
+            remove_partial(s);
+        }
+        used_bytes_ += class_size;
+        return ptr;
+    }
+
+    void
+    slab_pool_allocator::deallocate(void *ptr) {
+        const uint64_t first = (static_cast<char *>(ptr) - base_) / kPageSize;
+        auto &p = pages_[first];
+        if (p.slab_ == nullptr) {
+            const uint64_t count = p.large_pages_;
+            p.large_pages_ = 0;
+            used_bytes_ -= count * kPageSize;
+            free_pages(first, count);
+            return;
+        }
+
+        slab *s = p.slab_;
+        *static_cast<void **>(ptr) = s->free_list_;
+        s->free_list_ = ptr;
+        used_bytes_ -= class_sizes_[s->size_class_];
+        if (s->used_-- == s->capacity_) {
+            add_partial(s);
+        }
+        // Keep one empty slab per class to absorb alloc/free cycles
+        if ((s->used_ == 0) && (partial_[s->size_class_].size() > 1)) {
+            remove_partial(s);
+            delete_slab(s);
+        }
+    }
+
+    host_pool_stats
+    slab_pool_allocator::get_stats() const {
+        host_pool_stats stats;
+        stats.capacity_bytes_ = page_count_ * kPageSize;
+        stats.used_bytes_ = used_bytes_;
+        stats.free_bytes_ = stats.capacity_bytes_ - used_bytes_;
+        if (!free_by_size_.empty()) {
+            stats.largest_free_block_ = free_by_size_.rbegin()->first * kPageSize;
+        }
+        for (size_t i = class_sizes_.size(); i-- > 0;) {
+            if (!partial_[i].empty()) {
+                stats.largest_free_block_ = std::max(stats.largest_free_block_, class_sizes_[i]);
+                break;
+            }
+        }
+        return stats;
+    }
+
+    bool
+    slab_pool_allocator::get_blocks(std::vector<host_pool_block> *blocks) const {
+        auto free_run = free_by_addr_.begin();
+        std::vector<bool> is_free;
+        for (uint64_t i = 0; i < page_count_;) {
+            if ((free_run != free_by_addr_.end()) && (free_run->first == i)) {
+                host_pool_block block;
+                block.offset_ = i * kPageSize;
+                block.size_ = free_run->second * kPageSize;
+                blocks->push_back(block);
+                i += free_run->second;
+                ++free_run;
+                continue;
+            }
+            const slab *s = pages_[i].slab_;
+            if (s == nullptr) {
+                host_pool_block block;
+                block.offset_ = i * kPageSize;
+                block.size_ = pages_[i].large_pages_ * kPageSize;
+                block.used_ = true;
+                blocks->push_back(block);
+                i += std::max<uint64_t>(pages_[i].large_pages_, 1);
+                continue;
+            }
+
+            // The blocks on the free list and those never handed out are free,
+            // runs of blocks in the same state are reported as one.
+            const uint64_t class_size = class_sizes_[s->size_class_];
+            const uint64_t slab_offset = s->first_page_ * kPageSize;
+            is_free.assign(s->capacity_, false);
+            for (uint32_t j = s->next_unused_; j < s->capacity_; ++j) {
+                is_free[j] = true;
+            }
+            for (void *ptr = s->free_list_; ptr != nullptr; ptr = *static_cast<void **>(ptr)) {
+                is_free[(static_cast<char *>(ptr) - base_ - slab_offset) / class_size] = true;
+            }
+            for (uint32_t j = 0; j < s->capacity_;) {
+                host_pool_block block;
+                block.offset_ = slab_offset + j * class_size;
+                block.size_ = class_size;
+                block.count_ = 0;
+                block.used_ = !is_free[j];
+                for (; (j < s->capacity_) && (is_free[j] != block.used_); ++j) {
+                    ++block.count_;
+                }
+                blocks->push_back(block);
+            }
+            // The tail of the slab that fits no block, free as in get_stats()
+            const uint64_t tail = s->page_count_ * kPageSize - s->capacity_ * class_size;
+            if (tail != 0) {
+                host_pool_block block;
+                block.offset_ = slab_offset + s->capacity_ * class_size;
+                block.size_ = tail;
+                blocks->push_back(block);
+            }
+            i = s->first_page_ + s->page_count_;
+        }
+        return true;
+    }
+
+    uint64_t
+    slab_pool_allocator::alloc_pages(uint64_t count) {
+        // Best fit, the lowest address among the runs of the same length
+        auto it = free_by_size_.lower_bound(std::make_pair(count, uint64_t(0)));
+        if (it == free_by_size_.end()) {
+            return UINT64_MAX;
+        }
+        const uint64_t length = it->first;
+        const uint64_t first = it->second;
+        free_by_size_.erase(it);
+        free_by_addr_.erase(first);
+        if (length > count) {
+            free_by_addr_.emplace(first + count, length - count);
+            free_by_size_.emplace(length - count, first + count);
+        }
+        return first;
+    }
+
+    uint64_t
+    slab_pool_allocator::alloc_top_pages(uint64_t count) {
+        // Slabs are a few pages, so the highest run almost always fits
+        for (auto it = free_by_addr_.rbegin(); it != free_by_addr_.rend(); ++it) {
+            if (it->second < count) {
+                continue;
+            }
+            const uint64_t first = it->first;
+            const uint64_t length = it->second;
+            free_by_size_.erase(std::make_pair(length, first));
+            free_by_addr_.erase(first);
+            if (length > count) {
+                free_by_addr_.emplace(first, length - count);
+                free_by_size_.emplace(length - count, first);
+            }
+            return first + length - count;
+        }
+        return UINT64_MAX;
+    }
+
+    void
+    slab_pool_allocator::free_pages(uint64_t first, uint64_t count) {
+        auto next = free_by_addr_.find(first + count);
+        if (next != free_by_addr_.end()) {
+            count += next->second;
+            free_by_size_.erase(std::make_pair(next->second, next->first));
+            free_by_addr_.erase(next);
+        }
+        auto prev = free_by_addr_.lower_bound(first);
+        if (prev != free_by_addr_.begin()) {
+            --prev;
+            if (prev->first + prev->second == first) {
+                first = prev->first;
+                count += prev->second;
+                free_by_size_.erase(std::make_pair(prev->second, prev->first));
+                free_by_addr_.erase(prev);
+            }
+        }
+        free_by_addr_.emplace(first, count);
+        free_by_size_.emplace(count, first);
+    }
+
+    slab_pool_allocator::slab *
+    slab_pool_allocator::new_slab(uint32_t size_class) {
+        // At least eight blocks per slab
+        const uint64_t class_size = class_sizes_[size_class];
+        const uint64_t count = (std::max(kPageSize, class_size * 8) + kPageSize - 1) / kPageSize;
+        const uint64_t first = alloc_top_pages(count);
+        if (first == UINT64_MAX) {
+            return nullptr;
+        }
+        auto *s = new slab();
+        s->first_page_ = first;
+        s->page_count_ = count;
+        s->size_class_ = size_class;
+        s->capacity_ = static_cast<uint32_t>(count * kPageSize / class_size);
+        for (uint64_t i = 0; i < count; ++i) {
+            pages_[first + i].slab_ = s;
+        }
+        add_partial(s);
+        return s;
+    }
+
+    void
+    slab_pool_allocator::delete_slab(slab *s) {
+        for (uint64_t i = 0; i < s->page_count_; ++i) {
+            pages_[s->first_page_ + i].slab_ = nullptr;
+        }
+        free_pages(s->first_page_, s->page_count_);
+        delete s;
+    }
+
+    void
+    slab_pool_allocator::add_partial(slab *s) {
+        auto &partial = partial_[s->size_class_];
+        s->partial_index_ = partial.size();
+        partial.push_back(s);
+    }
+
+    void
+    slab_pool_allocator::remove_partial(slab *s) {
+        auto &partial = partial_[s->size_class_];
+        partial[s->partial_index_] = partial.back();
+        partial[s->partial_index_]->partial_index_ = s->partial_index_;
+        partial.pop_back();
+        s->partial_index_ = SIZE_MAX;
+    }
+
+}  // namespace hercules::core
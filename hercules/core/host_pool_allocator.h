@@ -0,0 +1,204 @@
+/****************************************************************
+ * Copyright (c) 2022, liyinbin
+ * All rights reserved.
+ * Author by liyinbin (jeff.li) lijippy@163.com
+ *****************************************************************/
+
+#ifndef HERCULES_CORE_HOST_POOL_ALLOCATOR_H_
+#define HERCULES_CORE_HOST_POOL_ALLOCATOR_H_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace hercules::core {
+
+    // The allocators that can manage a host memory pool.
+    enum class host_pool_backend {
+        // Best-fit over a red-black tree of free blocks, from boost.interprocess.
+        kBestFit,
+        // Size-class slabs for small and medium blocks, and an address-ordered
+        // coalescing page allocator for large blocks.
+        kSlab,
+        // Best-fit over the size-ordered free blocks of a cnmem arena, which
+        // merges blocks with their free neighbours on release. Blocks are
+        // multiples of CNMEM_GRANULARITY bytes.
+        kArena
+    };
+
+    // Occupancy of a host memory pool.
+    struct host_pool_stats {
+        uint64_t capacity_bytes_ = 0;
+        // Bytes handed out, including the rounding up of requests.
+        uint64_t used_bytes_ = 0;
+        uint64_t free_bytes_ = 0;
+        // The largest block that can currently be allocated, if
+        // 'has_largest_free_block_'. kBestFit doesn't expose it.
+        uint64_t largest_free_block_ = 0;
+        bool has_largest_free_block_ = true;
+        // Capacity backed by reserved huge pages, and capacity the kernel
+        // was advised to back with transparent huge pages.
+        uint64_t huge_page_bytes_ = 0;
+        uint64_t transparent_huge_page_bytes_ = 0;
+        // Host memory held to track the blocks, outside of the pool. Only
+        // reported by kArena, the other backends count 0.
+        uint64_t metadata_bytes_ = 0;
+
+        // The share of the free memory that is unusable for a request as
+        // large as all of it, 0 when the free memory is one block or the
+        // largest free block is unknown.
+        double fragmentation() const {
+            return ((free_bytes_ == 0) || !has_largest_free_block_)
+                   ? 0.0
+                   : 1.0 - static_cast<double>(largest_free_block_) /
+                           static_cast<double>(free_bytes_);
+        }
+    };
+
+    // A run of 'count_' adjacent blocks of 'size_' bytes of a host memory pool,
+    // all used or all free. Runs of more than one block only come from slabs.
+    struct host_pool_block {
+        // From the start of the pool.
+        uint64_t offset_ = 0;
+        uint64_t size_ = 0;
+        uint64_t count_ = 1;
+        bool used_ = false;
+    };
+
+    // The state of a host memory pool at one point in time, i.e. to alert on
+    // fragmentation before allocations start to fail.
+    struct host_pool_snapshot {
+        static constexpr size_t kHistogramBucketCount = 64;
+
+        host_pool_stats stats_;
+        // Whether 'blocks_' and 'free_histogram_' are filled, kBestFit
+        // doesn't expose its blocks.
+        bool has_blocks_ = false;
+        // The used and free blocks, by offset.
+        std::vector<host_pool_block> blocks_;
+        // The number of free blocks of [2^i, 2^(i+1)) bytes, in bucket i.
+        std::array<uint64_t, kHistogramBucketCount> free_histogram_{};
+
+        // Serialize as a JSON object, i.e.
+        //   {"capacity_bytes":1048576,...,"fragmentation":0.25,
+        //    "free_histogram":[{"min_size":512,"count":2}],
+        //    "blocks":[{"offset":0,"size":512,"count":1,"used":true},...]}
+        // with "free_histogram" and "blocks" only if 'has_blocks_'.
+        std::string to_json() const;
+    };
+
+    // Allocator of the blocks of a host memory pool, a buffer it doesn't own.
+    // Not thread safe, callers serialize the calls.
+    class host_pool_allocator {
+    public:
+        virtual ~host_pool_allocator() = default;
+
+        // Return a block of at least 'size' bytes, or nullptr if there is none.
+        virtual void *allocate(uint64_t size) = 0;
+
+        // Release 'ptr', which must have been returned by allocate().
+        virtual void deallocate(void *ptr) = 0;
+
+        virtual host_pool_stats get_stats() const = 0;
+
+        // Append the blocks of the pool to 'blocks', by offset. Return false
+        // if the allocator can't enumerate its blocks.
+        virtual bool get_blocks(std::vector<host_pool_block> * /*blocks*/) const { return false; }
+
+        // Take a snapshot of the pool, with its blocks if get_blocks()
+        // supports it.
+        host_pool_snapshot get_snapshot() const;
+    };
+
+    // Create the 'backend' allocator of the 'size' bytes at 'buffer'. Throws
+    // std::exception if the pool can't be set up.
+    std::unique_ptr<host_pool_allocator> create_host_pool_allocator(
+            host_pool_backend backend, void *buffer, uint64_t size);
+
+    //
+    // Slab allocator of a host memory pool. The pool is divided into pages.
+    // Requests of up to kMaxSlabBlockSize bytes are rounded up to a size class
+    // and carved from slabs, runs of pages holding blocks of one class only, so
+    // small blocks don't break up the pool. Slabs are packed at the top of the
+    // pool. Larger requests take runs of whole pages, chosen best-fit and
+    // coalesced with their free neighbours on release. A slab goes back to the
+    // pages once all its blocks are free, except for one per size class.
+    //
+    class slab_pool_allocator : public host_pool_allocator {
+    public:
+        static constexpr uint64_t kPageSize = 64 << 10;
+        static constexpr uint64_t kMaxSlabBlockSize = 256 << 10;
+
+        slab_pool_allocator(void *buffer, uint64_t size);
+
+        ~slab_pool_allocator() override;
+
+        void *allocate(uint64_t size) override;
+
+        void deallocate(void *ptr) override;
+
+        host_pool_stats get_stats() const override;
+
+        bool get_blocks(std::vector<host_pool_block> *blocks) const override;
+
+    private:
+        struct slab {
+            uint64_t first_page_ = 0;
+            uint64_t page_count_ = 0;
+            uint32_t size_class_ = 0;
+            uint32_t capacity_ = 0;
+            uint32_t used_ = 0;
+            // Blocks past this index have never been handed out.
+            uint32_t next_unused_ = 0;
+            // Released blocks, linked through their first bytes.
+            void *free_list_ = nullptr;
+            // Position in 'partial_[size_class_]', if the slab has free blocks.
+            size_t partial_index_ = SIZE_MAX;
+        };
+
+        // The slab a page belongs to, or the length of the large block
+        // starting at the page.
+        struct page {
+            slab *slab_ = nullptr;
+            uint64_t large_pages_ = 0;
+        };
+
+        // Take a run of 'count' pages, return its first page or UINT64_MAX.
+        uint64_t alloc_pages(uint64_t count);
+
+        // Similar to the above, but take the pages at the highest address that
+        // fits. Slabs are packed at the top of the pool this way, away from
+        // the large blocks at the bottom.
+        uint64_t alloc_top_pages(uint64_t count);
+
+        void free_pages(uint64_t first, uint64_t count);
+
+        slab *new_slab(uint32_t size_class);
+
+        void delete_slab(slab *s);
+
+        void add_partial(slab *s);
+
+        void remove_partial(slab *s);
+
+        char *base_;
+        uint64_t page_count_;
+        uint64_t used_bytes_ = 0;
+        std::vector<uint64_t> class_sizes_;
+        // The slabs of each size class that have free blocks.
+        std::vector<std::vector<slab *>> partial_;
+        std::vector<page> pages_;
+        // Free page runs by first page, and by length then first page.
+        std::map<uint64_t, uint64_t> free_by_addr_;
+        std::set<std::pair<uint64_t, uint64_t>> free_by_size_;
+    };
+
+}  // namespace hercules::core
+
+#endif  // HERCULES_CORE_HOST_POOL_ALLOCATOR_H_
@@ -3,12 +3,122 @@
 //
 
 #include "hercules/core/memory_base.h"
+#include <utility>
+#include <vector>
+#include "hercules/common/error_code.h"
 #include "hercules/core/pinned_memory_manager.h"
 #include "hercules/core/cuda_memory_manager.h"
+#include "hercules/core/cuda_util.h"
 #include <flare/log/logging.h>
 
 namespace hercules::core {
 
+    memory_base::~memory_base() = default;
+
+    flare::result_status
+    memory_base::contiguous(
+            const char **buffer, hercules::proto::MemoryType *memory_type,
+            int64_t *memory_type_id) {
+        if (total_byte_size_ == 0) {
+            *buffer = nullptr;
+            *memory_type = hercules::proto::MEMORY_CPU;
+            *memory_type_id = 0;
+            return flare::result_status::success();
+        }
+
+        // Empty buffers don't count, a single buffer with data is returned
+        size_t data_idx = 0;
+        size_t data_count = 0;
+        for (size_t idx = 0; (idx < buffer_count_) && (data_count < 2); ++idx) {
+            size_t byte_size;
+            hercules::proto::MemoryType src_memory_type;
+            int64_t src_memory_type_id;
+            buffer_at(idx, &byte_size, &src_memory_type, &src_memory_type_id);
+            if (byte_size != 0) {
+                data_idx = idx;
+                ++data_count;
+            }
+        }
+        if (data_count == 1) {
+            size_t byte_size;
+            *buffer = buffer_at(data_idx, &byte_size, memory_type, memory_type_id);
+            return flare::result_status::success();
+        }
+
+        // Concurrent callers wait for the first one to gather
+        std::lock_guard<std::mutex> lk(contiguous_mtx_);
+        if (contiguous_ == nullptr) {
+            auto gathered = std::make_unique<allocated_memory>(
+                    total_byte_size_, *memory_type, *memory_type_id);
+            hercules::proto::MemoryType dst_memory_type;
+            int64_t dst_memory_type_id;
+            char *dst = gathered->mutable_buffer(&dst_memory_type, &dst_memory_type_id);
+            if (dst == nullptr) {
+                return flare::result_status(
+                        hercules::common::ERROR_UNAVAILABLE,
+                        "failed to allocate " + std::to_string(total_byte_size_) +
+                        " bytes to gather " + std::to_string(buffer_count_) + " buffers");
+            }
+
+            std::vector<std::pair<const char *, size_t>> host_srcs;
+            host_srcs.reserve(buffer_count_);
+            bool cuda_used = false;
+            size_t offset = 0;
+            for (size_t idx = 0; idx < buffer_count_; ++idx) {
+                size_t src_byte_size;
+                hercules::proto::MemoryType src_memory_type;
+                int64_t src_memory_type_id;
+                const char *src = buffer_at(
+                        idx, &src_byte_size, &src_memory_type, &src_memory_type_id);
+                if (src_byte_size == 0) {
+                    continue;
+                }
+                if ((src_memory_type != hercules::proto::MEMORY_GPU) &&
+                    (dst_memory_type != hercules::proto::MEMORY_GPU)) {
+                    // Host buffers are gathered together below
+                    host_srcs.emplace_back(src, src_byte_size);
+                } else {
+                    // Flush the host buffers before, they are gathered in order
+                    if (!host_srcs.empty()) {
+                        GatherHostBuffers(host_srcs, dst + offset);
+                        for (const auto &host_src : host_srcs) {
+                            offset += host_src.second;
+                        }
+                        host_srcs.clear();
+                    }
+                    bool buffer_cuda_used = false;
+                    auto status = CopyBuffer(
+                            "gather buffer " + std::to_string(idx), src_memory_type,
+                            src_memory_type_id, dst_memory_type, dst_memory_type_id,
+                            src_byte_size, src, dst + offset, 0 /* cuda_stream */,
+                            &buffer_cuda_used);
+                    if (!status.is_ok()) {
+                        return status;
+                    }
+                    cuda_used |= buffer_cuda_used;
+                    offset += src_byte_size;
+                }
+            }
+            if (!host_srcs.empty()) {
+                GatherHostBuffers(host_srcs, dst + offset);
+            }
+#ifdef HERCULES_ENABLE_GPU
+            if (cuda_used) {
+                cudaError_t err = cudaStreamSynchronize(0);
+                if (err != cudaSuccess) {
+                    return flare::result_status(
+                            hercules::common::ERROR_INTERNAL,
+                            std::string("failed to gather buffers: ") + cudaGetErrorString(err));
+                }
+            }
+#endif  // HERCULES_ENABLE_GPU
+            contiguous_ = std::move(gathered);
+        }
+
+        *buffer = contiguous_->mutable_buffer(memory_type, memory_type_id);
+        return flare::result_status::success();
+    }
+
     memory_reference::memory_reference() : memory_base() {}
 
     const char *
@@ -42,6 +152,7 @@ namespace hercules::core {
     memory_reference::add_buffer(
             const char *buffer, size_t byte_size, hercules::proto::MemoryType memory_type,
             int64_t memory_type_id) {
+        contiguous_.reset();
         total_byte_size_ += byte_size;
         buffer_count_++;
         buffer_.emplace_back(buffer, byte_size, memory_type, memory_type_id);
@@ -51,6 +162,7 @@ namespace hercules::core {
     size_t
     memory_reference::add_buffer(
             const char *buffer, buffer_attributes *buffer_attributes) {
+        contiguous_.reset();
         total_byte_size_ += buffer_attributes->byte_size();
         buffer_count_++;
         buffer_.emplace_back(buffer, buffer_attributes);
@@ -61,10 +173,10 @@ namespace hercules::core {
     memory_reference::add_buffer_front(
             const char *buffer, size_t byte_size, hercules::proto::MemoryType memory_type,
             int64_t memory_type_id) {
+        contiguous_.reset();
         total_byte_size_ += byte_size;
         buffer_count_++;
-        buffer_.emplace(
-                buffer_.begin(), buffer, byte_size, memory_type, memory_type_id);
+        buffer_.emplace_front(buffer, byte_size, memory_type, memory_type_id);
         return buffer_.size() - 1;
     }
 
@@ -177,7 +289,9 @@ namespace hercules::core {
                 }
 
                 default: {
-                    auto status = pinned_memory_manager::Free(buffer_);
+                    // Usually on the thread completing the request, which
+                    // shouldn't wait on the pool locks
+                    auto status = pinned_memory_manager::defer_free(buffer_);
                     if (!status.is_ok()) {
                         FLARE_LOG(ERROR) << status;
                         buffer_ = nullptr;
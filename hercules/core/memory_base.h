@@ -7,13 +7,21 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <memory>
+#include <mutex>
+#include <flare/base/result_status.h>
+#include "hercules/common/small_vector.h"
 #include "hercules/core/buffer_attributes.h"
 #include "flare/base/profile.h"
 
 namespace hercules::core {
 
+    class allocated_memory;
+
     class memory_base {
     public:
+        virtual ~memory_base();
+
         // Get the 'idx'-th data block in the buffer. Using index to avoid
         // maintaining internal state such that one buffer can be shared
         // across multiple providers.
@@ -37,10 +45,31 @@ namespace hercules::core {
         // Return the total byte size of the data buffer
         size_t total_byte_size() const { return total_byte_size_; }
 
+        // Get the whole memory as one contiguous buffer of total_byte_size()
+        // bytes, i.e. for the backends that take a single input buffer.
+        // 'buffer' returns the start of the bytes, nullptr if the memory is
+        // empty.
+        // 'memory_type' and 'memory_type_id' are the memory type and id to
+        // gather into, and return the actual memory type and id of 'buffer',
+        // CPU memory if the memory is empty.
+        // The only non-empty buffer is returned as is, whatever its memory
+        // type, without copy. Several buffers are gathered into a buffer allocated from the
+        // memory pools, which the memory keeps and returns on later calls
+        // until a buffer is added, so the buffers are copied once. The
+        // gathered buffer may be of another memory type than requested, see
+        // allocated_memory. Safe to call concurrently, i.e. by the providers
+        // sharing the memory, but not with adding a buffer.
+        flare::result_status contiguous(
+                const char** buffer, hercules::proto::MemoryType* memory_type,
+                int64_t* memory_type_id);
+
     protected:
         memory_base() : total_byte_size_(0), buffer_count_(0) {}
         size_t total_byte_size_;
         size_t buffer_count_;
+        // The buffers gathered by contiguous(), reset when they change
+        std::mutex contiguous_mtx_;
+        std::unique_ptr<allocated_memory> contiguous_;
     };
 
     class memory_reference : public memory_base {
@@ -87,7 +116,11 @@ namespace hercules::core {
             const char* buffer_;
             buffer_attributes buffer_attributes_;
         };
-        std::vector<Block> buffer_;
+
+        // Most tensors are one or two buffers, kept inline so that a
+        // reference doesn't allocate.
+        static constexpr size_t kInlineBufferCount = 2;
+        hercules::common::small_vector<Block, kInlineBufferCount> buffer_;
     };
 
     class mutable_memory : public memory_base {
@@ -8,6 +8,12 @@
 #include <flare/base/profile.h>
 #include <flare/log/logging.h>
 
+#ifndef FLARE_PLATFORM_OSX
+#include <numa.h>
+#include <numaif.h>
+#include <sched.h>
+#endif
+
 namespace hercules::core {
 
 
@@ -38,6 +44,51 @@ namespace hercules::core {
 
     }  // namespace
 
+    flare::result_status
+    numa_thread_pool_options(
+            const hercules::common::two_level_map_config &host_policy_map,
+            size_t thread_count_per_node,
+            hercules::common::thread_pool::options *options) {
+        if (thread_count_per_node < 1) {
+            return flare::result_status(
+                    hercules::common::ERROR_INVALID_ARG,
+                    "NUMA thread pool must have positive 'thread_count_per_node'");
+        }
+        // Only one group should be created for one node, pick one of the host
+        // policies naming the node.
+        std::map<int, std::string> numa_map;
+        for (const auto &host_policy : host_policy_map) {
+            const auto numa_it = host_policy.second.find("numa-node");
+            if (numa_it != host_policy.second.end()) {
+                int node_id;
+                RETURN_IF_ERROR(
+                        ParseIntOption("Parsing 'numa-node' value", numa_it->second, &node_id));
+                numa_map.emplace(node_id, host_policy.first);
+            }
+        }
+        if (numa_map.empty()) {
+            return flare::result_status(
+                    hercules::common::ERROR_INVALID_ARG,
+                    "no host policy specifies 'numa-node'");
+        }
+
+        options->groups_.clear();
+        for (const auto &node_policy : numa_map) {
+            const auto &host_policy = host_policy_map.at(node_policy.second);
+            options->groups_.emplace_back(
+                    thread_count_per_node, node_policy.first, [host_policy]() {
+                        auto status = set_numa_config_on_thread(host_policy);
+                        if (!status.is_ok()) {
+                            FLARE_LOG(WARNING) << "Unable to apply host policy to worker thread: "
+                                               << status;
+                        }
+                    });
+        }
+        options->work_stealing_ = true;
+        options->thread_count_ = thread_count_per_node * numa_map.size();
+        return flare::result_status::success();
+    }
+
 // NUMA setting will be ignored on Windows platform
 #ifdef FLARE_PLATFORM_OSX
 
@@ -62,6 +113,18 @@ namespace hercules::core {
         return flare::result_status::success();
     }
 
+    flare::result_status
+    get_current_numa_node(int *node) {
+        *node = 0;
+        return flare::result_status::success();
+    }
+
+    flare::result_status
+    get_numa_node_distance(int from, int to, int *distance) {
+        *distance = (from == to) ? 10 : 20;
+        return flare::result_status::success();
+    }
+
     flare::result_status
     set_numa_thread_affinity(
             std::thread::native_handle_type thread,
@@ -131,6 +194,44 @@ namespace hercules::core {
         return flare::result_status::success();
     }
 
+    flare::result_status
+    get_current_numa_node(int *node) {
+        // The node of each CPU, read once. Empty without NUMA support.
+        static const std::vector<int> cpu_nodes = []() {
+            std::vector<int> nodes;
+            if (numa_available() >= 0) {
+                const int cpu_count = numa_num_configured_cpus();
+                for (int cpu = 0; cpu < cpu_count; ++cpu) {
+                    nodes.push_back(numa_node_of_cpu(cpu));
+                }
+            }
+            return nodes;
+        }();
+        const int cpu = sched_getcpu();
+        if ((cpu < 0) || (static_cast<size_t>(cpu) >= cpu_nodes.size()) ||
+            (cpu_nodes[cpu] < 0)) {
+            return flare::result_status(
+                    hercules::common::ERROR_UNAVAILABLE, "Unable to get NUMA node of the current CPU");
+        }
+        *node = cpu_nodes[cpu];
+        return flare::result_status::success();
+    }
+
+    flare::result_status
+    get_numa_node_distance(int from, int to, int *distance) {
+        if (numa_available() < 0) {
+            return flare::result_status(hercules::common::ERROR_UNAVAILABLE, "NUMA is not available");
+        }
+        *distance = numa_distance(from, to);
+        if (*distance == 0) {
+            return flare::result_status(
+                    hercules::common::ERROR_INVALID_ARG,
+                    "Unable to get the distance between NUMA nodes " + std::to_string(from) +
+                    " and " + std::to_string(to));
+        }
+        return flare::result_status::success();
+    }
+
     flare::result_status
     set_numa_thread_affinity(
             std::thread::native_handle_type thread,
@@ -10,6 +10,7 @@
 #include <vector>
 #include "flare/base/result_status.h"
 #include "hercules/common/model_config.h"
+#include "hercules/common/thread_pool.h"
 
 namespace hercules::core {
 
@@ -27,11 +28,28 @@ namespace hercules::core {
     // Reset the memory allocation setting.
     flare::result_status reset_numa_memory_policy();
 
+    // Get the NUMA node of the CPU the calling thread runs on. The thread may
+    // migrate right after, unless its affinity is set.
+    flare::result_status get_current_numa_node(int* node);
+
+    // Get the relative distance between two NUMA nodes, 10 for a node to
+    // itself and more for farther nodes.
+    flare::result_status get_numa_node_distance(int from, int to, int* distance);
+
     // Set a thread affinity to be on specific cpus.
     flare::result_status set_numa_thread_affinity(
             std::thread::native_handle_type thread,
             const hercules::common::map_config& host_policy);
 
+    // Fill 'options' with one worker group per NUMA node named by the
+    // 'numa-node' settings in 'host_policy_map'. Each group has
+    // 'thread_count_per_node' workers that apply the host policy of their node
+    // on start, so tasks enqueued with that node as hint run on local cores.
+    flare::result_status numa_thread_pool_options(
+            const hercules::common::two_level_map_config& host_policy_map,
+            size_t thread_count_per_node,
+            hercules::common::thread_pool::options* options);
+
 
 }  // namespace hercules::core
 #endif  // HERCULES_CORE_NUMA_UTIL_H_
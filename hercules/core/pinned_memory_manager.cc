@@ -4,7 +4,12 @@
 
 #include "hercules/core/pinned_memory_manager.h"
 
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <iterator>
 #include <sstream>
+#include <thread>
 #include "hercules/core/numa_util.h"
 #include "hercules/common/error_code.h"
 #include <flare/log/logging.h>
@@ -37,38 +42,789 @@ namespace hercules::core {
             return flare::result_status::success();
         }
 
+        // Guards the links between pools and thread caches, which are cut by
+        // whichever of the two goes away first. Never destroyed, as threads may
+        // exit after static destruction.
+        std::mutex &
+        CacheRegistryMutex() {
+            static auto *mtx = new std::mutex();
+            return *mtx;
+        }
+
+        std::atomic<uint64_t> next_pool_serial{0};
+
+        // Starts at 1, threads that never deferred a free hold serial 0.
+        std::atomic<uint64_t> next_manager_serial{1};
+
+        std::atomic<size_t> next_telemetry_stripe{0};
+
+        // The telemetry stripe of the calling thread, out of 'stripe_count',
+        // a power of two.
+        size_t
+        TelemetryStripe(size_t stripe_count) {
+            static thread_local const size_t stripe = next_telemetry_stripe.fetch_add(1);
+            return stripe & (stripe_count - 1);
+        }
+
+        size_t
+        SizeBucket(uint64_t size) {
+            return (size < 2) ? 0 : (63 - __builtin_clzll(size));
+        }
+
+        // How the memory of a pool is set up.
+        struct pinned_buffer_config {
+            huge_page_mode huge_pages_ = huge_page_mode::kNone;
+            // Threads touching the memory before it is pinned, none if zero.
+            size_t prefault_thread_count_ = 0;
+            // The host policy of the pool's NUMA node, if any.
+            const hercules::common::map_config *host_policy_ = nullptr;
+        };
+
+#ifdef HERCULES_ENABLE_GPU
+        // Write to every page of 'mapping' from up to 'thread_count' threads.
+        // Each applies 'host_policy' first, so the pages are placed on the
+        // pool's NUMA node by first touch. Return the time it took.
+        std::chrono::nanoseconds
+        PrefaultMapping(
+                const host_mapping &mapping, size_t thread_count,
+                const hercules::common::map_config *host_policy) {
+            const auto start = std::chrono::steady_clock::now();
+            // A thread per 16MB at most, small pools aren't worth many threads
+            constexpr uint64_t kMinBytesPerThread = 16 << 20;
+            const uint64_t page_size = mapping.page_size_;
+            const uint64_t page_count = mapping.size_ / page_size;
+            thread_count = static_cast<size_t>(std::clamp<uint64_t>(
+                    mapping.size_ / kMinBytesPerThread, 1, thread_count));
+            const uint64_t pages_per_thread = (page_count + thread_count - 1) / thread_count;
+            const auto touch = [&](uint64_t first, uint64_t last) {
+                if (host_policy != nullptr) {
+                    auto status = set_numa_config_on_thread(*host_policy);
+                    if (!status.is_ok()) {
+                        FLARE_LOG(WARNING) << "Unable to apply host policy to pre-faulting thread: "
+                                           << status;
+                    }
+                }
+                volatile char *base = static_cast<char *>(mapping.addr_);
+                for (uint64_t page = first; page < last; ++page) {
+                    base[page * page_size] = 0;
+                }
+            };
+            // The calling thread keeps its own NUMA settings, so it only waits
+            std::vector<std::thread> threads;
+            for (uint64_t first = 0; first < page_count; first += pages_per_thread) {
+                threads.emplace_back(touch, first, std::min(first + pages_per_thread, page_count));
+            }
+            for (auto &thread : threads) {
+                thread.join();
+            }
+            return std::chrono::steady_clock::now() - start;
+        }
+#endif  // HERCULES_ENABLE_GPU
+
+        // Allocate 'size' bytes of page-locked memory into 'buffer'. With huge
+        // pages or pre-faulting the memory is mapped, touched if requested,
+        // and then registered with CUDA, as cudaHostAlloc() only uses regular
+        // pages and faults them in from one thread. 'mapping' describes the
+        // memory then. The pre-faulting time goes to 'prefault_time'.
+        flare::result_status
+        AllocPinnedBuffer(
+                uint64_t size, const pinned_buffer_config &config, void **buffer,
+                host_mapping *mapping, std::chrono::nanoseconds *prefault_time) {
+            *buffer = nullptr;
+            *mapping = host_mapping();
+            *prefault_time = std::chrono::nanoseconds(0);
+#ifdef HERCULES_ENABLE_GPU
+            if (((config.huge_pages_ != huge_page_mode::kNone) ||
+                 (config.prefault_thread_count_ != 0)) &&
+                map_host_memory(size, config.huge_pages_, mapping).is_ok()) {
+                if (config.prefault_thread_count_ != 0) {
+                    *prefault_time = PrefaultMapping(
+                            *mapping, config.prefault_thread_count_, config.host_policy_);
+                }
+                if (cudaHostRegister(mapping->addr_, mapping->size_, cudaHostRegisterPortable) ==
+                    cudaSuccess) {
+                    *buffer = mapping->addr_;
+                    return flare::result_status::success();
+                }
+                unmap_host_memory(*mapping);
+                *mapping = host_mapping();
+                *prefault_time = std::chrono::nanoseconds(0);
+            }
+            auto err = cudaHostAlloc(buffer, size, cudaHostAllocPortable);
+            if (err != cudaSuccess) {
+                *buffer = nullptr;
+                return flare::result_status(
+                        hercules::common::ERROR_UNAVAILABLE,
+                        "unable to allocate pinned system memory: " +
+                        std::string(cudaGetErrorString(err)));
+            }
+            return flare::result_status::success();
+#else
+            return flare::result_status(
+                    hercules::common::ERROR_UNSUPPORTED,
+                    "pinned system memory requires GPU support");
+#endif  // HERCULES_ENABLE_GPU
+        }
+
+        void
+        FreePinnedBuffer(void *buffer, const host_mapping &mapping) {
+#ifdef HERCULES_ENABLE_GPU
+            if (mapping.addr_ != nullptr) {
+                cudaHostUnregister(mapping.addr_);
+                unmap_host_memory(mapping);
+            } else if (buffer != nullptr) {
+                cudaFreeHost(buffer);
+            }
+#endif  // HERCULES_ENABLE_GPU
+        }
+
+        // Allocate the initial buffer of a pool, or return nullptr if the
+        // pool is disabled or there is no pinned memory.
+        void *
+        CreatePoolBuffer(
+                uint64_t size, const pinned_buffer_config &config, host_mapping *mapping,
+                std::chrono::nanoseconds *prefault_time) {
+            *mapping = host_mapping();
+            *prefault_time = std::chrono::nanoseconds(0);
+#ifdef HERCULES_ENABLE_GPU
+            if (size == 0) {
+                FLARE_LOG(INFO) << "Pinned memory pool disabled";
+                return nullptr;
+            }
+            void *buffer;
+            auto status = AllocPinnedBuffer(size, config, &buffer, mapping, prefault_time);
+            if (!status.is_ok()) {
+                FLARE_LOG(WARNING) << status << ", pinned memory pool will not be available";
+                return nullptr;
+            }
+            FLARE_LOG(INFO) << "Pinned memory pool is created at '" << PointerToString(buffer)
+                            << "' with size " << size << ", "
+                            << ((mapping->page_size_ > base_page_size())
+                                ? "on reserved huge pages"
+                                : (mapping->transparent_huge_pages_
+                                   ? "on transparent huge pages" : "on regular pages"));
+            if (mapping->addr_ != nullptr && prefault_time->count() != 0) {
+                FLARE_LOG(INFO) << "Pre-faulted " << mapping->size_ << " bytes of pinned memory in "
+                                << std::chrono::duration_cast<std::chrono::milliseconds>(
+                                        *prefault_time).count() << " ms";
+            }
+            return buffer;
+#else
+            return nullptr;
+#endif  // HERCULES_ENABLE_GPU
+        }
+
+        // Release non-pinned memory, mapped if 'mapped_bytes' is not zero.
+        void
+        FreeUnpinned(void *ptr, uint64_t mapped_bytes) {
+            if (mapped_bytes != 0) {
+                host_mapping mapping;
+                mapping.addr_ = ptr;
+                mapping.size_ = mapped_bytes;
+                unmap_host_memory(mapping);
+            } else {
+                free(ptr);
+            }
+        }
+
     }  // namespace
 
     std::unique_ptr<pinned_memory_manager> pinned_memory_manager::instance_;
     uint64_t pinned_memory_manager::pinned_memory_byte_size_;
 
     pinned_memory_manager::pinned_memory::pinned_memory(
-            void *pinned_memory_buffer, uint64_t size)
-            : pinned_memory_buffer_(pinned_memory_buffer) {
-        if (pinned_memory_buffer_ != nullptr) {
-            managed_pinned_memory_ = boost::interprocess::managed_external_buffer(
-                    boost::interprocess::create_only_t{}, pinned_memory_buffer_, size);
-
+            void *pinned_memory_buffer, uint64_t size, const host_mapping &mapping,
+            host_pool_backend backend)
+            : serial_(next_pool_serial.fetch_add(1)), backend_(backend) {
+        if ((pinned_memory_buffer != nullptr) && (size != 0)) {
+            add_chunk(pinned_memory_buffer, size, mapping, false);
+        } else {
+            FreePinnedBuffer(pinned_memory_buffer, mapping);
         }
     }
 
 
     pinned_memory_manager::pinned_memory::~pinned_memory() {
-#ifdef HERCULES_ENABLE_GPU
-        if (pinned_memory_buffer_ != nullptr) {
-            cudaFreeHost(pinned_memory_buffer_);
+        // The cached blocks go away with the buffer
+        std::lock_guard<std::mutex> lk(CacheRegistryMutex());
+        for (auto &cache : caches_) {
+            std::lock_guard<std::mutex> cache_lk(cache->mtx_);
+            cache->pool_ = nullptr;
+            cache->bins_.clear();
+            cache->cached_bytes_ = 0;
+        }
+        caches_.clear();
+    }
+
+    pinned_memory_manager::pinned_memory::chunk::~chunk() {
+        allocator_.reset();
+        FreePinnedBuffer(buffer_, mapping_);
+    }
+
+    void
+    pinned_memory_manager::pinned_memory::add_chunk(
+            void *buffer, uint64_t size, const host_mapping &mapping, bool decays) {
+        auto c = std::make_unique<chunk>();
+        c->buffer_ = static_cast<char *>(buffer);
+        c->size_ = size;
+        c->mapping_ = mapping;
+        c->decays_ = decays;
+        c->idle_since_ = clock::now();
+        try {
+            c->allocator_ = create_host_pool_allocator(backend_, buffer, size);
+        }
+        catch (...) {
+            // The caller still owns the buffer
+            c->buffer_ = nullptr;
+            c->mapping_ = host_mapping();
+            throw;
+        }
+        chunk_by_addr_.emplace(c->buffer_, c.get());
+        chunks_.push_back(std::move(c));
+        byte_size_.fetch_add(size, std::memory_order_relaxed);
+    }
+
+    pinned_memory_manager::pinned_memory::chunk *
+    pinned_memory_manager::pinned_memory::chunk_of(void *ptr) {
+        if (chunks_.size() == 1) {
+            return chunks_.front().get();
+        }
+        auto it = chunk_by_addr_.upper_bound(static_cast<char *>(ptr));
+        return (it == chunk_by_addr_.begin()) ? nullptr : std::prev(it)->second;
+    }
+
+    void *
+    pinned_memory_manager::pinned_memory::allocate(uint64_t size) {
+        // First fit over the chunks, so the initial chunk is preferred and
+        // the later ones drain and decay.
+        for (auto &c : chunks_) {
+            void *ptr = c->allocator_->allocate(size);
+            if (ptr != nullptr) {
+                ++c->live_blocks_;
+                return ptr;
+            }
+        }
+        return nullptr;
+    }
+
+    void
+    pinned_memory_manager::pinned_memory::deallocate(void *ptr) {
+        chunk *c = chunk_of(ptr);
+        c->allocator_->deallocate(ptr);
+        if (--c->live_blocks_ == 0) {
+            c->idle_since_ = clock::now();
+        }
+    }
+
+    void
+    pinned_memory_manager::pinned_memory::release_idle_chunks(
+            clock::time_point idle_before, std::vector<std::unique_ptr<chunk>> *released) {
+        for (auto it = chunks_.begin(); it != chunks_.end();) {
+            chunk *c = it->get();
+            if (!c->decays_ || (c->live_blocks_ != 0) || (c->idle_since_ > idle_before)) {
+                ++it;
+                continue;
+            }
+            chunk_by_addr_.erase(c->buffer_);
+            byte_size_.fetch_sub(c->size_, std::memory_order_relaxed);
+            released->push_back(std::move(*it));
+            it = chunks_.erase(it);
+        }
+    }
+
+    host_pool_stats
+    pinned_memory_manager::pinned_memory::get_stats() const {
+        host_pool_stats stats;
+        for (const auto &c : chunks_) {
+            const auto chunk_stats = c->allocator_->get_stats();
+            stats.capacity_bytes_ += chunk_stats.capacity_bytes_;
+            stats.used_bytes_ += chunk_stats.used_bytes_;
+            stats.free_bytes_ += chunk_stats.free_bytes_;
+            stats.largest_free_block_ =
+                    std::max(stats.largest_free_block_, chunk_stats.largest_free_block_);
+            stats.has_largest_free_block_ &= chunk_stats.has_largest_free_block_;
+            stats.metadata_bytes_ += chunk_stats.metadata_bytes_;
+            count_huge_pages(*c, &stats);
+        }
+        return stats;
+    }
+
+    std::vector<host_pool_snapshot>
+    pinned_memory_manager::pinned_memory::get_snapshots() const {
+        std::vector<host_pool_snapshot> snapshots;
+        snapshots.reserve(chunks_.size());
+        for (const auto &c : chunks_) {
+            snapshots.push_back(c->allocator_->get_snapshot());
+            count_huge_pages(*c, &snapshots.back().stats_);
+        }
+        return snapshots;
+    }
+
+    void
+    pinned_memory_manager::pinned_memory::count_huge_pages(const chunk &c, host_pool_stats *stats) {
+        if (c.mapping_.page_size_ > base_page_size()) {
+            stats->huge_page_bytes_ += c.size_;
+        } else if (c.mapping_.transparent_huge_pages_) {
+            stats->transparent_huge_page_bytes_ += c.size_;
         }
-#endif  // HERCULES_ENABLE_GPU
     }
 
     pinned_memory_manager::~pinned_memory_manager() {
+        if (scavenger_.joinable()) {
+            {
+                std::lock_guard<std::mutex> lk(scavenger_mtx_);
+                stop_scavenger_ = true;
+            }
+            scavenger_cv_.notify_all();
+            scavenger_.join();
+        }
+        reclaim_deferred();
+
         // Clean up
-        for (const auto &memory_info : memory_info_) {
-            const auto &is_pinned = memory_info.second.first;
-            if (!is_pinned) {
-                free(memory_info.first);
+        memory_info_.for_each([](void *ptr, const allocation_info &info) {
+            if (!info.is_pinned_) {
+                FreeUnpinned(ptr, info.mapped_bytes_);
+            }
+        });
+    }
+
+    pinned_memory_manager::thread_cache_list::~thread_cache_list() {
+        std::lock_guard<std::mutex> lk(CacheRegistryMutex());
+        for (auto &entry : caches_) {
+            auto &cache = entry.second;
+            std::lock_guard<std::mutex> cache_lk(cache->mtx_);
+            pinned_memory *pool = cache->pool_;
+            if (pool == nullptr) {
+                continue;
+            }
+            {
+                std::lock_guard<std::mutex> pool_lk(pool->buffer_mtx_);
+                for (auto &bin : cache->bins_) {
+                    for (void *block : bin.blocks_) {
+                        pool->deallocate(block);
+                    }
+                }
+            }
+            pool->caches_.erase(
+                    std::remove(pool->caches_.begin(), pool->caches_.end(), cache),
+                    pool->caches_.end());
+        }
+    }
+
+    pinned_memory_manager::deferred_list_holder::~deferred_list_holder() {
+        if (list_ != nullptr) {
+            // The manager may be gone, leave the pointers to its reclaimer
+            std::lock_guard<std::mutex> lk(list_->mtx_);
+            list_->exited_ = true;
+        }
+    }
+
+    pinned_memory_manager::deferred_list *
+    pinned_memory_manager::local_deferred_list() {
+        static thread_local deferred_list_holder local;
+        if (local.manager_serial_ != serial_) {
+            if (local.list_ != nullptr) {
+                std::lock_guard<std::mutex> lk(local.list_->mtx_);
+                local.list_->exited_ = true;
+            }
+            auto list = std::make_shared<deferred_list>();
+            list->ptrs_.reserve(deferred_free_batch_size_);
+            {
+                std::lock_guard<std::mutex> lk(deferred_mtx_);
+                deferred_lists_.push_back(list);
+            }
+            local.list_ = std::move(list);
+            local.manager_serial_ = serial_;
+        }
+        return local.list_.get();
+    }
+
+    void
+    pinned_memory_manager::free_batch(std::vector<void *> *ptrs) {
+        std::vector<std::pair<pinned_memory *, void *>> pinned;
+        pinned.reserve(ptrs->size());
+        for (void *ptr : *ptrs) {
+            allocation_info info;
+            if (!memory_info_.erase(ptr, &info)) {
+                FLARE_LOG(ERROR) << "unexpected memory address '" << PointerToString(ptr)
+                                 << "' is not being managed";
+                continue;
+            }
+            record_free(info.size_);
+            if (info.is_pinned_) {
+                pinned.emplace_back(info.pool_, ptr);
+            } else {
+                FreeUnpinned(ptr, info.mapped_bytes_);
+            }
+        }
+#ifdef HERCULES_PINNED_MEMORY_DEBUG
+        FLARE_LOG(INFO) << "deferred deallocation of " << ptrs->size() << " block(s), "
+                        << pinned.size() << " pinned";
+#endif  // HERCULES_PINNED_MEMORY_DEBUG
+        ptrs->clear();
+
+        // Blocks go straight back to their pool rather than to a thread
+        // cache, as the freeing thread is rarely the one that allocates.
+        std::sort(
+                pinned.begin(), pinned.end(),
+                [](const std::pair<pinned_memory *, void *> &lhs,
+                   const std::pair<pinned_memory *, void *> &rhs) {
+                    return std::less<pinned_memory *>()(lhs.first, rhs.first);
+                });
+        for (size_t i = 0; i < pinned.size();) {
+            pinned_memory *pool = pinned[i].first;
+            std::lock_guard<std::mutex> lk(pool->buffer_mtx_);
+            for (; (i < pinned.size()) && (pinned[i].first == pool); ++i) {
+                pool->deallocate(pinned[i].second);
+            }
+        }
+    }
+
+    void
+    pinned_memory_manager::reclaim_deferred() {
+        std::vector<void *> batch;
+        {
+            std::lock_guard<std::mutex> lk(deferred_mtx_);
+            for (auto it = deferred_lists_.begin(); it != deferred_lists_.end();) {
+                auto &list = **it;
+                bool exited;
+                {
+                    std::lock_guard<std::mutex> list_lk(list.mtx_);
+                    batch.insert(batch.end(), list.ptrs_.begin(), list.ptrs_.end());
+                    list.ptrs_.clear();
+                    exited = list.exited_;
+                }
+                it = exited ? deferred_lists_.erase(it) : std::next(it);
+            }
+        }
+        if (!batch.empty()) {
+            free_batch(&batch);
+        }
+    }
+
+    uint32_t
+    pinned_memory_manager::size_class_of(uint64_t size) const {
+        if (size_classes_.empty() || (size > size_classes_.back())) {
+            return kNoSizeClass;
+        }
+        return static_cast<uint32_t>(
+                std::lower_bound(size_classes_.begin(), size_classes_.end(), size) -
+                size_classes_.begin());
+    }
+
+    size_t
+    pinned_memory_manager::bin_capacity(uint32_t size_class) const {
+        // A bin may take a quarter of the cache
+        const uint64_t blocks = thread_cache_byte_size_ / (4 * size_classes_[size_class]);
+        return static_cast<size_t>(std::clamp<uint64_t>(blocks, 1, 64));
+    }
+
+    pinned_memory_manager::thread_cache *
+    pinned_memory_manager::local_cache(pinned_memory *pool) {
+        static thread_local thread_cache_list local;
+        for (auto &entry : local.caches_) {
+            if (entry.first == pool->serial_) {
+                return entry.second.get();
+            }
+        }
+
+        auto cache = std::make_shared<thread_cache>();
+        cache->pool_ = pool;
+        cache->bins_.resize(size_classes_.size());
+        std::lock_guard<std::mutex> lk(CacheRegistryMutex());
+        // Drop the caches of pools destroyed since
+        local.caches_.erase(
+                std::remove_if(
+                        local.caches_.begin(), local.caches_.end(),
+                        [](const std::pair<uint64_t, std::shared_ptr<thread_cache>> &entry) {
+                            std::lock_guard<std::mutex> cache_lk(entry.second->mtx_);
+                            return entry.second->pool_ == nullptr;
+                        }),
+                local.caches_.end());
+        pool->caches_.push_back(cache);
+        local.caches_.emplace_back(pool->serial_, cache);
+        return cache.get();
+    }
+
+    void *
+    pinned_memory_manager::cache_alloc(pinned_memory *pool, uint32_t size_class) {
+        thread_cache *cache = local_cache(pool);
+        const uint64_t block_size = size_classes_[size_class];
+        std::lock_guard<std::mutex> lk(cache->mtx_);
+        auto &bin = cache->bins_[size_class];
+        if (bin.blocks_.empty()) {
+            // Refill half the bin at once, so the pool is locked once per batch
+            const size_t batch = std::max<size_t>(bin_capacity(size_class) / 2, 1);
+            std::lock_guard<std::mutex> pool_lk(pool->buffer_mtx_);
+            for (size_t i = 0; i < batch; ++i) {
+                if ((i != 0) && (cache->cached_bytes_ + block_size > thread_cache_byte_size_)) {
+                    break;
+                }
+                void *block = pool->allocate(block_size);
+                if (block == nullptr) {
+                    break;
+                }
+                bin.blocks_.push_back(block);
+                cache->cached_bytes_ += block_size;
+            }
+            if (bin.blocks_.empty()) {
+                return nullptr;
+            }
+        }
+
+        // The most recently freed block is the most likely to be in the CPU cache
+        void *ptr = bin.blocks_.back();
+        bin.blocks_.pop_back();
+        cache->cached_bytes_ -= block_size;
+        bin.low_water_ = std::min(bin.low_water_, bin.blocks_.size());
+        return ptr;
+    }
+
+    void
+    pinned_memory_manager::cache_free(pinned_memory *pool, uint32_t size_class, void *ptr) {
+        thread_cache *cache = local_cache(pool);
+        const uint64_t block_size = size_classes_[size_class];
+        const size_t capacity = bin_capacity(size_class);
+        std::lock_guard<std::mutex> lk(cache->mtx_);
+        auto &bin = cache->bins_[size_class];
+        const auto fits = [&]() {
+            return (bin.blocks_.size() < capacity) &&
+                   (cache->cached_bytes_ + block_size <= thread_cache_byte_size_);
+        };
+        if (!fits()) {
+            // Flush the coldest half of the bin in one go
+            release_blocks(cache, size_class, std::max<size_t>(capacity / 2, 1));
+        }
+        if (fits()) {
+            bin.blocks_.push_back(ptr);
+            cache->cached_bytes_ += block_size;
+        } else {
+            std::lock_guard<std::mutex> pool_lk(pool->buffer_mtx_);
+            pool->deallocate(ptr);
+        }
+    }
+
+    void
+    pinned_memory_manager::release_blocks(
+            thread_cache *cache, uint32_t size_class, size_t count) const {
+        auto &bin = cache->bins_[size_class];
+        count = std::min(count, bin.blocks_.size());
+        if (count == 0) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> pool_lk(cache->pool_->buffer_mtx_);
+            for (size_t i = 0; i < count; ++i) {
+                cache->pool_->deallocate(bin.blocks_[i]);
+            }
+        }
+        bin.blocks_.erase(bin.blocks_.begin(), bin.blocks_.begin() + count);
+        cache->cached_bytes_ -= count * size_classes_[size_class];
+        bin.low_water_ = std::min(bin.low_water_, bin.blocks_.size());
+    }
+
+    void
+    pinned_memory_manager::drain_caches(pinned_memory *pool) {
+        std::lock_guard<std::mutex> lk(CacheRegistryMutex());
+        for (auto &cache : pool->caches_) {
+            std::lock_guard<std::mutex> cache_lk(cache->mtx_);
+            for (uint32_t size_class = 0; size_class < cache->bins_.size(); ++size_class) {
+                release_blocks(cache.get(), size_class, cache->bins_[size_class].blocks_.size());
+            }
+        }
+    }
+
+    void
+    pinned_memory_manager::scavenge() {
+        {
+            std::lock_guard<std::mutex> lk(CacheRegistryMutex());
+            for (auto &buffer : pinned_memory_buffers_) {
+                for (auto &cache : buffer.second->caches_) {
+                    std::lock_guard<std::mutex> cache_lk(cache->mtx_);
+                    for (uint32_t size_class = 0; size_class < cache->bins_.size(); ++size_class) {
+                        // Half of the blocks that were not needed in the last
+                        // interval go back, so a steady workload keeps its cache.
+                        auto &bin = cache->bins_[size_class];
+                        release_blocks(cache.get(), size_class, (bin.low_water_ + 1) / 2);
+                        bin.low_water_ = bin.blocks_.size();
+                    }
+                }
             }
         }
+
+        if (pool_max_byte_size_ == 0) {
+            return;
+        }
+        const auto idle_before = pinned_memory::clock::now() - pool_chunk_decay_;
+        for (auto &buffer : pinned_memory_buffers_) {
+            auto &pool = *buffer.second;
+            std::vector<std::unique_ptr<pinned_memory::chunk>> released;
+            {
+                std::lock_guard<std::mutex> lk(pool.buffer_mtx_);
+                pool.release_idle_chunks(idle_before, &released);
+            }
+            if (!released.empty()) {
+                const size_t count = released.size();
+                // Unregistering and unmapping take a while, so the chunks are
+                // freed here, out of the pool lock.
+                released.clear();
+                chunks_released_.fetch_add(count, std::memory_order_relaxed);
+                FLARE_LOG(INFO) << "Released " << count
+                                << " idle chunk(s) of pinned memory pool " << buffer.first
+                                << ", pool size is now " << pool.byte_size();
+            }
+        }
+    }
+
+    bool
+    pinned_memory_manager::grow(pinned_memory *pool, uint64_t size) {
+        if (pool_max_byte_size_ == 0) {
+            return false;
+        }
+        const uint64_t seen_byte_size = pool->byte_size();
+        std::lock_guard<std::mutex> grow_lk(pool->grow_mtx_);
+        if (pool->byte_size() > seen_byte_size) {
+            // Another thread grew the pool while this one waited
+            return true;
+        }
+
+        // Leave room for the allocator's own bookkeeping and rounding, and
+        // keep chunks a multiple of 2MB so they map to whole huge pages.
+        constexpr uint64_t kChunkAlignment = 2 << 20;
+        const uint64_t needed = size + slab_pool_allocator::kPageSize + 4096;
+        uint64_t chunk_size = std::max(
+                pool_chunk_byte_size_,
+                (needed + kChunkAlignment - 1) / kChunkAlignment * kChunkAlignment);
+        if (seen_byte_size + chunk_size > pool_max_byte_size_) {
+            // A smaller chunk still helps if the request fits
+            chunk_size = pool_max_byte_size_ - std::min(seen_byte_size, pool_max_byte_size_);
+            if (chunk_size < needed) {
+                return false;
+            }
+        }
+
+        // Chunks are added on the request path, where pre-faulting from many
+        // threads would only add latency.
+        pinned_buffer_config config;
+        config.huge_pages_ = huge_pages_;
+        void *buffer;
+        host_mapping mapping;
+        std::chrono::nanoseconds prefault_time;
+        if (!AllocPinnedBuffer(chunk_size, config, &buffer, &mapping, &prefault_time).is_ok()) {
+            return false;
+        }
+        try {
+            std::lock_guard<std::mutex> lk(pool->buffer_mtx_);
+            pool->add_chunk(buffer, chunk_size, mapping, true);
+        }
+        catch (const std::exception &ex) {
+            FreePinnedBuffer(buffer, mapping);
+            FLARE_LOG(WARNING) << "Unable to grow pinned memory pool: " << ex.what();
+            return false;
+        }
+        chunks_added_.fetch_add(1, std::memory_order_relaxed);
+        FLARE_LOG(INFO) << "Pinned memory pool grown by " << chunk_size << " bytes to "
+                        << pool->byte_size() << " bytes";
+        return true;
+    }
+
+    void
+    pinned_memory_manager::scavenger_loop() {
+        using clock = std::chrono::steady_clock;
+        const bool scavenging = (scavenge_interval_.count() != 0);
+        const bool sampling = (telemetry_sample_interval_.count() != 0);
+        const bool reclaiming = (deferred_free_interval_.count() != 0);
+        auto next_scavenge = clock::now() + scavenge_interval_;
+        auto next_sample = clock::now() + telemetry_sample_interval_;
+        auto next_reclaim = clock::now() + deferred_free_interval_;
+        std::unique_lock<std::mutex> lk(scavenger_mtx_);
+        while (true) {
+            // At least one of them is enabled, or the thread isn't started
+            auto wake = clock::time_point::max();
+            if (scavenging) {
+                wake = std::min(wake, next_scavenge);
+            }
+            if (sampling) {
+                wake = std::min(wake, next_sample);
+            }
+            if (reclaiming) {
+                wake = std::min(wake, next_reclaim);
+            }
+            if (scavenger_cv_.wait_until(lk, wake, [this]() { return stop_scavenger_; })) {
+                break;
+            }
+            lk.unlock();
+            const auto now = clock::now();
+            if (scavenging && (now >= next_scavenge)) {
+                scavenge();
+                next_scavenge = now + scavenge_interval_;
+            }
+            if (sampling && (now >= next_sample)) {
+                sample_telemetry();
+                next_sample = now + telemetry_sample_interval_;
+            }
+            if (reclaiming && (now >= next_reclaim)) {
+                reclaim_deferred();
+                next_reclaim = now + deferred_free_interval_;
+            }
+            lk.lock();
+        }
+    }
+
+    void
+    pinned_memory_manager::record_allocation(uint64_t size) {
+        auto &stripe = telemetry_stripes_[TelemetryStripe(kTelemetryStripeCount)];
+        stripe.allocations_.fetch_add(1, std::memory_order_relaxed);
+        stripe.allocated_bytes_.fetch_add(size, std::memory_order_relaxed);
+        stripe.size_buckets_[SizeBucket(size)].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void
+    pinned_memory_manager::record_free(uint64_t size) {
+        auto &stripe = telemetry_stripes_[TelemetryStripe(kTelemetryStripeCount)];
+        stripe.frees_.fetch_add(1, std::memory_order_relaxed);
+        stripe.freed_bytes_.fetch_add(size, std::memory_order_relaxed);
+    }
+
+    void
+    pinned_memory_manager::collect_telemetry(telemetry *result) {
+        *result = telemetry();
+        uint64_t allocated_bytes = 0;
+        uint64_t freed_bytes = 0;
+        for (const auto &stripe : telemetry_stripes_) {
+            result->allocations_ += stripe.allocations_.load(std::memory_order_relaxed);
+            result->frees_ += stripe.frees_.load(std::memory_order_relaxed);
+            allocated_bytes += stripe.allocated_bytes_.load(std::memory_order_relaxed);
+            freed_bytes += stripe.freed_bytes_.load(std::memory_order_relaxed);
+            for (size_t i = 0; i < telemetry::kSizeBucketCount; ++i) {
+                result->size_histogram_[i] += stripe.size_buckets_[i].load(std::memory_order_relaxed);
+            }
+        }
+        // A free can be counted before the allocation it releases when they
+        // are on different stripes
+        result->bytes_in_use_ = (allocated_bytes > freed_bytes) ? (allocated_bytes - freed_bytes) : 0;
+        result->fallback_allocations_ = fallback_allocations_.load(std::memory_order_relaxed);
+
+        std::lock_guard<std::mutex> lk(telemetry_mtx_);
+        high_water_bytes_ = std::max(high_water_bytes_, result->bytes_in_use_);
+        result->high_water_bytes_ = high_water_bytes_;
+        result->allocation_rate_ = allocation_rate_;
+    }
+
+    void
+    pinned_memory_manager::sample_telemetry() {
+        telemetry current;
+        collect_telemetry(&current);
+        const auto now = std::chrono::steady_clock::now();
+        std::lock_guard<std::mutex> lk(telemetry_mtx_);
+        const std::chrono::duration<double> elapsed = now - last_sample_time_;
+        if (elapsed.count() > 0) {
+            allocation_rate_ =
+                    static_cast<double>(current.allocations_ - last_sample_allocations_) /
+                    elapsed.count();
+        }
+        last_sample_allocations_ = current.allocations_;
+        last_sample_time_ = now;
     }
 
     void
@@ -78,18 +834,120 @@ namespace hercules::core {
         pinned_memory_buffers_[node_mask] = pinned_memory_buffer;
     }
 
+    void *
+    pinned_memory_manager::alloc_pinned(pinned_memory *pool, uint64_t size, uint32_t size_class) {
+        const auto allocate = [&]() -> void * {
+            if (size_class != kNoSizeClass) {
+                return cache_alloc(pool, size_class);
+            }
+            std::lock_guard<std::mutex> lk(pool->buffer_mtx_);
+            return pool->allocate(size);
+        };
+        void *ptr = pool->has_buffer() ? allocate() : nullptr;
+        if ((ptr == nullptr) && (thread_cache_byte_size_ != 0) && pool->has_buffer()) {
+            // The blocks cached by the threads may be enough
+            drain_caches(pool);
+            ptr = allocate();
+        }
+        if ((ptr == nullptr) && (deferred_free_batch_size_ != 0) && pool->has_buffer()) {
+            // So do the blocks freed by the threads but not reclaimed yet
+            reclaim_deferred();
+            ptr = allocate();
+        }
+        if ((ptr == nullptr) &&
+            grow(pool, (size_class != kNoSizeClass) ? size_classes_[size_class] : size)) {
+            ptr = allocate();
+        }
+        return ptr;
+    }
+
+    void
+    pinned_memory_manager::build_pool_order(
+            const std::map<int, std::vector<int>> &fallback_order) {
+        std::map<int, pinned_memory *> node_pools;
+        for (const auto &buffer : pinned_memory_buffers_) {
+            default_pools_.push_back(buffer.second.get());
+            if (buffer.second->node_ >= 0) {
+                node_pools.emplace(buffer.second->node_, buffer.second.get());
+            }
+        }
+        if (node_pools.empty()) {
+            return;
+        }
+
+        int max_node = node_pools.rbegin()->first;
+        if (!fallback_order.empty()) {
+            max_node = std::max(max_node, fallback_order.rbegin()->first);
+        }
+        pools_by_node_.resize(max_node + 1);
+        for (int node = 0; node <= max_node; ++node) {
+            auto &candidates = pools_by_node_[node];
+            const auto local = node_pools.find(node);
+            if (local != node_pools.end()) {
+                candidates.push_back(local->second);
+            }
+            const auto add = [&](int other) {
+                const auto it = node_pools.find(other);
+                if ((it != node_pools.end()) &&
+                    (std::find(candidates.begin(), candidates.end(), it->second) ==
+                     candidates.end())) {
+                    candidates.push_back(it->second);
+                }
+            };
+            const auto order = fallback_order.find(node);
+            if (order != fallback_order.end()) {
+                for (int other : order->second) {
+                    add(other);
+                }
+                continue;
+            }
+            // Nearest first, by node id among equally distant nodes
+            std::vector<std::pair<int, int>> others;
+            for (const auto &entry : node_pools) {
+                int distance;
+                if (!get_numa_node_distance(node, entry.first, &distance).is_ok()) {
+                    distance = (node == entry.first) ? 0 : 1;
+                }
+                others.emplace_back(distance, entry.first);
+            }
+            std::sort(others.begin(), others.end());
+            for (const auto &other : others) {
+                add(other.second);
+            }
+        }
+    }
+
     flare::result_status
     pinned_memory_manager::alloc_internal(
             void **ptr, uint64_t size, hercules::proto::MemoryType *allocated_type,
-            bool allow_nonpinned_fallback, pinned_memory *pinned_memory_buffer) {
+            bool allow_nonpinned_fallback, const pool_candidates &candidates, int node) {
         auto status = flare::result_status::success();
-        if (pinned_memory_buffer->pinned_memory_buffer_ != nullptr) {
-            std::lock_guard<std::mutex> lk(pinned_memory_buffer->buffer_mtx_);
-            *ptr = pinned_memory_buffer->managed_pinned_memory_.allocate(size, std::nothrow_t{});
+        *ptr = nullptr;
+        uint32_t size_class = kNoSizeClass;
+        pinned_memory *pinned_memory_buffer = candidates.front();
+        bool has_pool = (pool_max_byte_size_ != 0);
+        for (auto *pool : candidates) {
+            has_pool |= pool->has_buffer();
+        }
+        if (has_pool) {
+            size_class = size_class_of(size);
+            // The pool of the node first, then the others in fallback order
+            for (size_t i = 0; (i < candidates.size()) && (*ptr == nullptr); ++i) {
+                pinned_memory_buffer = candidates[i];
+                *ptr = alloc_pinned(pinned_memory_buffer, size, size_class);
+            }
             *allocated_type = hercules::proto::MEMORY_CPU_BINDING;
             if (*ptr == nullptr) {
                 status = flare::result_status(
                         hercules::common::ERROR_INTERNAL, "failed to allocate pinned system memory");
+            } else {
+                auto &usage = pinned_memory_buffer->usage_;
+                if ((node == pinned_memory_buffer->node_) || (pinned_memory_buffer->node_ < 0)) {
+                    usage.local_allocations_.fetch_add(1, std::memory_order_relaxed);
+                } else {
+                    usage.remote_allocations_.fetch_add(1, std::memory_order_relaxed);
+                }
+                usage.allocated_bytes_.fetch_add(size, std::memory_order_relaxed);
             }
         } else {
             status = flare::result_status(
@@ -98,14 +956,30 @@ namespace hercules::core {
         }
 
         bool is_pinned = true;
+        uint64_t mapped_bytes = 0;
         if ((!status.is_ok()) && allow_nonpinned_fallback) {
-            static bool warning_logged = false;
-            if (!warning_logged) {
+            const uint64_t fallbacks =
+                    fallback_allocations_.fetch_add(1, std::memory_order_relaxed) + 1;
+            fallback_bytes_.fetch_add(size, std::memory_order_relaxed);
+            // Warn on the first fallback and then at every power of two, so a
+            // pool that is too small stays visible without flooding the log.
+            if ((fallbacks & (fallbacks - 1)) == 0) {
                 FLARE_LOG(WARNING) << status
-                                   << ", falling back to non-pinned system memory";
-                warning_logged = true;
+                                   << ", falling back to non-pinned system memory ("
+                                   << fallbacks << " fallbacks so far)";
+            }
+            if ((huge_pages_ != huge_page_mode::kNone) &&
+                (size >= huge_page_min_fallback_byte_size_)) {
+                host_mapping mapping;
+                if (map_host_memory(size, huge_pages_, &mapping).is_ok()) {
+                    *ptr = mapping.addr_;
+                    mapped_bytes = mapping.size_;
+                    huge_page_fallback_allocations_.fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+            if (*ptr == nullptr) {
+                *ptr = malloc(size);
             }
-            *ptr = malloc(size);
             *allocated_type = hercules::proto::MEMORY_CPU;
             is_pinned = false;
             if (*ptr == nullptr) {
@@ -116,31 +990,43 @@ namespace hercules::core {
                 status = flare::result_status::success();
             }
         }
+        if (!status.is_ok()) {
+            failed_allocations_.fetch_add(1, std::memory_order_relaxed);
+        }
 
         // keep track of allocated buffer or clean up
         {
-            std::lock_guard<std::mutex> lk(info_mtx_);
             if (status.is_ok()) {
-                auto res = memory_info_.emplace(
-                        *ptr, std::make_pair(is_pinned, pinned_memory_buffer));
-                if (!res.second) {
+                allocation_info info;
+                info.is_pinned_ = is_pinned;
+                info.pool_ = pinned_memory_buffer;
+                info.size_class_ = is_pinned ? size_class : kNoSizeClass;
+                info.mapped_bytes_ = mapped_bytes;
+                info.size_ = size;
+                if (!memory_info_.insert(*ptr, info)) {
                     status = flare::result_status(
                             hercules::common::ERROR_INTERNAL, "unexpected memory address collision, '" +
                                                               PointerToString(*ptr) +
                                                               "' has been managed");
+                } else {
+                    record_allocation(size);
                 }
+#ifdef HERCULES_PINNED_MEMORY_DEBUG
                 FLARE_LOG(INFO) << (is_pinned ? "" : "non-")
                                 << "pinned memory allocation: "
                                 << "size " << size << ", addr " << *ptr;
+#endif  // HERCULES_PINNED_MEMORY_DEBUG
             }
         }
 
         if ((!status.is_ok()) && (*ptr != nullptr)) {
-            if (is_pinned) {
+            if (is_pinned && (size_class != kNoSizeClass)) {
+                cache_free(pinned_memory_buffer, size_class, *ptr);
+            } else if (is_pinned) {
                 std::lock_guard<std::mutex> lk(pinned_memory_buffer->buffer_mtx_);
-                pinned_memory_buffer->managed_pinned_memory_.deallocate(*ptr);
+                pinned_memory_buffer->deallocate(*ptr);
             } else {
-                free(*ptr);
+                FreeUnpinned(*ptr, mapped_bytes);
             }
         }
 
@@ -151,16 +1037,21 @@ namespace hercules::core {
     pinned_memory_manager::free_internal(void *ptr) {
         bool is_pinned = true;
         pinned_memory *pinned_memory_buffer = nullptr;
+        uint32_t size_class = kNoSizeClass;
+        uint64_t mapped_bytes = 0;
         {
-            std::lock_guard<std::mutex> lk(info_mtx_);
-            auto it = memory_info_.find(ptr);
-            if (it != memory_info_.end()) {
-                is_pinned = it->second.first;
-                pinned_memory_buffer = it->second.second;
+            allocation_info info;
+            if (memory_info_.erase(ptr, &info)) {
+                is_pinned = info.is_pinned_;
+                pinned_memory_buffer = info.pool_;
+                size_class = info.size_class_;
+                mapped_bytes = info.mapped_bytes_;
+                record_free(info.size_);
+#ifdef HERCULES_PINNED_MEMORY_DEBUG
                 FLARE_LOG(INFO) << (is_pinned ? "" : "non-")
                                 << "pinned memory deallocation: "
                                 << "addr " << ptr;
-                memory_info_.erase(it);
+#endif  // HERCULES_PINNED_MEMORY_DEBUG
             } else {
                 return flare::result_status(
                         hercules::common::ERROR_INTERNAL, "unexpected memory address '" +
@@ -169,11 +1060,13 @@ namespace hercules::core {
             }
         }
 
-        if (is_pinned) {
+        if (is_pinned && (size_class != kNoSizeClass)) {
+            cache_free(pinned_memory_buffer, size_class, ptr);
+        } else if (is_pinned) {
             std::lock_guard<std::mutex> lk(pinned_memory_buffer->buffer_mtx_);
-            pinned_memory_buffer->managed_pinned_memory_.deallocate(ptr);
+            pinned_memory_buffer->deallocate(ptr);
         } else {
-            free(ptr);
+            FreeUnpinned(ptr, mapped_bytes);
         }
         return flare::result_status::success();
     }
@@ -195,27 +1088,19 @@ namespace hercules::core {
 
         instance_.reset(new pinned_memory_manager());
         if (options.host_policy_map_.empty()) {
-            void *buffer = nullptr;
-#ifdef HERCULES_ENABLE_GPU
-            auto err = cudaHostAlloc(
-    &buffer, options.pinned_memory_pool_byte_size_, cudaHostAllocPortable);
-if (err != cudaSuccess) {
-  buffer = nullptr;
-  LOG_WARNING << "Unable to allocate pinned system memory, pinned memory "
-                 "pool will not be available: "
-              << std::string(cudaGetErrorString(err));
-} else if (options.pinned_memory_pool_byte_size_ != 0) {
-  LOG_INFO << "Pinned memory pool is created at '"
-           << PointerToString(buffer) << "' with size "
-           << options.pinned_memory_pool_byte_size_;
-} else {
-  LOG_INFO << "Pinned memory pool disabled";
-}
-#endif  // HERCULES_ENABLE_GPU
+            pinned_buffer_config config;
+            config.huge_pages_ = options.huge_pages_;
+            config.prefault_thread_count_ = options.pool_prefault_thread_count_;
+            host_mapping mapping;
+            std::chrono::nanoseconds prefault_time;
+            void *buffer = CreatePoolBuffer(
+                    options.pinned_memory_pool_byte_size_, config, &mapping, &prefault_time);
+            instance_->prefault_time_ += prefault_time;
             try {
                 instance_->add_pinned_memory_buffer(
-                        std::shared_ptr<pinned_memory>(
-                                new pinned_memory(buffer, options.pinned_memory_pool_byte_size_)),
+                        std::shared_ptr<pinned_memory>(new pinned_memory(
+                                buffer, options.pinned_memory_pool_byte_size_, mapping,
+                                options.pool_backend_)),
                         0);
             }
             catch (const std::exception &ex) {
@@ -252,30 +1137,22 @@ if (err != cudaSuccess) {
                                        << status;
                     continue;
                 }
-                void *buffer = nullptr;
-#ifdef HERCULES_ENABLE_GPU
-                auto err = cudaHostAlloc(
-      &buffer, options.pinned_memory_pool_byte_size_,
-      cudaHostAllocPortable);
-  if (err != cudaSuccess) {
-    buffer = nullptr;
-    LOG_WARNING << "Unable to allocate pinned system memory, pinned memory "
-                   "pool will not be available: "
-                << std::string(cudaGetErrorString(err));
-  } else if (options.pinned_memory_pool_byte_size_ != 0) {
-    LOG_INFO << "Pinned memory pool is created at '"
-             << PointerToString(buffer) << "' with size "
-             << options.pinned_memory_pool_byte_size_;
-  } else {
-    LOG_INFO << "Pinned memory pool disabled";
-  }
-#endif  // HERCULES_ENABLE_GPU
+                pinned_buffer_config config;
+                config.huge_pages_ = options.huge_pages_;
+                config.prefault_thread_count_ = options.pool_prefault_thread_count_;
+                config.host_policy_ = &options.host_policy_map_.at(node_policy.second);
+                host_mapping mapping;
+                std::chrono::nanoseconds prefault_time;
+                void *buffer = CreatePoolBuffer(
+                        options.pinned_memory_pool_byte_size_, config, &mapping, &prefault_time);
+                instance_->prefault_time_ += prefault_time;
                 reset_numa_memory_policy();
                 try {
-                    instance_->add_pinned_memory_buffer(
-                            std::shared_ptr<pinned_memory>(new pinned_memory(
-                                    buffer, options.pinned_memory_pool_byte_size_)),
-                            node_mask);
+                    std::shared_ptr<pinned_memory> pool(new pinned_memory(
+                            buffer, options.pinned_memory_pool_byte_size_, mapping,
+                            options.pool_backend_));
+                    pool->node_ = node_policy.first;
+                    instance_->add_pinned_memory_buffer(pool, node_mask);
                 }
                 catch (const std::exception &ex) {
                     return flare::result_status(
@@ -290,7 +1167,8 @@ if (err != cudaSuccess) {
                 try {
                     instance_->add_pinned_memory_buffer(
                             std::shared_ptr<pinned_memory>(new pinned_memory(
-                                    nullptr, options.pinned_memory_pool_byte_size_)),
+                                    nullptr, options.pinned_memory_pool_byte_size_,
+                                    host_mapping(), options.pool_backend_)),
                             0);
                 }
                 catch (const std::exception &ex) {
@@ -301,6 +1179,61 @@ if (err != cudaSuccess) {
                 }
             }
         }
+        if (options.thread_cache_byte_size_ != 0) {
+            // Four size classes per power of two, so a block wastes at most a
+            // fifth of its size.
+            auto &classes = instance_->size_classes_;
+            for (uint64_t base = 256; base <= options.thread_cache_max_block_size_; base *= 2) {
+                for (uint64_t step = 0; step < 4; ++step) {
+                    const uint64_t size = base + step * (base / 4);
+                    if (size <= options.thread_cache_max_block_size_) {
+                        classes.push_back(size);
+                    }
+                }
+            }
+            if (!classes.empty()) {
+                instance_->thread_cache_byte_size_ = options.thread_cache_byte_size_;
+                instance_->scavenge_interval_ = options.thread_cache_scavenge_interval_;
+            }
+        }
+        instance_->huge_pages_ = options.huge_pages_;
+        instance_->huge_page_min_fallback_byte_size_ = options.huge_page_min_fallback_byte_size_;
+#ifdef HERCULES_ENABLE_GPU
+        // Without GPU support there is no pinned memory to grow the pools by.
+        if (options.pinned_memory_pool_max_byte_size_ > options.pinned_memory_pool_byte_size_) {
+            instance_->pool_max_byte_size_ = options.pinned_memory_pool_max_byte_size_;
+            instance_->pool_chunk_byte_size_ = options.pinned_memory_pool_chunk_byte_size_;
+            instance_->pool_chunk_decay_ = options.pinned_memory_pool_chunk_decay_;
+            // Chunks are checked for decay along with the thread caches
+            if (instance_->scavenge_interval_.count() == 0) {
+                instance_->scavenge_interval_ = std::max(
+                        options.pinned_memory_pool_chunk_decay_, std::chrono::milliseconds(1));
+            }
+        }
+#endif  // HERCULES_ENABLE_GPU
+        bool has_pool = (instance_->pool_max_byte_size_ != 0);
+        for (const auto &buffer : instance_->pinned_memory_buffers_) {
+            has_pool |= buffer.second->has_buffer();
+        }
+        if (!has_pool) {
+            instance_->scavenge_interval_ = std::chrono::milliseconds(0);
+        }
+        instance_->telemetry_sample_interval_ = options.telemetry_sample_interval_;
+        instance_->last_sample_time_ = std::chrono::steady_clock::now();
+        instance_->serial_ = next_manager_serial.fetch_add(1);
+        if (options.deferred_free_batch_size_ != 0) {
+            instance_->deferred_free_batch_size_ = options.deferred_free_batch_size_;
+            // The lists of exited threads are only emptied by the reclaimer
+            instance_->deferred_free_interval_ =
+                    std::max(options.deferred_free_interval_, std::chrono::milliseconds(1));
+        }
+        if ((instance_->scavenge_interval_.count() != 0) ||
+            (instance_->telemetry_sample_interval_.count() != 0) ||
+            (instance_->deferred_free_interval_.count() != 0)) {
+            instance_->scavenger_ =
+                    std::thread(&pinned_memory_manager::scavenger_loop, instance_.get());
+        }
+        instance_->build_pool_order(options.numa_fallback_order_);
         pinned_memory_byte_size_ = options.pinned_memory_pool_byte_size_;
         return flare::result_status::success();
     }
@@ -314,21 +1247,141 @@ if (err != cudaSuccess) {
                     hercules::common::ERROR_UNAVAILABLE, "pinned_memory_manager has not been created");
         }
 
-        auto pinned_memory_buffer =
-                instance_->pinned_memory_buffers_.begin()->second.get();
+        int node = -1;
+        const pool_candidates *candidates = &instance_->default_pools_;
         if (instance_->pinned_memory_buffers_.size() > 1) {
-            unsigned long node_mask;
-            if (get_numa_memory_policy_node_mask(&node_mask).is_ok()) {
-                auto it = instance_->pinned_memory_buffers_.find(node_mask);
-                if (it != instance_->pinned_memory_buffers_.end()) {
-                    pinned_memory_buffer = it->second.get();
-                }
+            node = requester_node();
+            if ((node >= 0) && (static_cast<size_t>(node) < instance_->pools_by_node_.size()) &&
+                !instance_->pools_by_node_[node].empty()) {
+                candidates = &instance_->pools_by_node_[node];
             }
         }
 
         return instance_->alloc_internal(
-                ptr, size, allocated_type, allow_nonpinned_fallback,
-                pinned_memory_buffer);
+                ptr, size, allocated_type, allow_nonpinned_fallback, *candidates, node);
+    }
+
+    int
+    pinned_memory_manager::requester_node() {
+        // An explicit host policy wins over where the thread happens to run
+        unsigned long node_mask;
+        if (get_numa_memory_policy_node_mask(&node_mask).is_ok() && (node_mask != 0) &&
+            ((node_mask & (node_mask - 1)) == 0)) {
+            return __builtin_ctzl(node_mask);
+        }
+        int node;
+        if (get_current_numa_node(&node).is_ok()) {
+            return node;
+        }
+        return -1;
+    }
+
+    flare::result_status
+    pinned_memory_manager::get_pool_stats(std::map<unsigned long, host_pool_stats> *stats) {
+        if (instance_ == nullptr) {
+            return flare::result_status(
+                    hercules::common::ERROR_UNAVAILABLE, "pinned_memory_manager has not been created");
+        }
+
+        stats->clear();
+        for (const auto &buffer : instance_->pinned_memory_buffers_) {
+            auto &pool = *buffer.second;
+            std::lock_guard<std::mutex> lk(pool.buffer_mtx_);
+            if (!pool.has_buffer()) {
+                continue;
+            }
+            (*stats)[buffer.first] = pool.get_stats();
+        }
+        return flare::result_status::success();
+    }
+
+    flare::result_status
+    pinned_memory_manager::get_pool_snapshots(
+            std::map<unsigned long, std::vector<host_pool_snapshot>> *snapshots) {
+        if (instance_ == nullptr) {
+            return flare::result_status(
+                    hercules::common::ERROR_UNAVAILABLE, "pinned_memory_manager has not been created");
+        }
+
+        snapshots->clear();
+        for (const auto &buffer : instance_->pinned_memory_buffers_) {
+            auto &pool = *buffer.second;
+            std::lock_guard<std::mutex> lk(pool.buffer_mtx_);
+            if (!pool.has_buffer()) {
+                continue;
+            }
+            (*snapshots)[buffer.first] = pool.get_snapshots();
+        }
+        return flare::result_status::success();
+    }
+
+    flare::result_status
+    pinned_memory_manager::get_pool_snapshots_json(std::string *json) {
+        std::map<unsigned long, std::vector<host_pool_snapshot>> snapshots;
+        auto status = get_pool_snapshots(&snapshots);
+        if (!status.is_ok()) {
+            return status;
+        }
+        // Serialized without the locks
+        json->assign("[");
+        for (const auto &pool : snapshots) {
+            if (json->size() > 1) {
+                json->append(",");
+            }
+            json->append("{\"numa_node_mask\":" + std::to_string(pool.first) + ",\"chunks\":[");
+            for (size_t i = 0; i < pool.second.size(); ++i) {
+                if (i != 0) {
+                    json->append(",");
+                }
+                json->append(pool.second[i].to_json());
+            }
+            json->append("]}");
+        }
+        json->append("]");
+        return flare::result_status::success();
+    }
+
+    flare::result_status
+    pinned_memory_manager::get_counters(counters *counters) {
+        if (instance_ == nullptr) {
+            return flare::result_status(
+                    hercules::common::ERROR_UNAVAILABLE, "pinned_memory_manager has not been created");
+        }
+
+        counters->fallback_allocations_ =
+                instance_->fallback_allocations_.load(std::memory_order_relaxed);
+        counters->fallback_bytes_ = instance_->fallback_bytes_.load(std::memory_order_relaxed);
+        counters->failed_allocations_ =
+                instance_->failed_allocations_.load(std::memory_order_relaxed);
+        counters->chunks_added_ = instance_->chunks_added_.load(std::memory_order_relaxed);
+        counters->chunks_released_ = instance_->chunks_released_.load(std::memory_order_relaxed);
+        counters->huge_page_fallback_allocations_ =
+                instance_->huge_page_fallback_allocations_.load(std::memory_order_relaxed);
+        counters->prefault_time_ = instance_->prefault_time_;
+        counters->pools_.clear();
+        for (const auto &buffer : instance_->pinned_memory_buffers_) {
+            const auto &pool = *buffer.second;
+            auto &pool_counters = counters->pools_[buffer.first];
+            pool_counters.node_ = pool.node_;
+            pool_counters.local_allocations_ =
+                    pool.usage_.local_allocations_.load(std::memory_order_relaxed);
+            pool_counters.remote_allocations_ =
+                    pool.usage_.remote_allocations_.load(std::memory_order_relaxed);
+            pool_counters.allocated_bytes_ =
+                    pool.usage_.allocated_bytes_.load(std::memory_order_relaxed);
+        }
+        return flare::result_status::success();
+    }
+
+    flare::result_status
+    pinned_memory_manager::get_telemetry(telemetry *telemetry) {
+        if (instance_ == nullptr) {
+            return flare::result_status(
+                    hercules::common::ERROR_UNAVAILABLE, "pinned_memory_manager has not been created");
+        }
+
+        instance_->collect_telemetry(telemetry);
+        return flare::result_status::success();
     }
 
     flare::result_status
@@ -341,4 +1394,33 @@ if (err != cudaSuccess) {
         return instance_->free_internal(ptr);
     }
 
-}  // namespace hercules::core
\ No newline at end of file
+    flare::result_status
+    pinned_memory_manager::defer_free(void *ptr) {
+        if (instance_ == nullptr) {
+            return flare::result_status(
+                    hercules::common::ERROR_UNAVAILABLE, "pinned_memory_manager has not been created");
+        }
+        if (instance_->deferred_free_batch_size_ == 0) {
+            return instance_->free_internal(ptr);
+        }
+
+        deferred_list *list = instance_->local_deferred_list();
+        std::vector<void *> batch;
+        {
+            std::lock_guard<std::mutex> lk(list->mtx_);
+            list->ptrs_.push_back(ptr);
+            if (list->ptrs_.size() < instance_->deferred_free_batch_size_) {
+                return flare::result_status::success();
+            }
+            batch.swap(list->ptrs_);
+        }
+        instance_->free_batch(&batch);
+        // Hand the emptied vector back to keep its capacity
+        std::lock_guard<std::mutex> lk(list->mtx_);
+        if (list->ptrs_.empty()) {
+            list->ptrs_.swap(batch);
+        }
+        return flare::result_status::success();
+    }
+
+}  // namespace hercules::core
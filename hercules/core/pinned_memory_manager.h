@@ -5,18 +5,34 @@
 #ifndef HERCULES_CORE_PINED_MEMORY_MANAGER_H_
 #define HERCULES_CORE_PINED_MEMORY_MANAGER_H_
 
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <cstddef>
 #include <cstdint>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
 #include <flare/base/result_status.h>
+#include "hercules/common/macros.h"
 #include "hercules/common/model_config.h"
+#include "hercules/common/sharded_pointer_map.h"
+#include "hercules/core/host_memory.h"
+#include "hercules/core/host_pool_allocator.h"
 #include "hercules/proto/memory_type.pb.h"
-#include <boost/interprocess/managed_external_buffer.hpp>
 
 namespace hercules::core {
     // This is a singleton class responsible for maintaining pinned memory pool
     // used by the inference server. Pinned memory allocations and deallocations
     // must be requested via functions provided by this class.
+    //
+    // Building with HERCULES_PINNED_MEMORY_DEBUG defined logs every allocation
+    // and deallocation. Use get_telemetry() otherwise, the log lines cost more
+    // than the allocations themselves.
     class pinned_memory_manager {
     public:
         // Options to configure pinned memeory manager.
@@ -29,6 +45,108 @@ namespace hercules::core {
 
             uint64_t pinned_memory_pool_byte_size_;
             hercules::common::two_level_map_config host_policy_map_;
+            // Each thread caches freed pinned blocks of up to
+            // 'thread_cache_max_block_size_' bytes, rounded up to a size class,
+            // and reuses them without locking the pool. A thread caches at most
+            // 'thread_cache_byte_size_' bytes per pool, zero, the default,
+            // disables the cache. Blocks left unused for
+            // 'thread_cache_scavenge_interval_' are given back to the pool.
+            // Cached blocks stay with the thread that freed them, so a pool
+            // shared by threads that allocate and threads that free should
+            // leave the cache off.
+            uint64_t thread_cache_byte_size_ = 0;
+            uint64_t thread_cache_max_block_size_ = 1 << 20;
+            std::chrono::milliseconds thread_cache_scavenge_interval_{1000};
+            // The allocator managing the blocks of each pool.
+            host_pool_backend pool_backend_ = host_pool_backend::kBestFit;
+            // When a pool is exhausted it grows by chunks of at least
+            // 'pinned_memory_pool_chunk_byte_size_' bytes, up to
+            // 'pinned_memory_pool_max_byte_size_' bytes in total, before
+            // falling back to non-pinned memory. Zero, a cap below the
+            // initial size or a build without GPU support disables growing.
+            // Chunks added this way are given back once unused for
+            // 'pinned_memory_pool_chunk_decay_'.
+            uint64_t pinned_memory_pool_max_byte_size_ = 0;
+            uint64_t pinned_memory_pool_chunk_byte_size_ = 64 << 20;
+            std::chrono::milliseconds pinned_memory_pool_chunk_decay_{10000};
+            // The pages backing the pools and the non-pinned fallback
+            // allocations of at least 'huge_page_min_fallback_byte_size_'
+            // bytes. Smaller fallbacks always come from malloc().
+            huge_page_mode huge_pages_ = huge_page_mode::kNone;
+            uint64_t huge_page_min_fallback_byte_size_ = 2 << 20;
+            // If not zero, create() touches the memory of each pool from up
+            // to this many threads running on the pool's NUMA node, so the
+            // page faults are taken at startup rather than by the first
+            // requests. Only applies to the initial chunks.
+            size_t pool_prefault_thread_count_ = 0;
+            // With one pool per NUMA node, a request goes to the pool of the
+            // node named by the thread's host policy, or else to the pool of
+            // the node the thread runs on. If that pool can't serve it, the
+            // pools of the nodes listed here for the node are tried in order.
+            // Nodes not listed try the other pools, nearest first, and an
+            // empty list disables falling back to other nodes.
+            std::map<int, std::vector<int>> numa_fallback_order_;
+            // How often the telemetry is sampled to track the high-water mark
+            // and the allocation rate. Zero, the default, disables sampling,
+            // and then the high-water mark only covers the calls to
+            // get_telemetry() and the allocation rate stays zero.
+            std::chrono::milliseconds telemetry_sample_interval_{0};
+            // If not zero, defer_free() queues up to this many pointers per
+            // thread and gives them back in one batch, so the threads
+            // completing requests don't wait on the pool locks for every
+            // free. What the threads queued is also reclaimed in the
+            // background every 'deferred_free_interval_'. Queued memory
+            // counts as in use until it is reclaimed.
+            size_t deferred_free_batch_size_ = 0;
+            std::chrono::milliseconds deferred_free_interval_{10};
+        };
+
+        // Allocation activity across all pools, pinned or not.
+        struct telemetry {
+            static constexpr size_t kSizeBucketCount = 64;
+
+            // Bytes requested by the live allocations, and the most seen at
+            // any sample or call to get_telemetry().
+            uint64_t bytes_in_use_ = 0;
+            uint64_t high_water_bytes_ = 0;
+            uint64_t allocations_ = 0;
+            uint64_t frees_ = 0;
+            // Allocations per second between the last two samples.
+            double allocation_rate_ = 0.0;
+            uint64_t fallback_allocations_ = 0;
+            // Requested sizes in power of two buckets: bucket 0 counts sizes
+            // below 2 bytes, and bucket i > 0 counts sizes in [2^i, 2^(i+1)).
+            std::array<uint64_t, kSizeBucketCount> size_histogram_{};
+        };
+
+        // Process-wide counts of how the pools coped with the demand.
+        struct counters {
+            // Allocations served from non-pinned memory, and their bytes.
+            uint64_t fallback_allocations_ = 0;
+            uint64_t fallback_bytes_ = 0;
+            // Fallbacks mapped with huge pages rather than malloc'ed.
+            uint64_t huge_page_fallback_allocations_ = 0;
+            // Requests failed because neither pinned memory nor a fallback
+            // was available.
+            uint64_t failed_allocations_ = 0;
+            uint64_t chunks_added_ = 0;
+            uint64_t chunks_released_ = 0;
+            // Time create() spent pre-faulting the pools.
+            std::chrono::nanoseconds prefault_time_{0};
+
+            // Usage of one pool.
+            struct pool_counters {
+                // The NUMA node of the pool, -1 without NUMA pools.
+                int node_ = -1;
+                // Allocations served for threads of the pool's node, and for
+                // threads of other nodes whose pool couldn't serve them.
+                uint64_t local_allocations_ = 0;
+                uint64_t remote_allocations_ = 0;
+                uint64_t allocated_bytes_ = 0;
+            };
+
+            // Keyed by the NUMA node mask of the pool, as get_pool_stats().
+            std::map<unsigned long, pool_counters> pools_;
         };
 
         ~pinned_memory_manager();
@@ -50,31 +168,276 @@ namespace hercules::core {
         // Return flare::result_status object indicating success or failure.
         static flare::result_status Free(void *ptr);
 
+        // Similar to Free(), but the memory may be freed later in a batch
+        // with other memory freed by the calling thread, see
+        // options::deferred_free_batch_size_. Deferred frees of memory not
+        // managed here are only logged.
+        static flare::result_status defer_free(void *ptr);
+
+        // Get the occupancy and fragmentation of each pinned memory pool, keyed
+        // by the NUMA node mask of the pool. Blocks held by the thread caches
+        // count as used.
+        static flare::result_status get_pool_stats(std::map<unsigned long, host_pool_stats> *stats);
+
+        // Get a snapshot of each chunk of each pinned memory pool, keyed like
+        // get_pool_stats(), i.e. to monitor the fragmentation of the pools.
+        static flare::result_status get_pool_snapshots(
+                std::map<unsigned long, std::vector<host_pool_snapshot>> *snapshots);
+
+        // Similar to the above, serialized as a JSON array of pools, i.e.
+        //   [{"numa_node_mask":1,"chunks":[<host_pool_snapshot::to_json()>]}]
+        static flare::result_status get_pool_snapshots_json(std::string *json);
+
+        static flare::result_status get_counters(counters *counters);
+
+        static flare::result_status get_telemetry(telemetry *telemetry);
+
     protected:
         // Provide explicit control on the lifecycle of the CUDA memory manager,
         // for testing only.
         static void reset();
 
     private:
+        struct thread_cache;
+
         class pinned_memory {
         public:
-            pinned_memory(void *pinned_memory_buffer, uint64_t size);
+            using clock = std::chrono::steady_clock;
+
+            // 'pinned_memory_buffer' becomes the initial chunk, if not null.
+            // 'mapping' is set if the buffer was mapped by map_host_memory().
+            pinned_memory(
+                    void *pinned_memory_buffer, uint64_t size, const host_mapping &mapping,
+                    host_pool_backend backend);
 
             ~pinned_memory();
 
-            void *pinned_memory_buffer_;
+            // A piece of pinned memory with its own allocator, freed on
+            // destruction.
+            struct chunk {
+                ~chunk();
+
+                char *buffer_ = nullptr;
+                uint64_t size_ = 0;
+                bool decays_ = false;
+                host_mapping mapping_;
+                std::unique_ptr<host_pool_allocator> allocator_;
+                // Blocks handed out, including those held by thread caches.
+                size_t live_blocks_ = 0;
+                clock::time_point idle_since_;
+            };
+
+            // The methods below must be called with 'buffer_mtx_' held.
+
+            // Take ownership of the 'size' bytes at 'buffer' as a new chunk,
+            // which is released by release_idle_chunks() if 'decays'.
+            void add_chunk(void *buffer, uint64_t size, const host_mapping &mapping, bool decays);
+
+            // Return a block from the first chunk that has room, or nullptr.
+            void *allocate(uint64_t size);
+
+            void deallocate(void *ptr);
+
+            // Remove the chunks that decay and have been unused since before
+            // 'idle_before' and move them to 'released', so that the caller
+            // can free them after dropping 'buffer_mtx_'.
+            void release_idle_chunks(
+                    clock::time_point idle_before, std::vector<std::unique_ptr<chunk>> *released);
+
+            host_pool_stats get_stats() const;
+
+            // A snapshot of each chunk, in the order they were added.
+            std::vector<host_pool_snapshot> get_snapshots() const;
+
+            // Whether the pool has any memory, readable without the lock.
+            bool has_buffer() const { return byte_size_.load(std::memory_order_relaxed) != 0; }
+
+            uint64_t byte_size() const { return byte_size_.load(std::memory_order_relaxed); }
+
             std::mutex buffer_mtx_;
-            boost::interprocess::managed_external_buffer managed_pinned_memory_;
+            // Serializes growing the pool, taken before 'buffer_mtx_'.
+            std::mutex grow_mtx_;
+            // Unique over the process lifetime, unlike the address.
+            uint64_t serial_;
+            // The NUMA node of the pool, -1 if the pool isn't bound to one.
+            int node_ = -1;
+
+            struct alignas(HERCULES_CACHELINE_SIZE) usage {
+                std::atomic<uint64_t> local_allocations_{0};
+                std::atomic<uint64_t> remote_allocations_{0};
+                std::atomic<uint64_t> allocated_bytes_{0};
+            };
+            usage usage_;
+            // The thread caches of this pool, guarded by the cache registry lock.
+            std::vector<std::shared_ptr<thread_cache>> caches_;
+
+        private:
+            chunk *chunk_of(void *ptr);
+
+            // Add the bytes of 'c' backed by huge pages to 'stats'.
+            static void count_huge_pages(const chunk &c, host_pool_stats *stats);
+
+            host_pool_backend backend_;
+            // In the order they were added, the initial chunk first.
+            std::vector<std::unique_ptr<chunk>> chunks_;
+            std::map<char *, chunk *> chunk_by_addr_;
+            std::atomic<uint64_t> byte_size_{0};
+        };
+
+        // Sentinel size class of blocks that are not cached.
+        static constexpr uint32_t kNoSizeClass = UINT32_MAX;
+
+        // What the manager knows of a live allocation.
+        struct allocation_info {
+            bool is_pinned_ = false;
+            pinned_memory *pool_ = nullptr;
+            // The size class the block was rounded up to, if it is cacheable.
+            uint32_t size_class_ = kNoSizeClass;
+            // The length of a non-pinned block mapped with huge pages, zero if
+            // it was malloc'ed.
+            uint64_t mapped_bytes_ = 0;
+            // The requested size.
+            uint64_t size_ = 0;
+        };
+
+        // Telemetry counters, striped over the threads so that they don't
+        // all hit the same cache line.
+        static constexpr size_t kTelemetryStripeCount = 16;
+
+        struct alignas(HERCULES_CACHELINE_SIZE) telemetry_stripe {
+            std::atomic<uint64_t> allocations_{0};
+            std::atomic<uint64_t> frees_{0};
+            std::atomic<uint64_t> allocated_bytes_{0};
+            std::atomic<uint64_t> freed_bytes_{0};
+            std::array<std::atomic<uint64_t>, telemetry::kSizeBucketCount> size_buckets_{};
+        };
+
+        // Free blocks of one size class in a thread cache.
+        struct cache_bin {
+            std::vector<void *> blocks_;
+            // Fewest blocks the bin held since the last scavenge, that many
+            // blocks went unused meanwhile.
+            size_t low_water_ = 0;
         };
 
+        // Free blocks of one pool cached by one thread. Only the owning thread
+        // and the scavenger take 'mtx_', so it is rarely contended.
+        struct thread_cache {
+            std::mutex mtx_;
+            // Null once the pool is destroyed.
+            pinned_memory *pool_ = nullptr;
+            std::vector<cache_bin> bins_;
+            uint64_t cached_bytes_ = 0;
+        };
+
+        // The caches of the calling thread, given back to their pools when the
+        // thread exits.
+        struct thread_cache_list {
+            ~thread_cache_list();
+
+            std::vector<std::pair<uint64_t, std::shared_ptr<thread_cache>>> caches_;
+        };
+
+        // Pointers queued by one thread for deferred freeing. Only the owning
+        // thread and the reclaimer take 'mtx_', so it is rarely contended.
+        struct deferred_list {
+            std::mutex mtx_;
+            std::vector<void *> ptrs_;
+            // Set when the owning thread exits, the reclaimer then drops the
+            // list once it is emptied.
+            bool exited_ = false;
+        };
+
+        // The deferred list of the calling thread for the manager of serial
+        // 'manager_serial_'.
+        struct deferred_list_holder {
+            ~deferred_list_holder();
+
+            uint64_t manager_serial_ = 0;
+            std::shared_ptr<deferred_list> list_;
+        };
+
+        // The pools to try for a request, in order.
+        using pool_candidates = std::vector<pinned_memory *>;
+
         pinned_memory_manager() = default;
 
+        // Serve the request from the first of 'candidates' that can, on
+        // behalf of a thread of 'node' (-1 if unknown).
         flare::result_status alloc_internal(
                 void **ptr, uint64_t size, hercules::proto::MemoryType *allocated_type,
-                bool allow_nonpinned_fallback, pinned_memory *pinned_memory_buffer);
+                bool allow_nonpinned_fallback, const pool_candidates &candidates, int node);
+
+        // Return a block of 'pool', or nullptr if it can't serve the request
+        // even after draining the thread caches and growing.
+        void *alloc_pinned(pinned_memory *pool, uint64_t size, uint32_t size_class);
+
+        // The NUMA node whose pool the calling thread should use, or -1.
+        static int requester_node();
+
+        // Fill 'default_pools_' and 'pools_by_node_' once the pools exist.
+        void build_pool_order(const std::map<int, std::vector<int>> &fallback_order);
 
         flare::result_status free_internal(void *ptr);
 
+        // Return the calling thread's deferred list, creating it if needed.
+        deferred_list *local_deferred_list();
+
+        // Free all of 'ptrs', locking each pool once, and clear 'ptrs'.
+        void free_batch(std::vector<void *> *ptrs);
+
+        // Free the pointers queued by all threads.
+        void reclaim_deferred();
+
+        // Return the size class that 'size' rounds up to, or kNoSizeClass if
+        // blocks of 'size' are not cached.
+        uint32_t size_class_of(uint64_t size) const;
+
+        // The number of blocks a thread caches for 'size_class'.
+        size_t bin_capacity(uint32_t size_class) const;
+
+        // Return the calling thread's cache of 'pool', creating it if needed.
+        thread_cache *local_cache(pinned_memory *pool);
+
+        // Take a block of 'size_class' from the calling thread's cache of
+        // 'pool', refilling the cache with a batch from the pool if empty.
+        // Return nullptr if the pool is exhausted.
+        void *cache_alloc(pinned_memory *pool, uint32_t size_class);
+
+        // Put 'ptr' in the calling thread's cache of 'pool', or give it back to
+        // the pool if the cache is full.
+        void cache_free(pinned_memory *pool, uint32_t size_class, void *ptr);
+
+        // Give the first 'count' blocks of the bin back to the pool of
+        // 'cache'. Must be called with the lock of 'cache' held.
+        void release_blocks(thread_cache *cache, uint32_t size_class, size_t count) const;
+
+        // Give the blocks cached by all threads for 'pool' back to it.
+        void drain_caches(pinned_memory *pool);
+
+        // Give the blocks the threads didn't use since the last call back to
+        // their pools.
+        void scavenge();
+
+        // Run scavenge(), sample_telemetry() and reclaim_deferred() at their
+        // intervals.
+        void scavenger_loop();
+
+        void record_allocation(uint64_t size);
+
+        void record_free(uint64_t size);
+
+        // Sum the stripes into 'result', and update the high-water mark.
+        void collect_telemetry(telemetry *result);
+
+        // Update the high-water mark and the allocation rate.
+        void sample_telemetry();
+
+        // Add a chunk to 'pool' so that a block of 'size' bytes fits, unless
+        // that would exceed the cap. Return whether the pool may now serve
+        // the request, i.e. it grew here or in another thread meanwhile.
+        bool grow(pinned_memory *pool, uint64_t size);
+
         void add_pinned_memory_buffer(
                 const std::shared_ptr<pinned_memory> &pinned_memory_buffer,
                 unsigned long node_mask);
@@ -82,9 +445,61 @@ namespace hercules::core {
         static std::unique_ptr<pinned_memory_manager> instance_;
         static uint64_t pinned_memory_byte_size_;
 
-        std::mutex info_mtx_;
-        std::map<void *, std::pair<bool, pinned_memory *>> memory_info_;
+        // Whether each live allocation is pinned, and the pool it comes from.
+        // Sharded so that threads allocating and freeing don't serialize on a
+        // single lock.
+        hercules::common::sharded_pointer_map<allocation_info> memory_info_;
+
+        // Thread cache configuration, the block sizes of the size classes are
+        // in increasing order.
+        uint64_t thread_cache_byte_size_ = 0;
+        std::vector<uint64_t> size_classes_;
+        std::chrono::milliseconds scavenge_interval_{0};
+        std::chrono::milliseconds telemetry_sample_interval_{0};
+        std::chrono::milliseconds deferred_free_interval_{0};
+        std::thread scavenger_;
+        std::mutex scavenger_mtx_;
+        std::condition_variable scavenger_cv_;
+        bool stop_scavenger_ = false;
+
+        // Growth configuration, see options.
+        uint64_t pool_max_byte_size_ = 0;
+        uint64_t pool_chunk_byte_size_ = 0;
+        std::chrono::milliseconds pool_chunk_decay_{0};
+        huge_page_mode huge_pages_ = huge_page_mode::kNone;
+        uint64_t huge_page_min_fallback_byte_size_ = 0;
+
+        // Only written by create().
+        std::chrono::nanoseconds prefault_time_{0};
+        // Unique over the process lifetime, tells the thread local deferred
+        // lists of a previous manager apart.
+        uint64_t serial_ = 0;
+
+        size_t deferred_free_batch_size_ = 0;
+        // Guards 'deferred_lists_'.
+        std::mutex deferred_mtx_;
+        std::vector<std::shared_ptr<deferred_list>> deferred_lists_;
+
+        telemetry_stripe telemetry_stripes_[kTelemetryStripeCount];
+        // Guards the sampled values below.
+        std::mutex telemetry_mtx_;
+        uint64_t high_water_bytes_ = 0;
+        double allocation_rate_ = 0.0;
+        uint64_t last_sample_allocations_ = 0;
+        std::chrono::steady_clock::time_point last_sample_time_;
+
+        std::atomic<uint64_t> fallback_allocations_{0};
+        std::atomic<uint64_t> fallback_bytes_{0};
+        std::atomic<uint64_t> huge_page_fallback_allocations_{0};
+        std::atomic<uint64_t> failed_allocations_{0};
+        std::atomic<uint64_t> chunks_added_{0};
+        std::atomic<uint64_t> chunks_released_{0};
         std::map<unsigned long, std::shared_ptr<pinned_memory>> pinned_memory_buffers_;
+        // Every pool, for threads of no known node.
+        pool_candidates default_pools_;
+        // The pools to try for the threads of each node, empty for the nodes
+        // that use 'default_pools_'.
+        std::vector<pool_candidates> pools_by_node_;
     };
 
 }  // namespace hercules::core
@@ -0,0 +1,273 @@
+/****************************************************************
+ * Copyright (c) 2022, liyinbin
+ * All rights reserved.
+ * Author by liyinbin (jeff.li) lijippy@163.com
+ *****************************************************************/
+
+#include "hercules/core/shared_memory_manager.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include "hercules/common/error_code.h"
+
+namespace hercules::core {
+
+    // A mapped window of a shared memory object.
+    struct shared_memory_manager::region {
+        ~region() {
+            if (mapping_ != nullptr) {
+                munmap(mapping_, mapping_size_);
+            }
+        }
+
+        std::string key_;
+        uint64_t offset_ = 0;
+        uint64_t byte_size_ = 0;
+        // The mapping starts at the page holding 'offset_'.
+        void *mapping_ = nullptr;
+        uint64_t mapping_size_ = 0;
+        char *base_ = nullptr;
+    };
+
+    namespace {
+
+        std::string
+        ErrnoString() {
+            return std::strerror(errno);
+        }
+
+        // Views that keep their region mapped.
+        class shared_memory_reference : public memory_reference {
+        public:
+            explicit shared_memory_reference(std::shared_ptr<void> region)
+                    : region_(std::move(region)) {
+            }
+
+        private:
+            std::shared_ptr<void> region_;
+        };
+
+        class shared_mutable_memory : public mutable_memory {
+        public:
+            shared_mutable_memory(std::shared_ptr<void> region, char *buffer, size_t byte_size)
+                    : mutable_memory(buffer, byte_size, hercules::proto::MEMORY_CPU, 0),
+                      region_(std::move(region)) {
+            }
+
+        private:
+            std::shared_ptr<void> region_;
+        };
+
+    }  // namespace
+
+    shared_memory_manager::~shared_memory_manager() {
+        unregister_all();
+    }
+
+    flare::result_status
+    shared_memory_manager::register_region(
+            const std::string &name, const std::string &key, uint64_t offset,
+            uint64_t byte_size) {
+        // Only "/name", files and memfds of other processes can't be mapped
+        // through a key
+        if ((key.size() < 2) || (key[0] != '/') ||
+            (key.find('/', 1) != std::string::npos)) {
+            return flare::result_status(
+                    hercules::common::ERROR_INVALID_ARG,
+                    "Unable to open shared memory region '" + name + "' with key '" + key +
+                    "': not a POSIX shared memory object name");
+        }
+        const int fd = shm_open(key.c_str(), O_RDWR, S_IRUSR | S_IWUSR);
+        if (fd == -1) {
+            return flare::result_status(
+                    hercules::common::ERROR_INTERNAL,
+                    "Unable to open shared memory region '" + name + "' with key '" + key +
+                    "': " + ErrnoString());
+        }
+        auto status = add_region(name, key, fd, offset, byte_size);
+        close(fd);
+        return status;
+    }
+
+    flare::result_status
+    shared_memory_manager::register_fd(
+            const std::string &name, int fd, uint64_t offset, uint64_t byte_size) {
+        return add_region(name, "fd:" + std::to_string(fd), fd, offset, byte_size);
+    }
+
+    flare::result_status
+    shared_memory_manager::add_region(
+            const std::string &name, const std::string &key, int fd, uint64_t offset,
+            uint64_t byte_size) {
+        {
+            std::lock_guard<std::mutex> lk(mtx_);
+            if (regions_.find(name) != regions_.end()) {
+                return flare::result_status(
+                        hercules::common::ERROR_ALREADY_EXISTS,
+                        "shared memory region '" + name + "' is already registered");
+            }
+        }
+        if (byte_size == 0) {
+            return flare::result_status(
+                    hercules::common::ERROR_INVALID_ARG,
+                    "shared memory region '" + name + "' must have a positive byte size");
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            return flare::result_status(
+                    hercules::common::ERROR_INTERNAL,
+                    "Unable to get the size of shared memory region '" + name + "': " +
+                    ErrnoString());
+        }
+        const auto object_size = static_cast<uint64_t>(st.st_size);
+        if ((offset > object_size) || (byte_size > object_size - offset)) {
+            return flare::result_status(
+                    hercules::common::ERROR_INVALID_ARG,
+                    "shared memory region '" + name + "' of " + std::to_string(byte_size) +
+                    " bytes at offset " + std::to_string(offset) + " exceeds the " +
+                    std::to_string(object_size) + " bytes of '" + key + "'");
+        }
+
+        // mmap() takes page aligned offsets only
+        const auto page_size = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+        const uint64_t mapping_offset = offset / page_size * page_size;
+        auto r = std::make_shared<region>();
+        r->key_ = key;
+        r->offset_ = offset;
+        r->byte_size_ = byte_size;
+        r->mapping_size_ = byte_size + (offset - mapping_offset);
+        void *mapping = mmap(
+                nullptr, r->mapping_size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+                static_cast<off_t>(mapping_offset));
+        if (mapping == MAP_FAILED) {
+            return flare::result_status(
+                    hercules::common::ERROR_INTERNAL,
+                    "Unable to map shared memory region '" + name + "': " + ErrnoString());
+        }
+        r->mapping_ = mapping;
+        r->base_ = static_cast<char *>(mapping) + (offset - mapping_offset);
+
+        std::lock_guard<std::mutex> lk(mtx_);
+        if (!regions_.emplace(name, std::move(r)).second) {
+            // Registered concurrently, 'r' unmaps on destruction
+            return flare::result_status(
+                    hercules::common::ERROR_ALREADY_EXISTS,
+                    "shared memory region '" + name + "' is already registered");
+        }
+        return flare::result_status::success();
+    }
+
+    flare::result_status
+    shared_memory_manager::unregister_region(const std::string &name) {
+        std::shared_ptr<region> r;
+        {
+            std::lock_guard<std::mutex> lk(mtx_);
+            auto it = regions_.find(name);
+            if (it == regions_.end()) {
+                return flare::result_status(
+                        hercules::common::ERROR_NOT_FOUND,
+                        "shared memory region '" + name + "' is not registered");
+            }
+            r = std::move(it->second);
+            regions_.erase(it);
+        }
+        // Unmapped here unless views still hold it, outside of the lock
+        return flare::result_status::success();
+    }
+
+    flare::result_status
+    shared_memory_manager::unregister_all() {
+        std::map<std::string, std::shared_ptr<region>> regions;
+        {
+            std::lock_guard<std::mutex> lk(mtx_);
+            regions.swap(regions_);
+        }
+        return flare::result_status::success();
+    }
+
+    flare::result_status
+    shared_memory_manager::get_status(
+            const std::string &name, std::vector<region_status> *status) {
+        status->clear();
+        std::lock_guard<std::mutex> lk(mtx_);
+        for (const auto &entry : regions_) {
+            if (!name.empty() && (entry.first != name)) {
+                continue;
+            }
+            region_status region;
+            region.name_ = entry.first;
+            region.key_ = entry.second->key_;
+            region.offset_ = entry.second->offset_;
+            region.byte_size_ = entry.second->byte_size_;
+            status->push_back(std::move(region));
+        }
+        if (!name.empty() && status->empty()) {
+            return flare::result_status(
+                    hercules::common::ERROR_NOT_FOUND,
+                    "shared memory region '" + name + "' is not registered");
+        }
+        return flare::result_status::success();
+    }
+
+    flare::result_status
+    shared_memory_manager::find_range(
+            const std::string &name, uint64_t offset, uint64_t byte_size,
+            std::shared_ptr<region> *region) {
+        {
+            std::lock_guard<std::mutex> lk(mtx_);
+            auto it = regions_.find(name);
+            if (it == regions_.end()) {
+                return flare::result_status(
+                        hercules::common::ERROR_NOT_FOUND,
+                        "shared memory region '" + name + "' is not registered");
+            }
+            *region = it->second;
+        }
+        // Written so that 'offset + byte_size' can't overflow
+        const uint64_t region_size = (*region)->byte_size_;
+        if ((offset > region_size) || (byte_size > region_size - offset)) {
+            region->reset();
+            return flare::result_status(
+                    hercules::common::ERROR_INVALID_ARG,
+                    std::to_string(byte_size) + " bytes at offset " + std::to_string(offset) +
+                    " are out of the " + std::to_string(region_size) +
+                    " bytes of shared memory region '" + name + "'");
+        }
+        return flare::result_status::success();
+    }
+
+    flare::result_status
+    shared_memory_manager::get_memory_reference(
+            const std::string &name, uint64_t offset, uint64_t byte_size,
+            std::unique_ptr<memory_reference> *memory) {
+        std::shared_ptr<region> r;
+        auto status = find_range(name, offset, byte_size, &r);
+        if (!status.is_ok()) {
+            return status;
+        }
+        char *buffer = r->base_ + offset;
+        auto reference = std::make_unique<shared_memory_reference>(std::move(r));
+        reference->add_buffer(buffer, byte_size, hercules::proto::MEMORY_CPU, 0);
+        *memory = std::move(reference);
+        return flare::result_status::success();
+    }
+
+    flare::result_status
+    shared_memory_manager::get_mutable_memory(
+            const std::string &name, uint64_t offset, uint64_t byte_size,
+            std::unique_ptr<mutable_memory> *memory) {
+        std::shared_ptr<region> r;
+        auto status = find_range(name, offset, byte_size, &r);
+        if (!status.is_ok()) {
+            return status;
+        }
+        char *buffer = r->base_ + offset;
+        *memory = std::make_unique<shared_mutable_memory>(std::move(r), buffer, byte_size);
+        return flare::result_status::success();
+    }
+
+}  // namespace hercules::core
@@ -0,0 +1,101 @@
+/****************************************************************
+ * Copyright (c) 2022, liyinbin
+ * All rights reserved.
+ * Author by liyinbin (jeff.li) lijippy@163.com
+ *****************************************************************/
+
+#ifndef HERCULES_CORE_SHARED_MEMORY_MANAGER_H_
+#define HERCULES_CORE_SHARED_MEMORY_MANAGER_H_
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <flare/base/result_status.h>
+#include "hercules/core/memory_base.h"
+
+namespace hercules::core {
+
+    //
+    // Registry of system shared memory regions created by co-located clients,
+    // i.e. through SystemSharedMemoryRegister. A region is a window of a POSIX
+    // shared memory object, or of a memfd passed in process, mapped once at
+    // registration. Tensors in a region are handed out as
+    // views straight into the mapping, so their bytes are never copied.
+    //
+    // A region stays mapped until it is unregistered and the last view into
+    // it is destroyed. Thread safe.
+    //
+    class shared_memory_manager {
+    public:
+        struct region_status {
+            std::string name_;
+            std::string key_;
+            uint64_t offset_ = 0;
+            uint64_t byte_size_ = 0;
+        };
+
+        shared_memory_manager() = default;
+
+        ~shared_memory_manager();
+
+        shared_memory_manager(const shared_memory_manager &) = delete;
+
+        shared_memory_manager &operator=(const shared_memory_manager &) = delete;
+
+        // Register as 'name' the 'byte_size' bytes at 'offset' of the POSIX
+        // shared memory object 'key', i.e. "/x", opened with shm_open(). Keys
+        // are given by clients, so paths, i.e. "/dev/shm/x", are rejected:
+        // they would map any file the server can open.
+        flare::result_status register_region(
+                const std::string &name, const std::string &key, uint64_t offset,
+                uint64_t byte_size);
+
+        // Similar to the above, for a region of the file descriptor 'fd', i.e.
+        // a memfd received over a unix socket. 'fd' is not kept open.
+        flare::result_status register_fd(
+                const std::string &name, int fd, uint64_t offset, uint64_t byte_size);
+
+        flare::result_status unregister_region(const std::string &name);
+
+        flare::result_status unregister_all();
+
+        // Get the status of the region 'name', or of all regions if 'name' is
+        // empty.
+        flare::result_status get_status(
+                const std::string &name, std::vector<region_status> *status);
+
+        // Return a read-only view of the 'byte_size' bytes at 'offset' in the
+        // region 'name', i.e. for an input tensor.
+        flare::result_status get_memory_reference(
+                const std::string &name, uint64_t offset, uint64_t byte_size,
+                std::unique_ptr<memory_reference> *memory);
+
+        // Return a writable view of the 'byte_size' bytes at 'offset' in the
+        // region 'name', i.e. for an output tensor.
+        flare::result_status get_mutable_memory(
+                const std::string &name, uint64_t offset, uint64_t byte_size,
+                std::unique_ptr<mutable_memory> *memory);
+
+    private:
+        struct region;
+
+        flare::result_status add_region(
+                const std::string &name, const std::string &key, int fd, uint64_t offset,
+                uint64_t byte_size);
+
+        // Find the region 'name' and check that 'byte_size' bytes at 'offset'
+        // are within it.
+        flare::result_status find_range(
+                const std::string &name, uint64_t offset, uint64_t byte_size,
+                std::shared_ptr<region> *region);
+
+        std::mutex mtx_;
+        std::map<std::string, std::shared_ptr<region>> regions_;
+    };
+
+}  // namespace hercules::core
+
+#endif  // HERCULES_CORE_SHARED_MEMORY_MANAGER_H_
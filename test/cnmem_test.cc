@@ -0,0 +1,198 @@
+/****************************************************************
+ * Copyright (c) 2022, liyinbin
+ * All rights reserved.
+ * Author by liyinbin (jeff.li) lijippy@163.com
+ *****************************************************************/
+
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <map>
+#include <random>
+#include <gtest/gtest.h>
+#include "hercules/common/cnmem.h"
+
+namespace cnmem {
+
+    namespace {
+
+        constexpr std::size_t kArenaSize = 16 << 20;
+
+        std::size_t
+        Granular(std::size_t size) {
+            return (size + CNMEM_GRANULARITY - 1) / CNMEM_GRANULARITY * CNMEM_GRANULARITY;
+        }
+
+        // The blocks of 'manager' must tile its memory: sorted, not
+        // overlapping, and adding up to the used and free memory.
+        void
+        ExpectConsistent(const Manager &manager, std::size_t size) {
+            MemoryState state;
+            ASSERT_EQ(manager.getStateUnsafe(state), CNMEM_STATUS_SUCCESS);
+            EXPECT_EQ(state.usedMemory + state.freeMemory, size);
+            std::size_t used = 0;
+            std::size_t free = 0;
+            std::size_t largest = 0;
+            for( std::size_t i = 0; i < state.blocks.size(); ++i ) {
+                const BlockState &block = state.blocks[i];
+                if( i != 0 ) {
+                    const BlockState &prev = state.blocks[i - 1];
+                    EXPECT_LE(prev.data + prev.size, block.data);
+                    // Adjacent free blocks are merged
+                    if( prev.data + prev.size == block.data && !block.isHead ) {
+                        EXPECT_FALSE(!prev.isUsed && !block.isUsed);
+                    }
+                }
+                if( block.isUsed ) {
+                    used += block.size;
+                } else {
+                    free += block.size;
+                    largest = std::max(largest, block.size);
+                }
+            }
+            EXPECT_EQ(used, state.usedMemory);
+            EXPECT_EQ(free, state.freeMemory);
+            EXPECT_EQ(largest, state.largestFreeBlock);
+        }
+
+        // Allocate and release 'ops' random blocks, checking that blocks
+        // don't overlap and keep their bytes.
+        void
+        Churn(Manager &manager, std::size_t ops, unsigned seed) {
+            std::mt19937_64 rng(seed);
+            std::map<char*, std::size_t> live;
+            for( std::size_t i = 0; i < ops; ++i ) {
+                if( live.empty() || (live.size() < 512 && rng() % 2 == 0) ) {
+                    const std::size_t size = Granular(rng() % 70000 + 1);
+                    void *ptr = NULL;
+                    if( manager.allocate(ptr, size) != CNMEM_STATUS_SUCCESS ) {
+                        ASSERT_EQ(ptr, nullptr);
+                        continue;
+                    }
+                    char *data = static_cast<char*>(ptr);
+                    ASSERT_EQ(reinterpret_cast<uintptr_t>(data) % CNMEM_GRANULARITY, 0u);
+                    auto next = live.upper_bound(data);
+                    if( next != live.end() ) {
+                        ASSERT_LE(data + size, next->first);
+                    }
+                    if( next != live.begin() ) {
+                        auto prev = std::prev(next);
+                        ASSERT_LE(prev->first + prev->second, data);
+                    }
+                    memset(data, static_cast<int>(size / CNMEM_GRANULARITY), size);
+                    live.emplace(data, size);
+                } else {
+                    auto it = live.begin();
+                    std::advance(it, rng() % live.size());
+                    const char expected = static_cast<char>(it->second / CNMEM_GRANULARITY);
+                    ASSERT_EQ(it->first[0], expected);
+                    ASSERT_EQ(it->first[it->second - 1], expected);
+                    ASSERT_EQ(manager.release(it->first), CNMEM_STATUS_SUCCESS);
+                    live.erase(it);
+                }
+                if( i % 1024 == 0 ) {
+                    ExpectConsistent(manager, kArenaSize);
+                }
+            }
+            for( auto &block : live ) {
+                ASSERT_EQ(manager.release(block.first), CNMEM_STATUS_SUCCESS);
+            }
+        }
+
+    }  // namespace
+
+    TEST(cnmem, arena_churn) {
+        HostBacking backing;
+        Manager manager;
+        manager.setBacking(&backing);
+        manager.setFlags(CNMEM_FLAGS_CANNOT_GROW);
+        ASSERT_EQ(manager.reserve(kArenaSize), CNMEM_STATUS_SUCCESS);
+
+        Churn(manager, 50000, 1);
+        ExpectConsistent(manager, kArenaSize);
+        std::size_t used = 0;
+        std::size_t largest = 0;
+        manager.getUsedMemoryUnsafe(used);
+        manager.getLargestFreeBlockUnsafe(largest);
+        EXPECT_EQ(used, 0u);
+        EXPECT_EQ(largest, kArenaSize);
+
+        // The block records are pooled, a second run reuses them
+        std::size_t metadata = 0;
+        std::size_t blocks = 0;
+        manager.getMetadataUnsafe(metadata, blocks);
+        EXPECT_GT(blocks, 0u);
+        Churn(manager, 50000, 1);
+        std::size_t metadata_after = 0;
+        manager.getMetadataUnsafe(metadata_after, blocks);
+        EXPECT_EQ(metadata_after, metadata);
+    }
+
+    TEST(cnmem, child_grows_from_parent) {
+        HostBacking backing;
+        Manager root;
+        root.setBacking(&backing);
+        ASSERT_EQ(root.reserve(1 << 20), CNMEM_STATUS_SUCCESS);
+        Manager *child = new Manager;
+        child->setParent(&root);
+        child->setBacking(&backing);
+        child->setStream(reinterpret_cast<void*>(1), true);
+        ASSERT_EQ(child->reserve(256 << 10), CNMEM_STATUS_SUCCESS);
+        ASSERT_EQ(root.addChild(child), CNMEM_STATUS_SUCCESS);
+
+        void *small = NULL;
+        void *large = NULL;
+        ASSERT_EQ(child->allocate(small, 4096), CNMEM_STATUS_SUCCESS);
+        // Past its reservation, the child takes a block of the root
+        ASSERT_EQ(child->allocate(large, 512 << 10), CNMEM_STATUS_SUCCESS);
+        std::size_t used = 0;
+        root.getUsedMemoryUnsafe(used);
+        EXPECT_EQ(used, (256u << 10) + (512u << 10));
+
+        ASSERT_EQ(child->release(small), CNMEM_STATUS_SUCCESS);
+        ASSERT_EQ(child->release(large), CNMEM_STATUS_SUCCESS);
+        ExpectConsistent(root, 1 << 20);
+        // 'root' deletes its children
+    }
+
+    TEST(cnmem, parent_steals_from_child) {
+        HostBacking backing;
+        Manager root;
+        root.setBacking(&backing);
+        ASSERT_EQ(root.reserve(1 << 20), CNMEM_STATUS_SUCCESS);
+        Manager *child = new Manager;
+        child->setParent(&root);
+        child->setBacking(&backing);
+        child->setStream(reinterpret_cast<void*>(1), true);
+        ASSERT_EQ(child->reserve(512 << 10), CNMEM_STATUS_SUCCESS);
+        ASSERT_EQ(root.addChild(child), CNMEM_STATUS_SUCCESS);
+        root.setFlags(CNMEM_FLAGS_CANNOT_GROW);
+
+        // The root is left with 512KB and can't grow
+        void *ptr = NULL;
+        EXPECT_EQ(root.allocate(ptr, 768 << 10), CNMEM_STATUS_OUT_OF_MEMORY);
+        EXPECT_EQ(ptr, nullptr);
+
+        // The free memory of the child can be taken back
+        std::size_t root_used = 0;
+        root.getUsedMemoryUnsafe(root_used);
+        void *stolen = NULL;
+        ASSERT_EQ(root.stealUnsafe(stolen, 100 << 10), CNMEM_STATUS_SUCCESS);
+        ASSERT_NE(stolen, nullptr);
+        std::size_t child_free = 0;
+        child->getFreeMemoryUnsafe(child_free);
+        EXPECT_EQ(child_free, (512u << 10) - (100u << 10));
+        // Carved out of the block the child holds, already used by the root
+        std::size_t root_used_after = 0;
+        root.getUsedMemoryUnsafe(root_used_after);
+        EXPECT_EQ(root_used_after, root_used);
+
+        ASSERT_EQ(root.release(stolen), CNMEM_STATUS_SUCCESS);
+        ExpectConsistent(root, 1 << 20);
+
+        // Not when stealing is disabled
+        root.setFlags(CNMEM_FLAGS_CANNOT_GROW | CNMEM_FLAGS_CANNOT_STEAL);
+        EXPECT_EQ(root.stealUnsafe(stolen, 100 << 10), CNMEM_STATUS_INVALID_ARGUMENT);
+    }
+
+}  // namespace cnmem
@@ -0,0 +1,201 @@
+/****************************************************************
+ * Copyright (c) 2022, liyinbin
+ * All rights reserved.
+ * Author by liyinbin (jeff.li) lijippy@163.com
+ *****************************************************************/
+
+#include <cstring>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <gtest/gtest.h>
+#include "hercules/common/async_work_queue.h"
+#include "hercules/core/cuda_util.h"
+#include "hercules/core/memory_base.h"
+#include "hercules/core/pinned_memory_manager.h"
+
+namespace hercules::core {
+
+    namespace {
+
+        // Buffers of various sizes, including empty ones, with distinct bytes.
+        std::vector<std::vector<char>>
+        MakeBuffers(size_t count) {
+            std::vector<std::vector<char>> buffers(count);
+            for (size_t i = 0; i < count; ++i) {
+                buffers[i].resize((i % 5 == 3) ? 0 : 1000 + (i * 37) % 70000);
+                for (size_t j = 0; j < buffers[i].size(); ++j) {
+                    buffers[i][j] = static_cast<char>(i * 131 + j);
+                }
+            }
+            return buffers;
+        }
+
+        std::vector<char>
+        Concat(const std::vector<std::vector<char>> &buffers) {
+            std::vector<char> bytes;
+            for (const auto &buffer : buffers) {
+                bytes.insert(bytes.end(), buffer.begin(), buffer.end());
+            }
+            return bytes;
+        }
+
+        // Reference 'buffers' in order, added at the front if 'front'.
+        void
+        AddBuffers(
+                const std::vector<std::vector<char>> &buffers, bool front,
+                memory_reference *memory) {
+            for (size_t i = 0; i < buffers.size(); ++i) {
+                if (front) {
+                    const auto &buffer = buffers[buffers.size() - 1 - i];
+                    memory->add_buffer_front(
+                            buffer.data(), buffer.size(), hercules::proto::MEMORY_CPU, 0);
+                } else {
+                    memory->add_buffer(
+                            buffers[i].data(), buffers[i].size(), hercules::proto::MEMORY_CPU, 0);
+                }
+            }
+        }
+
+        void
+        ExpectGathered(memory_reference *memory, const std::vector<char> &expected) {
+            const char *buffer = nullptr;
+            hercules::proto::MemoryType memory_type = hercules::proto::MEMORY_CPU_BINDING;
+            int64_t memory_type_id = 0;
+            ASSERT_TRUE(memory->contiguous(&buffer, &memory_type, &memory_type_id).is_ok());
+            ASSERT_EQ(memory->total_byte_size(), expected.size());
+            ASSERT_NE(buffer, nullptr);
+            EXPECT_NE(memory_type, hercules::proto::MEMORY_GPU);
+            EXPECT_EQ(memcmp(buffer, expected.data(), expected.size()), 0);
+
+            // Gathered once
+            const char *again = nullptr;
+            ASSERT_TRUE(memory->contiguous(&again, &memory_type, &memory_type_id).is_ok());
+            EXPECT_EQ(again, buffer);
+        }
+
+        void
+        RunGathers() {
+            for (size_t count : {2, 3, 16, 200}) {
+                for (bool front : {false, true}) {
+                    const auto buffers = MakeBuffers(count);
+                    memory_reference memory;
+                    AddBuffers(buffers, front, &memory);
+                    auto expected = Concat(buffers);
+                    ExpectGathered(&memory, expected);
+
+                    // Adding a buffer gathers again
+                    const char extra[3] = {1, 2, 3};
+                    memory.add_buffer(extra, sizeof(extra), hercules::proto::MEMORY_CPU, 0);
+                    expected.insert(expected.end(), extra, extra + sizeof(extra));
+                    ExpectGathered(&memory, expected);
+                }
+            }
+        }
+
+    }  // namespace
+
+    class memory_base_test : public ::testing::Test {
+    protected:
+        static void SetUpTestSuite() {
+            ASSERT_TRUE(
+                    pinned_memory_manager::create(pinned_memory_manager::options(64 << 20)).is_ok());
+        }
+    };
+
+    TEST_F(memory_base_test, single_buffer_is_not_copied) {
+        std::vector<char> bytes(100, 1);
+        memory_reference memory;
+        memory.add_buffer(bytes.data(), bytes.size(), hercules::proto::MEMORY_CPU, 0);
+        const char *buffer = nullptr;
+        hercules::proto::MemoryType memory_type = hercules::proto::MEMORY_CPU_BINDING;
+        int64_t memory_type_id = 0;
+        ASSERT_TRUE(memory.contiguous(&buffer, &memory_type, &memory_type_id).is_ok());
+        EXPECT_EQ(buffer, bytes.data());
+        EXPECT_EQ(memory_type, hercules::proto::MEMORY_CPU);
+    }
+
+    TEST_F(memory_base_test, empty_buffers_are_skipped) {
+        std::vector<char> bytes(100, 1);
+        char byte;
+        memory_reference memory;
+        memory.add_buffer(&byte, 0, hercules::proto::MEMORY_CPU, 0);
+        memory.add_buffer(bytes.data(), bytes.size(), hercules::proto::MEMORY_CPU, 0);
+        memory.add_buffer(&byte, 0, hercules::proto::MEMORY_CPU, 0);
+        const char *buffer = nullptr;
+        hercules::proto::MemoryType memory_type = hercules::proto::MEMORY_CPU_BINDING;
+        int64_t memory_type_id = 0;
+        ASSERT_TRUE(memory.contiguous(&buffer, &memory_type, &memory_type_id).is_ok());
+        EXPECT_EQ(buffer, bytes.data());
+        EXPECT_EQ(memory_type, hercules::proto::MEMORY_CPU);
+    }
+
+    TEST_F(memory_base_test, empty_memory) {
+        const char *buffer = reinterpret_cast<const char *>(this);
+        hercules::proto::MemoryType memory_type = hercules::proto::MEMORY_CPU_BINDING;
+        int64_t memory_type_id = 1;
+        memory_reference memory;
+        ASSERT_TRUE(memory.contiguous(&buffer, &memory_type, &memory_type_id).is_ok());
+        EXPECT_EQ(buffer, nullptr);
+        EXPECT_EQ(memory_type, hercules::proto::MEMORY_CPU);
+        EXPECT_EQ(memory_type_id, 0);
+
+        char byte;
+        memory.add_buffer(&byte, 0, hercules::proto::MEMORY_CPU, 0);
+        memory.add_buffer(&byte, 0, hercules::proto::MEMORY_CPU, 0);
+        buffer = &byte;
+        memory_type = hercules::proto::MEMORY_CPU_BINDING;
+        ASSERT_TRUE(memory.contiguous(&buffer, &memory_type, &memory_type_id).is_ok());
+        EXPECT_EQ(buffer, nullptr);
+        EXPECT_EQ(memory_type, hercules::proto::MEMORY_CPU);
+    }
+
+    TEST_F(memory_base_test, gather) {
+        RunGathers();
+    }
+
+    TEST_F(memory_base_test, concurrent_gather) {
+        const auto buffers = MakeBuffers(8);
+        const auto expected = Concat(buffers);
+        for (int round = 0; round < 50; ++round) {
+            memory_reference memory;
+            AddBuffers(buffers, false, &memory);
+            std::vector<const char *> gathered(8, nullptr);
+            std::vector<std::thread> threads;
+            for (size_t i = 0; i < gathered.size(); ++i) {
+                threads.emplace_back([&memory, &gathered, i]() {
+                    hercules::proto::MemoryType memory_type = hercules::proto::MEMORY_CPU;
+                    int64_t memory_type_id = 0;
+                    EXPECT_TRUE(
+                            memory.contiguous(&gathered[i], &memory_type, &memory_type_id).is_ok());
+                });
+            }
+            for (auto &thread : threads) {
+                thread.join();
+            }
+            for (const char *buffer : gathered) {
+                ASSERT_EQ(buffer, gathered[0]);
+            }
+            EXPECT_EQ(memcmp(gathered[0], expected.data(), expected.size()), 0);
+        }
+    }
+
+    TEST_F(memory_base_test, parallel_gather) {
+        ASSERT_TRUE(hercules::common::async_work_queue::initialize(4).is_ok());
+        // Every gather is split in chunks of 64 bytes
+        set_host_copy_options(host_copy_options(1, 64));
+        RunGathers();
+
+        const auto buffers = MakeBuffers(16);
+        const auto expected = Concat(buffers);
+        std::vector<std::pair<const char *, size_t>> srcs;
+        for (const auto &buffer : buffers) {
+            srcs.emplace_back(buffer.data(), buffer.size());
+        }
+        std::vector<char> dst(expected.size());
+        GatherHostBuffers(srcs, dst.data(), true /* non_temporal */);
+        EXPECT_EQ(dst, expected);
+        set_host_copy_options(host_copy_options());
+    }
+
+}  // namespace hercules::core
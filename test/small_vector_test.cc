@@ -0,0 +1,115 @@
+/****************************************************************
+ * Copyright (c) 2022, liyinbin
+ * All rights reserved.
+ * Author by liyinbin (jeff.li) lijippy@163.com
+ *****************************************************************/
+
+#include <deque>
+#include <memory>
+#include <random>
+#include <string>
+#include <gtest/gtest.h>
+#include "hercules/common/small_vector.h"
+
+namespace hercules::common {
+
+    namespace {
+
+        int live_values = 0;
+
+        // Owns heap memory, so that leaked or doubly destroyed elements show
+        // under the sanitizers, and counts the live instances.
+        struct value {
+            explicit value(int i) : str_(new std::string(std::to_string(i))) { ++live_values; }
+
+            value(const value &other) : str_(new std::string(*other.str_)) { ++live_values; }
+
+            value(value &&other) noexcept: str_(std::move(other.str_)) { ++live_values; }
+
+            ~value() { --live_values; }
+
+            std::unique_ptr<std::string> str_;
+        };
+
+        template<typename Vector>
+        void
+        ExpectEqual(const Vector &vector, const std::deque<int> &expected) {
+            ASSERT_EQ(vector.size(), expected.size());
+            size_t i = 0;
+            for (const auto &element : vector) {
+                ASSERT_NE(element.str_, nullptr);
+                ASSERT_EQ(*element.str_, std::to_string(expected[i++]));
+            }
+        }
+
+        // Grow random sequences at both ends, checked against a std::deque,
+        // and copy and move them around.
+        template<size_t N>
+        void
+        RunAgainstDeque(unsigned seed) {
+            std::mt19937 rng(seed);
+            for (int round = 0; round < 2000; ++round) {
+                small_vector<value, N> vector;
+                std::deque<int> expected;
+                const int ops = static_cast<int>(rng() % 40);
+                for (int i = 0; i < ops; ++i) {
+                    const int x = static_cast<int>(rng() % 1000);
+                    if (rng() % 2 == 0) {
+                        vector.emplace_back(x);
+                        expected.push_back(x);
+                    } else {
+                        vector.emplace_front(x);
+                        expected.push_front(x);
+                    }
+                    ASSERT_EQ(*vector.front().str_, std::to_string(expected.front()));
+                    ASSERT_EQ(*vector.back().str_, std::to_string(expected.back()));
+                }
+                ExpectEqual(vector, expected);
+                EXPECT_GE(vector.capacity(), vector.size());
+
+                auto copy = vector;
+                ExpectEqual(copy, expected);
+                auto moved = std::move(copy);
+                EXPECT_TRUE(copy.empty());
+                ExpectEqual(moved, expected);
+                copy = moved;
+                ExpectEqual(copy, expected);
+                moved = std::move(vector);
+                ExpectEqual(moved, expected);
+
+                moved.clear();
+                EXPECT_TRUE(moved.empty());
+                moved.emplace_front(1);
+                ExpectEqual(moved, {1});
+            }
+        }
+
+    }  // namespace
+
+    TEST(small_vector, inline_storage) {
+        small_vector<value, 2> vector;
+        const auto is_inline = [&vector](const value &element) {
+            const auto *object = reinterpret_cast<const char *>(&vector);
+            const auto *address = reinterpret_cast<const char *>(&element);
+            return (address >= object) && (address < object + sizeof(vector));
+        };
+        vector.emplace_back(1);
+        vector.emplace_front(0);
+        // Two elements fit inline
+        EXPECT_EQ(vector.capacity(), 2u);
+        EXPECT_TRUE(is_inline(vector[0]));
+        EXPECT_TRUE(is_inline(vector[1]));
+        vector.emplace_back(2);
+        EXPECT_GT(vector.capacity(), 2u);
+        EXPECT_FALSE(is_inline(vector[0]));
+        ExpectEqual(vector, {0, 1, 2});
+    }
+
+    TEST(small_vector, against_deque) {
+        RunAgainstDeque<1>(1);
+        RunAgainstDeque<2>(2);
+        RunAgainstDeque<4>(3);
+        EXPECT_EQ(live_values, 0);
+    }
+
+}  // namespace hercules::common